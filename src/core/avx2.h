@@ -0,0 +1,43 @@
+/* avx2.h
+ *
+ * Kubo Ryosuke
+ */
+
+#ifndef SUNFISH_AVX2__
+#define SUNFISH_AVX2__
+
+// AVX2 のコードは関数単位で target 属性を付けてビルドし、
+// 実行時に CPU が対応している場合のみ使用します。
+#if !defined(USE_AVX2)
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define USE_AVX2 1
+# else
+#  define USE_AVX2 0
+# endif
+#endif
+
+#if USE_AVX2
+# include <immintrin.h>
+# define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace sunfish {
+
+/**
+ * 実行中の CPU が AVX2 に対応しているかどうかを返します。
+ */
+inline bool isAvx2Supported() {
+#if USE_AVX2
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+} // namespace sunfish
+
+#endif // SUNFISH_AVX2__
@@ -6,12 +6,86 @@
 #ifndef SUNFISH_BMI__
 #define SUNFISH_BMI__
 
-#if !defined(USE_BMI2)
-# define USE_BMI2 0
+#include <cstdint>
+
+// PEXT を使用するコードは常にビルドし、
+// 実行時に CPU が BMI2 に対応していて PEXT が高速な場合のみ使用します。
+#if !defined(USE_PEXT)
+# if defined(__GNUC__) && defined(__x86_64__)
+#  define USE_PEXT 1
+# else
+#  define USE_PEXT 0
+# endif
 #endif
 
-#if USE_BMI2
+#if USE_PEXT
 # include <immintrin.h>
+# include <cpuid.h>
 #endif
 
+namespace sunfish {
+
+#if USE_PEXT
+/**
+ * PEXT 命令
+ * -mbmi2 を指定せずにビルドした場合もインライン展開できるようにアセンブラで記述します。
+ */
+inline uint64_t pext(uint64_t src, uint64_t mask) {
+#if defined(__BMI2__)
+  return _pext_u64(src, mask);
+#else
+  uint64_t result;
+  __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(src), "r"(mask));
+  return result;
+#endif
+}
+#endif
+
+/**
+ * 実行中の CPU が BMI2 に対応しているかどうかを返します。
+ */
+inline bool isBmi2Supported() {
+#if USE_PEXT
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2") != 0;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+/**
+ * 実行中の CPU で PEXT が高速に動作するかどうかを返します。
+ * Zen2 以前の AMD の CPU ではマイクロコードで実装されていて低速なため false を返します。
+ */
+inline bool isPextFast() {
+#if USE_PEXT
+  static const bool fast = []() {
+    if (!isBmi2Supported()) {
+      return false;
+    }
+    if (!__builtin_cpu_is("amd")) {
+      return true;
+    }
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+      return false;
+    }
+    unsigned family = (eax >> 8) & 0x0f;
+    if (family == 0x0f) {
+      family += (eax >> 20) & 0xff;
+    }
+    // Zen3 (family 19h) 以降
+    return family >= 0x19;
+  }();
+  return fast;
+#else
+  return false;
+#endif
+}
+
+} // namespace sunfish
+
 #endif // SUNFISH_BMI__
@@ -91,6 +91,8 @@ void Board::init() {
     board_[sq.index()] = Piece::Empty;
   }
 
+  pieceListSize_ = 0;
+
   refreshHash();
 }
 
@@ -160,8 +162,13 @@ void Board::init(Handicap handicap) {
     black_ = false;
     bbWBishop_.unset(Square(2, 2));
     bbWRook_.unset(Square(8, 2));
+    bbWOccupy_.unset(Square(2, 2));
+    bbWOccupy_.unset(Square(8, 2));
+    board_[Square(2, 2).index()] = Piece::Empty;
+    board_[Square(8, 2).index()] = Piece::Empty;
   }
 
+  refreshPieceList_();
   refreshHash();
 }
 
@@ -199,6 +206,21 @@ void Board::init(const CompactBoard& cheapBoard) {
       }
     }
   }
+
+  refreshPieceList_();
+}
+
+/**
+ * 盤面から駒リストを作り直します。
+ */
+void Board::refreshPieceList_() {
+  pieceListSize_ = 0;
+  SQUARE_EACH(sq) {
+    auto piece = board_[sq.index()];
+    if (piece.exists() && piece.kindOnly() != Piece::King) {
+      addPieceList_(sq);
+    }
+  }
 }
 
 void Board::refreshHash() {
@@ -234,6 +256,41 @@ for (int i = 0; i < num; i++) { \
 
 }
 
+/**
+ * 指定した手を指した後の局面のハッシュ値を返します。
+ * 局面は変更しないため, 着手前にハッシュ表をプリフェッチする用途に使用します。
+ */
+uint64_t Board::getHashAfter(const Move& move) const {
+  uint64_t boardHash = boardHash_;
+  uint64_t handHash = handHash_;
+  Piece piece = move.piece();
+  const auto& to = move.to();
+  const auto& hand = black_ ? blackHand_ : whiteHand_;
+
+  if (move.isHand()) {
+    int num = hand.get(piece) - 1;
+    handHash ^= black_ ? Zobrist::handBlack(piece, num) : Zobrist::handWhite(piece, num);
+  } else {
+    boardHash ^= Zobrist::board(move.from(), black_ ? piece : piece.white());
+
+    const auto& captured = board_[to.index()];
+    if (captured.exists()) {
+      boardHash ^= Zobrist::board(to, captured);
+      Piece captured_k = captured.kindOnly().unpromote();
+      int num = hand.get(captured_k);
+      handHash ^= black_ ? Zobrist::handBlack(captured_k, num) : Zobrist::handWhite(captured_k, num);
+    }
+
+    if (move.promote()) {
+      piece = piece.promote();
+    }
+  }
+
+  boardHash ^= Zobrist::board(to, black_ ? piece : piece.white());
+
+  return boardHash ^ handHash ^ (black_ ? 0ull : Zobrist::black());
+}
+
 /**
  * 冗長性の低いデータに変換します。
  */
@@ -385,10 +442,66 @@ bool Board::isPin_(const Square& sq, const Bitboard& occ) const {
 template bool Board::isPin_<true>(const Square& sq, const Bitboard& occ) const;
 template bool Board::isPin_<false>(const Square& sq, const Bitboard& occ) const;
 
+/**
+ * ピンされている駒を列挙します。
+ */
+template<bool black>
+Bitboard Board::getPinnedPieces_() const {
+  Bitboard pinned(0x00LL, 0x00LL);
+  auto king = black ? sqBKing_ : sqWKing_;
+  if (!king.isValid()) {
+    return pinned;
+  }
+
+  // 玉から直接見える味方の駒のみが候補
+  auto occ = bbBOccupy_ | bbWOccupy_;
+  Bitboard bb = MoveTables::rook(king, occ) | MoveTables::bishop(king, occ);
+  bb &= black ? bbBOccupy_ : bbWOccupy_;
+  BB_EACH_OPE(sq, bb, {
+    if (isPin_<black>(sq, occ)) {
+      pinned.set(sq);
+    }
+  });
+
+  return pinned;
+}
+template Bitboard Board::getPinnedPieces_<true>() const;
+template Bitboard Board::getPinnedPieces_<false>() const;
+
+/**
+ * ピンされた駒の移動可能な直線を返します。
+ */
+template<bool black>
+Bitboard Board::getPinLine_(const Square& sq) const {
+  auto occ = bbBOccupy_ | bbWOccupy_;
+  switch (PinDirTable::get(sq, black ? sqBKing_ : sqWKing_)) {
+  case PinDir::Up:
+  case PinDir::Down:
+    return MoveTables::vertical(sq, occ);
+  case PinDir::Hor:
+    return MoveTables::horizontal(sq, occ);
+  case PinDir::RightUp:
+    return MoveTables::rightUpX(sq, occ);
+  case PinDir::RightDown:
+    return MoveTables::rightDownX(sq, occ);
+  default:
+    return ~Bitboard::Zero();
+  }
+}
+template Bitboard Board::getPinLine_<true>(const Square& sq) const;
+template Bitboard Board::getPinLine_<false>(const Square& sq) const;
+
 /**
  * 盤面の駒をセットします。
  */
 void Board::setBoardPiece(const Square& sq, const Piece& piece) {
+  auto prev = board_[sq.index()];
+  if (prev.exists() && prev.kindOnly() != Piece::King) {
+    removePieceList_(sq);
+  }
+  if (piece.exists() && piece.kindOnly() != Piece::King) {
+    addPieceList_(sq);
+  }
   board_[sq.index()] = piece;
   if (sqBKing_ == sq) {
     sqBKing_ = Square::Invalid;
@@ -1051,8 +1164,9 @@ template bool Board::isValidMoveStrict_<false>(const Move& move) const;
 /**
  * 指定した手で局面を進めます。
  * @param move
+ * @param legal true の場合は合法手チェックを省略します。
  */
-template<bool black>
+template<bool black, bool legal>
 bool Board::makeMove_(Move& move) {
   bool promote = move.promote();
   const auto& piece = move.piece();
@@ -1060,7 +1174,9 @@ bool Board::makeMove_(Move& move) {
 
   if (move.isHand()) {
 
-    if (!isValidMove_<black>(piece, to)) {
+    if (legal) {
+      assert(isValidMove_<black>(piece, to));
+    } else if (!isValidMove_<black>(piece, to)) {
       return false;
     }
 
@@ -1069,11 +1185,15 @@ bool Board::makeMove_(Move& move) {
     int num = hand.decUnsafe(piece);
     handHash_ ^= black ? Zobrist::handBlack(piece, num) : Zobrist::handWhite(piece, num);
 
+    addPieceList_(to);
+
   } else { // !move.isHand()
 
     const auto& from = move.from();
 
-    if (!isValidMove_<black>(piece, from, to)) {
+    if (legal) {
+      assert((isValidMove_<black>(piece, from, to)));
+    } else if (!isValidMove_<black>(piece, from, to)) {
       return false;
     }
 
@@ -1170,6 +1290,7 @@ bool Board::makeMove_(Move& move) {
         }
       }
       boardHash_ ^= Zobrist::board(to, captured);
+      removePieceList_(to);
 
       // hand
       auto& hand = black ? blackHand_ : whiteHand_;
@@ -1177,6 +1298,10 @@ bool Board::makeMove_(Move& move) {
       int num = hand.incUnsafe(captured_k) - 1;
       handHash_ ^= black ? Zobrist::handBlack(captured_k, num) : Zobrist::handWhite(captured_k, num);
     }
+
+    if (piece != Piece::King) {
+      movePieceList_(from, to);
+    }
   }
 
   // to
@@ -1305,8 +1430,10 @@ bool Board::makeMove_(Move& move) {
   return true;
 }
 
-template bool Board::makeMove_<true>(Move&);
-template bool Board::makeMove_<false>(Move&);
+template bool Board::makeMove_<true, false>(Move&);
+template bool Board::makeMove_<false, false>(Move&);
+template bool Board::makeMove_<true, true>(Move&);
+template bool Board::makeMove_<false, true>(Move&);
 
 /**
  * 局面を1手戻します。
@@ -1325,6 +1452,7 @@ bool Board::unmakeMove_(const Move& move) {
     handHash_ ^= black ? Zobrist::handBlack(piece, num) : Zobrist::handWhite(piece, num);
 
     board_[to.index()] = Piece::Empty;
+    removePieceList_(to);
 
   } else { // !move.isHand()
 
@@ -1379,6 +1507,9 @@ bool Board::unmakeMove_(const Move& move) {
       board_[from.index()] = piece_w;
       boardHash_ ^= Zobrist::board(from, piece_w);
     }
+    if (piece != Piece::King) {
+      movePieceList_(to, from);
+    }
 
     // capturing
     if (move.isCapturing()) {
@@ -1435,6 +1566,7 @@ bool Board::unmakeMove_(const Move& move) {
       Piece captured_u = captured.unpromote();
       int num = hand.decUnsafe(captured_u);
       handHash_ ^= black ? Zobrist::handBlack(captured_u, num) : Zobrist::handWhite(captured_u, num);
+      addPieceList_(to);
     } else {
       board_[to.index()] = Piece::Empty;
     }
@@ -1524,6 +1656,52 @@ bool Board::unmakeMove_(const Move& move) {
 template bool Board::unmakeMove_<true>(const Move& move);
 template bool Board::unmakeMove_<false>(const Move& move);
 
+/**
+ * 記録を使って局面を1手戻します。
+ */
+void Board::unmakeMove(const UndoRecord& undo) {
+  bool black = !black_;
+  const auto& to = undo.to;
+  Piece placed = board_[to.index()];
+  auto& occ = black ? bbBOccupy_ : bbWOccupy_;
+  assert(placed.exists());
+
+  getBB(placed).unset(to);
+  occ.unset(to);
+
+  if (undo.from.isInvalid()) {
+    // drop
+    board_[to.index()] = Piece::Empty;
+    removePieceList_(to);
+
+  } else {
+    const auto& from = undo.from;
+    assert(board_[from.index()] == Piece::Empty);
+    getBB(undo.moved).set(from);
+    occ.set(from);
+    board_[from.index()] = undo.moved;
+    if (undo.moved.kindOnly() != Piece::King) {
+      movePieceList_(to, from);
+    }
+
+    // capturing
+    if (undo.captured.exists()) {
+      getBB(undo.captured).set(to);
+      (black ? bbWOccupy_ : bbBOccupy_).set(to);
+      addPieceList_(to);
+    }
+    board_[to.index()] = undo.captured;
+  }
+
+  (black ? blackHand_ : whiteHand_) = undo.hand;
+  boardHash_ = undo.boardHash;
+  handHash_ = undo.handHash;
+  sqBKing_ = undo.sqBKing;
+  sqWKing_ = undo.sqWKing;
+
+  black_ = black;
+}
+
 /**
  * パスをして相手に手番を渡します。
  */
@@ -1579,6 +1757,23 @@ bool Board::validate() const {
       }
     }
   }
+
+  // piece list
+  int count = 0;
+  SQUARE_EACH(sq) {
+    auto piece = board_[sq.index()];
+    if (piece.exists() && piece.kindOnly() != Piece::King) {
+      int slot = pieceSlot_[sq.index()];
+      if (slot >= pieceListSize_ || pieceList_[slot] != sq.index()) {
+        return false;
+      }
+      count++;
+    }
+  }
+  if (count != pieceListSize_) {
+    return false;
+  }
+
   return true;
 }
 
@@ -27,7 +27,28 @@ struct CompactBoard {
   uint16_t buf[41];
 };
 
+/**
+ * 局面を1手戻すための記録
+ * ハッシュ値, 手番側の持ち駒, 玉の位置は保存した値をそのまま書き戻します。
+ */
+struct UndoRecord {
+  uint64_t boardHash;
+  uint64_t handHash;
+  Hand hand;
+  Piece moved;
+  Piece captured;
+  Square from;
+  Square to;
+  Square sqBKing;
+  Square sqWKing;
+};
+
 class Board {
+public:
+
+  /** 盤上にある玉以外の駒の最大数 */
+  static CONSTEXPR_CONST int MaxPieceListSize = 38;
+
 private:
 
   Bitboard bbBOccupy_;
@@ -75,6 +96,30 @@ private:
 
   Piece board_[Square::N];
 
+  /** 玉以外の盤上の駒の位置 (slot 毎に固定) */
+  uint8_t pieceList_[MaxPieceListSize];
+  /** 升目から pieceList_ の slot への逆引き */
+  uint8_t pieceSlot_[Square::N];
+  int pieceListSize_;
+
+  void addPieceList_(const Square& sq) {
+    assert(pieceListSize_ < MaxPieceListSize);
+    pieceSlot_[sq.index()] = (uint8_t)pieceListSize_;
+    pieceList_[pieceListSize_++] = (uint8_t)sq.index();
+  }
+  void removePieceList_(const Square& sq) {
+    int slot = pieceSlot_[sq.index()];
+    uint8_t last = pieceList_[--pieceListSize_];
+    pieceList_[slot] = last;
+    pieceSlot_[last] = (uint8_t)slot;
+  }
+  void movePieceList_(const Square& from, const Square& to) {
+    int slot = pieceSlot_[from.index()];
+    pieceList_[slot] = (uint8_t)to.index();
+    pieceSlot_[to.index()] = (uint8_t)slot;
+  }
+  void refreshPieceList_();
+
   Bitboard& getBB(const Piece& piece) {
     return *(const_cast<Bitboard*>(&getBB_(piece)));
   }
@@ -95,8 +140,26 @@ private:
   template<bool black> bool isValidMove_(const Piece& piece, const Square& to) const;
   template<bool black> bool isValidMove_(const Piece& piece, const Square& from, const Square& to) const;
   template<bool black> bool isValidMoveStrict_(const Move& move) const;
-  template<bool black> bool makeMove_(Move& move);
+  template<bool black> Bitboard getPinnedPieces_() const;
+  template<bool black> Bitboard getPinLine_(const Square& sq) const;
+  template<bool black, bool legal> bool makeMove_(Move& move);
   template<bool black> bool unmakeMove_(const Move& move);
+  void saveUndo_(const Move& move, UndoRecord& undo) const {
+    undo.boardHash = boardHash_;
+    undo.handHash = handHash_;
+    undo.hand = black_ ? blackHand_ : whiteHand_;
+    undo.to = move.to();
+    if (move.isHand()) {
+      undo.moved = Piece::Empty;
+      undo.from = Square();
+    } else {
+      undo.from = move.from();
+      undo.moved = board_[undo.from.index()];
+    }
+    undo.captured = board_[undo.to.index()];
+    undo.sqBKing = sqBKing_;
+    undo.sqWKing = sqWKing_;
+  }
 
 public:
 
@@ -137,11 +200,28 @@ public:
   uint64_t getNoTurnHash() const {
     return getBoardHash() ^ getHandHash();
   }
+  /** 指定した手を指した後の局面のハッシュ値を返します。 */
+  uint64_t getHashAfter(const Move& move) const;
+  /** 指定した手を指した後の局面の手番を除くハッシュ値を返します。 */
+  uint64_t getNoTurnHashAfter(const Move& move) const {
+    return getHashAfter(move) ^ (black_ ? 0ull : Zobrist::black());
+  }
 
   /** 盤面の駒を取得します。 */
   Piece getBoardPiece(const Square& sq) const {
     return board_[sq.index()];
   }
+  /** 盤上にある玉以外の駒の数を返します。 */
+  int getPieceListSize() const {
+    return pieceListSize_;
+  }
+  /**
+   * 盤上にある玉以外の駒の位置を返します。
+   * 各駒の slot は移動しても変わらず、駒が取られた場合は末尾の駒が空いた slot に移ります。
+   */
+  Square getPieceListSquare(int slot) const {
+    return Square(pieceList_[slot]);
+  }
   /** 先手の持ち駒を取得します。 */
   const Hand& getBlackHand() const {
     return blackHand_;
@@ -260,6 +340,41 @@ public:
     }
   }
 
+  /**
+   * 手番側の駒のうち, 動かすと王手放置になる可能性のある駒を返します。
+   */
+  Bitboard getPinnedPieces() const {
+    if (black_) {
+      return getPinnedPieces_<true>();
+    } else {
+      return getPinnedPieces_<false>();
+    }
+  }
+
+  /**
+   * ピンされた駒 sq が移動できる範囲を返します。
+   * 玉とピンしている駒を結ぶ直線上の升 (ピンしている駒を含む) です。
+   * @param sq getPinnedPieces に含まれる升
+   */
+  Bitboard getPinLine(const Square& sq) const {
+    if (black_) {
+      return getPinLine_<true>(sq);
+    } else {
+      return getPinLine_<false>(sq);
+    }
+  }
+
+  /**
+   * 手番側の玉が to に移動しても王手がかからないかを判定します。
+   */
+  bool isKingMovable(const Square& to) const {
+    if (black_) {
+      return !isChecking_<true>(to, bbBKing_.andNot(bbBOccupy_ | bbWOccupy_));
+    } else {
+      return !isChecking_<false>(to, bbWKing_.andNot(bbBOccupy_ | bbWOccupy_));
+    }
+  }
+
   /**
    * 任意の手が合法手であるか厳密なチェックをします。
    * MoveGenerator で生成した手に対しては isValidMove を使用してください。
@@ -280,12 +395,45 @@ public:
    */
   bool makeMove(Move& move) {
     if (black_) {
-      return makeMove_<true>(move);
+      return makeMove_<true, false>(move);
+    } else {
+      return makeMove_<false, false>(move);
+    }
+  }
+
+  /**
+   * 合法手であることが分かっている手で局面を進めます。
+   * 合法手チェックを行いません。
+   * MoveGenerator の generate*Legal で生成した手や,
+   * isValidMoveStrict で確認した手に対して使用します。
+   * @param move
+   */
+  void makeMoveLegal(Move& move) {
+    if (black_) {
+      makeMove_<true, true>(move);
     } else {
-      return makeMove_<false>(move);
+      makeMove_<false, true>(move);
     }
   }
 
+  /**
+   * 指定した手で局面を進め, unmakeMove のための記録を undo に書き込みます。
+   * 厳密な合法手チェックを行いません。
+   */
+  bool makeMove(Move& move, UndoRecord& undo) {
+    saveUndo_(move, undo);
+    return makeMove(move);
+  }
+
+  /**
+   * 合法手であることが分かっている手で局面を進め,
+   * unmakeMove のための記録を undo に書き込みます。
+   */
+  void makeMoveLegal(Move& move, UndoRecord& undo) {
+    saveUndo_(move, undo);
+    makeMoveLegal(move);
+  }
+
   /**
    * 指定した手で局面を進めます。
    * 厳密な合法手チェックをします。
@@ -294,9 +442,9 @@ public:
    */
   bool makeMoveStrict(Move& move) {
     if (black_) {
-      return isValidMoveStrict_<true>(move) && makeMove_<true>(move);
+      return isValidMoveStrict_<true>(move) && makeMove_<true, false>(move);
     } else {
-      return isValidMoveStrict_<false>(move) && makeMove_<false>(move);
+      return isValidMoveStrict_<false>(move) && makeMove_<false, false>(move);
     }
   }
 
@@ -311,6 +459,12 @@ public:
     }
   }
 
+  /**
+   * makeMove で書き込んだ記録を使って局面を1手戻します。
+   * ハッシュ値の再計算を行いません。
+   */
+  void unmakeMove(const UndoRecord& undo);
+
   /**
    * 指定した手で局面を進めます。
    * move に unmakeMove のための情報を書き込みません。
@@ -237,7 +237,6 @@ void generateMagicNumberTable() {
     }
   };
 
-  std::cout << "#if !USE_BMI2\n";
   std::cout << "const Bitboard MagicNumberTable::leftUp_[Square::N] = {\n";
   SQUARE_EACH(baseSq) {
     {
@@ -296,7 +295,6 @@ void generateMagicNumberTable() {
       " 0x" << std::hex << std::setw(16) << std::setfill('0') << rank_[sq.getRank()-1].low() << "ll),\n";
   }
   std::cout << "};\n";
-  std::cout << "#endif\n";
 }
 
 void generateMovePatternTable(bool useBmi2) {
@@ -403,11 +401,8 @@ void generateMovePatternTable(bool useBmi2) {
 }
 
 void generateMovePatternTable() {
-  std::cout << "#if USE_BMI2\n";
-  generateMovePatternTable(true);
-  std::cout << "#else\n";
+  // PEXT を使用する場合もシフトしてマジックナンバーと同じパターン番号を使用する
   generateMovePatternTable(false);
-  std::cout << "#endif\n";
 }
 
 void generateOneStepMoveTable(const char* name, Piece type) {
@@ -10,13 +10,28 @@
 
 namespace sunfish {
 
+namespace {
+
+/**
+ * ピンされた駒の移動先を玉とピンしている駒を結ぶ直線上に制限します。
+ */
+template <bool legal>
+inline void maskPinned(const Board& board, const Bitboard& pinned, const Square& from, Bitboard& bb) {
+  if (legal && pinned.check(from)) {
+    bb &= board.getPinLine(from);
+  }
+}
+
+} // namespace
+
 /**
  * 盤上の駒を動かす手を生成
  * @param black 先手番
  * @param genType
+ * @param legal 合法手のみを生成する場合は true (pinned を参照します)
  */
-template <bool black, MoveGenerator::GenType genType>
-void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bitboard* costumToMask) {
+template <bool black, MoveGenerator::GenType genType, bool legal, class List>
+void MoveGenerator::generateOnBoard_(const Board& board, List& moves, const Bitboard* costumToMask, const Bitboard& pinned) {
   const bool exceptNonEffectiveNonProm = true;
   const bool exceptProm = (genType == GenType::NoCapture);
   const bool tactical = (genType == GenType::Capture);
@@ -30,6 +45,15 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
 
   // pawn
   Bitboard bb = black ? board.getBPawn() : board.getWPawn();
+  if (legal && (bb & pinned)) {
+    // 縦方向以外にピンされた歩は動かせない
+    Bitboard bbPinned = bb & pinned;
+    BB_EACH_OPE(from, bbPinned, {
+      if (!board.getPinLine(from).check(black ? from.up() : from.down())) {
+        bb.unset(from);
+      }
+    });
+  }
   if (black) {
     bb.rightShift64(1);
   } else {
@@ -64,6 +88,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   }
   BB_EACH_OPE(from, bb,
     Bitboard bb2 = black ? MoveTables::blance(from, occ) : MoveTables::wlance(from, occ);
+    maskPinned<legal>(board, pinned, from, bb2);
     if (tactical) {
       bb2 &= toMask | promotable;
     } else if (exceptProm) {
@@ -95,6 +120,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   }
   BB_EACH_OPE(from, bb,
     Bitboard bb2 = black ? MoveTables::bknight(from) : MoveTables::wknight(from);
+    maskPinned<legal>(board, pinned, from, bb2);
     if (tactical) {
       bb2 &= toMask | promotable;
     } else if (exceptProm) {
@@ -122,6 +148,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBSilver() : board.getWSilver();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = black ? MoveTables::bsilver(from) : MoveTables::wsilver(from);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       if (to.isPromotable<black>() || from.isPromotable<black>()) {
@@ -135,6 +162,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBGold() : board.getWGold();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = black ? MoveTables::bgold(from) : MoveTables::wgold(from);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       moves.add(Move(Piece::Gold, from, to, false, false));
@@ -148,6 +176,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   }
   BB_EACH_OPE(from, bb,
     Bitboard bb2 = MoveTables::bishop(from, occ);
+    maskPinned<legal>(board, pinned, from, bb2);
     if (tactical) {
       if (!from.isPromotable<black>()) {
         bb2 &= toMask | promotable;
@@ -181,6 +210,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   }
   BB_EACH_OPE(from, bb,
     Bitboard bb2 = MoveTables::rook(from, occ);
+    maskPinned<legal>(board, pinned, from, bb2);
     if (tactical) {
       if (!from.isPromotable<black>()) {
         bb2 &= toMask | promotable;
@@ -217,7 +247,9 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
       bb2 &= toMask;
     }
     BB_EACH_OPE(to, bb2, {
-      moves.add(Move(Piece::King, from, to, false, false));
+      if (!legal || board.isKingMovable(to)) {
+        moves.add(Move(Piece::King, from, to, false, false));
+      }
     });
   }
 
@@ -225,6 +257,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBTokin() : board.getWTokin();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = black ? MoveTables::bgold(from) : MoveTables::wgold(from);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       moves.add(Move(Piece::Tokin, from, to, false, false));
@@ -235,6 +268,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBProLance() : board.getWProLance();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = black ? MoveTables::bgold(from) : MoveTables::wgold(from);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       moves.add(Move(Piece::ProLance, from, to, false, false));
@@ -245,6 +279,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBProKnight() : board.getWProKnight();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = black ? MoveTables::bgold(from) : MoveTables::wgold(from);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       moves.add(Move(Piece::ProKnight, from, to, false, false));
@@ -255,6 +290,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBProSilver() : board.getWProSilver();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = black ? MoveTables::bgold(from) : MoveTables::wgold(from);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       moves.add(Move(Piece::ProSilver, from, to, false, false));
@@ -265,6 +301,7 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBHorse() : board.getWHorse();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = MoveTables::horse(from, occ);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       moves.add(Move(Piece::Horse, from, to, false, false));
@@ -275,24 +312,34 @@ void MoveGenerator::generateOnBoard_(const Board& board, Moves& moves, const Bit
   bb = black ? board.getBDragon() : board.getWDragon();
   BB_EACH_OPE(from, bb, {
     Bitboard bb2 = MoveTables::dragon(from, occ);
+    maskPinned<legal>(board, pinned, from, bb2);
     bb2 &= toMask;
     BB_EACH_OPE(to, bb2, {
       moves.add(Move(Piece::Dragon, from, to, false, false));
     });
   });
 }
-template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::Capture>(const Board&, Moves&, const Bitboard*);
-template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::NoCapture>(const Board&, Moves&, const Bitboard*);
-template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::Evasion>(const Board&, Moves&, const Bitboard*);
-template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::Capture>(const Board&, Moves&, const Bitboard*);
-template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::NoCapture>(const Board&, Moves&, const Bitboard*);
-template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::Evasion>(const Board&, Moves&, const Bitboard*);
+#define INSTANTIATE__(List) \
+template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::Capture, false, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::NoCapture, false, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::Evasion, false, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::Capture, false, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::NoCapture, false, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::Evasion, false, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::Capture, true, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::NoCapture, true, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<true, MoveGenerator::GenType::Evasion, true, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::Capture, true, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::NoCapture, true, List>(const Board&, List&, const Bitboard*, const Bitboard&); \
+template void MoveGenerator::generateOnBoard_<false, MoveGenerator::GenType::Evasion, true, List>(const Board&, List&, const Bitboard*, const Bitboard&);
+MOVE_GENERATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
 
 /**
  * 持ち駒を打つ手を生成
  */
-template <bool black>
-void MoveGenerator::generateDrop_(const Board& board, Moves& moves, const Bitboard& toMask) {
+template <bool black, bool legal, class List>
+void MoveGenerator::generateDrop_(const Board& board, List& moves, const Bitboard& toMask) {
   // pawn
   int pawnCount = black ? board.getBlackHand(Piece::Pawn) : board.getWhiteHand(Piece::Pawn);
   if (pawnCount) {
@@ -307,6 +354,16 @@ void MoveGenerator::generateDrop_(const Board& board, Moves& moves, const Bitboa
     if (bbPawn & Bitboard::file(7)) { bb &= Bitboard::notFile(7); }
     if (bbPawn & Bitboard::file(8)) { bb &= Bitboard::notFile(8); }
     if (bbPawn & Bitboard::file(9)) { bb &= Bitboard::notFile(9); }
+    if (legal) {
+      // 打ち歩詰めになり得るのは敵玉の正面のみ
+      const auto& king = black ? board.getWKingSquare() : board.getBKingSquare();
+      if (king.isValid()) {
+        Square sq = black ? king.down() : king.up();
+        if (bb.check(sq) && !board.isValidMove(Move(Piece::Pawn, sq, false))) {
+          bb.unset(sq);
+        }
+      }
+    }
     BB_EACH_OPE(to, bb,
       moves.add(Move(Piece::Pawn, to, false));
     );
@@ -368,16 +425,21 @@ BB_EACH_OPE(to, bb, \
   }
 #undef GEN_DROP
 }
-template void MoveGenerator::generateDrop_<true>(const Board&, Moves&, const Bitboard&);
-template void MoveGenerator::generateDrop_<false>(const Board&, Moves&, const Bitboard&);
+#define INSTANTIATE__(List) \
+template void MoveGenerator::generateDrop_<true, false, List>(const Board&, List&, const Bitboard&); \
+template void MoveGenerator::generateDrop_<false, false, List>(const Board&, List&, const Bitboard&); \
+template void MoveGenerator::generateDrop_<true, true, List>(const Board&, List&, const Bitboard&); \
+template void MoveGenerator::generateDrop_<false, true, List>(const Board&, List&, const Bitboard&);
+MOVE_GENERATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
 
 /**
  * 王手を防ぐ手を生成します。
  * 王手がかかっている場合のみに使用します。
  * 打ち歩詰めの手を含む可能性があります。
  */
-template <bool black>
-void MoveGenerator::generateEvasion_(const Board& board, Moves& moves) {
+template <bool black, bool legal, class List>
+void MoveGenerator::generateEvasion_(const Board& board, List& moves, const Bitboard& pinned) {
   const auto& king = black ? board.getBKingSquare() : board.getWKingSquare();
 
   bool shortAttack = false;
@@ -501,34 +563,42 @@ void MoveGenerator::generateEvasion_(const Board& board, Moves& moves) {
 
   if ((longAttack == 2 || (shortAttack && longAttack))) {
     // 両王手
-    generateKing_<black>(board, moves);
+    generateKing_<black, legal, List>(board, moves);
   } else if (shortAttack) {
     // 近接王手
-    generateEvasionShort_<black>(board, moves, shortAttacker);
+    generateEvasionShort_<black, legal, List>(board, moves, shortAttacker, pinned);
   } else {
     // 跳び駒の利き
 
     // 1. 移動合と玉の移動
-    generateOnBoard_<black, GenType::Evasion>(board, moves, &longMask);
+    generateOnBoard_<black, GenType::Evasion, legal, List>(board, moves, &longMask, pinned);
 
     // 2. 持ち駒
     Bitboard dropMask = longMask & ~longAttacker;
     if (dropMask) {
-      generateDrop_<black>(board, moves, dropMask);
+      generateDrop_<black, legal, List>(board, moves, dropMask);
     }
   }
 
 }
-template void MoveGenerator::generateEvasion_<true>(const Board& board, Moves& moves);
-template void MoveGenerator::generateEvasion_<false>(const Board& board, Moves& moves);
-
-template <bool black>
-void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, const Bitboard& attacker) {
+#define INSTANTIATE__(List) \
+template void MoveGenerator::generateEvasion_<true, false, List>(const Board& board, List& moves, const Bitboard& pinned); \
+template void MoveGenerator::generateEvasion_<false, false, List>(const Board& board, List& moves, const Bitboard& pinned); \
+template void MoveGenerator::generateEvasion_<true, true, List>(const Board& board, List& moves, const Bitboard& pinned); \
+template void MoveGenerator::generateEvasion_<false, true, List>(const Board& board, List& moves, const Bitboard& pinned);
+MOVE_GENERATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
+
+template <bool black, bool legal, class List>
+void MoveGenerator::generateEvasionShort_(const Board& board, List& moves, const Bitboard& attacker, const Bitboard& pinned) {
   Bitboard occ = board.getBOccupy() | board.getWOccupy();
   Square to = attacker.getFirst();
+  // ピンされた駒は王手を防げない
+  const Bitboard notPinned = ~pinned;
 
   // pawn
   Bitboard bb = black ? board.getBPawn() : board.getWPawn();
+  if (legal) { bb &= notPinned; }
   if (bb & (black ? attacker.down() : attacker.up())) {
     if (to.isPromotable<black>()) {
       moves.add(Move(Piece::Pawn, black ? to.down() : to.up(), to, true, false));
@@ -539,6 +609,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // lance
   bb = black ? board.getBLance() : board.getWLance();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wlance(to, occ) : MoveTables::blance(to, occ);
   BB_EACH_OPE(from, bb,
     if (to.isPromotable<black>()) {
@@ -553,6 +624,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // knight
   bb = black ? board.getBKnight() : board.getWKnight();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wknight(to) : MoveTables::bknight(to);
   BB_EACH_OPE(from, bb,
     if (to.isPromotable<black>()) {
@@ -565,6 +637,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // silver
   bb = black ? board.getBSilver() : board.getWSilver();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wsilver(to) : MoveTables::bsilver(to);
   BB_EACH_OPE(from, bb, {
     moves.add(Move(Piece::Silver, from, to, false, false));
@@ -575,6 +648,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // gold
   bb = black ? board.getBGold() : board.getWGold();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wgold(to) : MoveTables::bgold(to);
   BB_EACH_OPE(from, bb,
     moves.add(Move(Piece::Gold, from, to, false, false));
@@ -582,6 +656,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // bishop
   bb = black ? board.getBBishop() : board.getWBishop();
+  if (legal) { bb &= notPinned; }
   bb &= MoveTables::bishop(to, occ);
   BB_EACH_OPE(from, bb,
     if (to.isPromotable<black>() || from.isPromotable<black>()) {
@@ -593,6 +668,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // rook
   bb = black ? board.getBRook() : board.getWRook();
+  if (legal) { bb &= notPinned; }
   bb &= MoveTables::rook(to, occ);
   BB_EACH_OPE(from, bb,
     if (to.isPromotable<black>() || from.isPromotable<black>()) {
@@ -608,12 +684,15 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
     bb = MoveTables::king(from);
     bb &= black ? ~board.getBOccupy() : ~board.getWOccupy();
     BB_EACH_OPE(to, bb, {
-      moves.add(Move(Piece::King, from, to, false, false));
+      if (!legal || board.isKingMovable(to)) {
+        moves.add(Move(Piece::King, from, to, false, false));
+      }
     });
   }
 
   // tokin
   bb = black ? board.getBTokin() : board.getWTokin();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wgold(to) : MoveTables::bgold(to);
   BB_EACH_OPE(from, bb,
     moves.add(Move(Piece::Tokin, from, to, false, false));
@@ -621,6 +700,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // promoted lance
   bb = black ? board.getBProLance() : board.getWProLance();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wgold(to) : MoveTables::bgold(to);
   BB_EACH_OPE(from, bb,
     moves.add(Move(Piece::ProLance, from, to, false, false));
@@ -628,6 +708,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // promoted knight
   bb = black ? board.getBProKnight() : board.getWProKnight();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wgold(to) : MoveTables::bgold(to);
   BB_EACH_OPE(from, bb,
     moves.add(Move(Piece::ProKnight, from, to, false, false));
@@ -635,6 +716,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // promoted silver
   bb = black ? board.getBProSilver() : board.getWProSilver();
+  if (legal) { bb &= notPinned; }
   bb &= black ? MoveTables::wgold(to) : MoveTables::bgold(to);
   BB_EACH_OPE(from, bb,
     moves.add(Move(Piece::ProSilver, from, to, false, false));
@@ -642,6 +724,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // horse
   bb = black ? board.getBHorse() : board.getWHorse();
+  if (legal) { bb &= notPinned; }
   bb &= MoveTables::horse(to, occ);
   BB_EACH_OPE(from, bb,
     moves.add(Move(Piece::Horse, from, to, false, false));
@@ -649,6 +732,7 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 
   // dragon
   bb = black ? board.getBDragon() : board.getWDragon();
+  if (legal) { bb &= notPinned; }
   bb &= MoveTables::dragon(to, occ);
   BB_EACH_OPE(from, bb,
     moves.add(Move(Piece::Dragon, from, to, false, false));
@@ -659,24 +743,31 @@ void MoveGenerator::generateEvasionShort_(const Board& board, Moves& moves, cons
 /**
  * 玉の移動する手を生成
  */
-template <bool black>
-void MoveGenerator::generateKing_(const Board& board, Moves& moves) {
+template <bool black, bool legal, class List>
+void MoveGenerator::generateKing_(const Board& board, List& moves) {
   const auto& from = black ? board.getBKingSquare() : board.getWKingSquare();
   Bitboard toMask = black ? ~board.getBOccupy() : ~board.getWOccupy();
 
   Bitboard bb = MoveTables::king(from) & toMask;
   BB_EACH_OPE(to, bb,
-    moves.add(Move(Piece::King, from, to, false, false));
+    if (!legal || board.isKingMovable(to)) {
+      moves.add(Move(Piece::King, from, to, false, false));
+    }
   );
 }
-template void MoveGenerator::generateKing_<true>(const Board& board, Moves& moves);
-template void MoveGenerator::generateKing_<false>(const Board& board, Moves& moves);
+#define INSTANTIATE__(List) \
+template void MoveGenerator::generateKing_<true, false, List>(const Board& board, List& moves); \
+template void MoveGenerator::generateKing_<false, false, List>(const Board& board, List& moves); \
+template void MoveGenerator::generateKing_<true, true, List>(const Board& board, List& moves); \
+template void MoveGenerator::generateKing_<false, true, List>(const Board& board, List& moves);
+MOVE_GENERATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
 
 /**
  * 王手を生成
  */
 template <bool black, bool light>
-void MoveGenerator::generateCheck_(const Board& board, Moves& moves) {
+void MoveGenerator::generateCheck_(const Board& board, MoveList& moves) {
   // TODO: 開き王手の生成
   const auto& occ = board.getBOccupy() | board.getWOccupy();
   Bitboard movable = ~(black ? board.getBOccupy() : board.getWOccupy());
@@ -997,9 +1088,9 @@ gencheck_rook_drop_end ## dir: ; \
   }
 
 }
-template void MoveGenerator::generateCheck_<true, true>(const Board& board, Moves& moves);
-template void MoveGenerator::generateCheck_<false, true>(const Board& board, Moves& moves);
-template void MoveGenerator::generateCheck_<true, false>(const Board& board, Moves& moves);
-template void MoveGenerator::generateCheck_<false, false>(const Board& board, Moves& moves);
+template void MoveGenerator::generateCheck_<true, true>(const Board& board, MoveList& moves);
+template void MoveGenerator::generateCheck_<false, true>(const Board& board, MoveList& moves);
+template void MoveGenerator::generateCheck_<true, false>(const Board& board, MoveList& moves);
+template void MoveGenerator::generateCheck_<false, false>(const Board& board, MoveList& moves);
 
 } // namespace sunfish
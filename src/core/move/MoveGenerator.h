@@ -8,10 +8,18 @@
 
 #include "../board/Board.h"
 #include "Moves.h"
+#include "MoveScorer.h"
 #include <cassert>
 
 namespace sunfish {
 
+/**
+ * 指し手生成に使用する全てのリストについてマクロを展開します。
+ */
+#define MOVE_GENERATOR_INSTANTIATE_EACH__(M) \
+M(MoveList) \
+M(ScoredMoveList<HistoryScorer>)
+
 /**
  * MoveGenerator
  * 指し手生成
@@ -29,18 +37,18 @@ private:
 
   MoveGenerator();
 
-  template <bool black, GenType genType>
-  static void generateOnBoard_(const Board& board, Moves& moves, const Bitboard* costumToMask);
-  template <bool black>
-  static void generateDrop_(const Board& board, Moves& moves, const Bitboard& toMask);
-  template <bool black>
-  static void generateEvasion_(const Board& board, Moves& moves);
-  template <bool black>
-  static void generateEvasionShort_(const Board& board, Moves& moves, const Bitboard& attacker);
-  template <bool black>
-  static void generateKing_(const Board& board, Moves& moves);
+  template <bool black, GenType genType, bool legal, class List>
+  static void generateOnBoard_(const Board& board, List& moves, const Bitboard* costumToMask, const Bitboard& pinned);
+  template <bool black, bool legal, class List>
+  static void generateDrop_(const Board& board, List& moves, const Bitboard& toMask);
+  template <bool black, bool legal, class List>
+  static void generateEvasion_(const Board& board, List& moves, const Bitboard& pinned);
+  template <bool black, bool legal, class List>
+  static void generateEvasionShort_(const Board& board, List& moves, const Bitboard& attacker, const Bitboard& pinned);
+  template <bool black, bool legal, class List>
+  static void generateKing_(const Board& board, List& moves);
   template <bool black, bool light>
-  static void generateCheck_(const Board& board, Moves& moves);
+  static void generateCheck_(const Board& board, MoveList& moves);
 
 public:
 
@@ -48,7 +56,7 @@ public:
    * 全ての合法手を生成します。
    * 打ち歩詰めや王手放置の手を含む可能性があります。
    */
-  static void generate(const Board& board, Moves& moves) {
+  static void generate(const Board& board, MoveList& moves) {
     if (!board.isChecking()) {
       generateCap(board, moves);
       generateNoCap(board, moves);
@@ -63,11 +71,11 @@ public:
    * 王手がかかっていない場合のみに使用します。
    * 王手放置の手を含む可能性があります。
    */
-  static void generateCap(const Board& board, Moves& moves) {
+  static void generateCap(const Board& board, MoveList& moves) {
     if (board.isBlack()) {
-      generateOnBoard_<true, GenType::Capture>(board, moves, nullptr);
+      generateOnBoard_<true, GenType::Capture, false>(board, moves, nullptr, Bitboard::Zero());
     } else {
-      generateOnBoard_<false, GenType::Capture>(board, moves, nullptr);
+      generateOnBoard_<false, GenType::Capture, false>(board, moves, nullptr, Bitboard::Zero());
     }
   }
 
@@ -76,11 +84,11 @@ public:
    * 王手がかかっていない場合のみに使用します。
    * 王手放置の手を含む可能性があります。
    */
-  static void generateNoCap(const Board& board, Moves& moves) {
+  static void generateNoCap(const Board& board, MoveList& moves) {
     if (board.isBlack()) {
-      generateOnBoard_<true, GenType::NoCapture>(board, moves, nullptr);
+      generateOnBoard_<true, GenType::NoCapture, false>(board, moves, nullptr, Bitboard::Zero());
     } else {
-      generateOnBoard_<false, GenType::NoCapture>(board, moves, nullptr);
+      generateOnBoard_<false, GenType::NoCapture, false>(board, moves, nullptr, Bitboard::Zero());
     }
   }
 
@@ -89,12 +97,12 @@ public:
    * 王手がかかっていない場合のみに使用します。
    * 打ち歩詰めや王手放置の手を含む可能性があります。
    */
-  static void generateDrop(const Board& board, Moves& moves) {
+  static void generateDrop(const Board& board, MoveList& moves) {
     Bitboard nocc = ~(board.getBOccupy() | board.getWOccupy());
     if (board.isBlack()) {
-      generateDrop_<true>(board, moves, nocc);
+      generateDrop_<true, false>(board, moves, nocc);
     } else {
-      generateDrop_<false>(board, moves, nocc);
+      generateDrop_<false, false>(board, moves, nocc);
     }
   }
 
@@ -103,11 +111,183 @@ public:
    * 王手がかかっている場合のみに使用します。
    * 打ち歩詰めや王手放置の手を含む可能性があります。
    */
-  static void generateEvasion(const Board& board, Moves& moves) {
+  static void generateEvasion(const Board& board, MoveList& moves) {
+    if (board.isBlack()) {
+      generateEvasion_<true, false>(board, moves, Bitboard::Zero());
+    } else {
+      generateEvasion_<false, false>(board, moves, Bitboard::Zero());
+    }
+  }
+
+  /**
+   * 全ての合法手を生成します。
+   * 打ち歩詰めや王手放置の手を含みません。
+   */
+  static void generateLegal(const Board& board, MoveList& moves) {
+    Bitboard pinned = board.getPinnedPieces();
+    if (!board.isChecking()) {
+      generateCapLegal(board, moves, pinned);
+      generateNoCapLegal(board, moves, pinned);
+      generateDropLegal(board, moves);
+    } else {
+      generateEvasionLegal(board, moves, pinned);
+    }
+  }
+
+  /**
+   * 駒を取る手と成る手のうち合法手のみを生成します。
+   * pinned には Board::getPinnedPieces の結果を指定します。
+   */
+  static void generateCapLegal(const Board& board, MoveList& moves, const Bitboard& pinned) {
+    if (board.isBlack()) {
+      generateOnBoard_<true, GenType::Capture, true>(board, moves, nullptr, pinned);
+    } else {
+      generateOnBoard_<false, GenType::Capture, true>(board, moves, nullptr, pinned);
+    }
+  }
+
+  /**
+   * 駒を取らずかつ成らない移動手のうち合法手のみを生成します。
+   * pinned には Board::getPinnedPieces の結果を指定します。
+   */
+  static void generateNoCapLegal(const Board& board, MoveList& moves, const Bitboard& pinned) {
+    if (board.isBlack()) {
+      generateOnBoard_<true, GenType::NoCapture, true>(board, moves, nullptr, pinned);
+    } else {
+      generateOnBoard_<false, GenType::NoCapture, true>(board, moves, nullptr, pinned);
+    }
+  }
+
+  /**
+   * 持ち駒を打つ手のうち合法手のみを生成します。
+   * 王手がかかっていない場合のみに使用します。
+   */
+  static void generateDropLegal(const Board& board, MoveList& moves) {
+    Bitboard nocc = ~(board.getBOccupy() | board.getWOccupy());
+    if (board.isBlack()) {
+      generateDrop_<true, true>(board, moves, nocc);
+    } else {
+      generateDrop_<false, true>(board, moves, nocc);
+    }
+  }
+
+  /**
+   * 王手を防ぐ手のうち合法手のみを生成します。
+   * pinned には Board::getPinnedPieces の結果を指定します。
+   */
+  static void generateEvasionLegal(const Board& board, MoveList& moves, const Bitboard& pinned) {
+    if (board.isBlack()) {
+      generateEvasion_<true, true>(board, moves, pinned);
+    } else {
+      generateEvasion_<false, true>(board, moves, pinned);
+    }
+  }
+
+  /**
+   * 駒を取る手と成る手を生成し, 同時に scorer のスコアを書き込みます。
+   * scores は moves と同じ添字で参照される呼び出し側の領域です。
+   * Scorer は MOVE_GENERATOR_INSTANTIATE_EACH__ に含まれるものに限ります。
+   */
+  template <class Scorer>
+  static void generateCap(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
+    if (board.isBlack()) {
+      generateOnBoard_<true, GenType::Capture, false>(board, list, nullptr, Bitboard::Zero());
+    } else {
+      generateOnBoard_<false, GenType::Capture, false>(board, list, nullptr, Bitboard::Zero());
+    }
+  }
+
+  /**
+   * 駒を取らずかつ成らない移動手を生成し, 同時に scorer のスコアを書き込みます。
+   */
+  template <class Scorer>
+  static void generateNoCap(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
+    if (board.isBlack()) {
+      generateOnBoard_<true, GenType::NoCapture, false>(board, list, nullptr, Bitboard::Zero());
+    } else {
+      generateOnBoard_<false, GenType::NoCapture, false>(board, list, nullptr, Bitboard::Zero());
+    }
+  }
+
+  /**
+   * 持ち駒を打つ手を生成し, 同時に scorer のスコアを書き込みます。
+   */
+  template <class Scorer>
+  static void generateDrop(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
+    Bitboard nocc = ~(board.getBOccupy() | board.getWOccupy());
+    if (board.isBlack()) {
+      generateDrop_<true, false>(board, list, nocc);
+    } else {
+      generateDrop_<false, false>(board, list, nocc);
+    }
+  }
+
+  /**
+   * 王手を防ぐ手を生成し, 同時に scorer のスコアを書き込みます。
+   */
+  template <class Scorer>
+  static void generateEvasion(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
+    if (board.isBlack()) {
+      generateEvasion_<true, false>(board, list, Bitboard::Zero());
+    } else {
+      generateEvasion_<false, false>(board, list, Bitboard::Zero());
+    }
+  }
+
+  /**
+   * 駒を取る手と成る手のうち合法手のみを生成し, 同時に scorer のスコアを書き込みます。
+   */
+  template <class Scorer>
+  static void generateCapLegal(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer, const Bitboard& pinned) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
+    if (board.isBlack()) {
+      generateOnBoard_<true, GenType::Capture, true>(board, list, nullptr, pinned);
+    } else {
+      generateOnBoard_<false, GenType::Capture, true>(board, list, nullptr, pinned);
+    }
+  }
+
+  /**
+   * 駒を取らずかつ成らない移動手のうち合法手のみを生成し, 同時に scorer のスコアを書き込みます。
+   */
+  template <class Scorer>
+  static void generateNoCapLegal(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer, const Bitboard& pinned) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
+    if (board.isBlack()) {
+      generateOnBoard_<true, GenType::NoCapture, true>(board, list, nullptr, pinned);
+    } else {
+      generateOnBoard_<false, GenType::NoCapture, true>(board, list, nullptr, pinned);
+    }
+  }
+
+  /**
+   * 持ち駒を打つ手のうち合法手のみを生成し, 同時に scorer のスコアを書き込みます。
+   */
+  template <class Scorer>
+  static void generateDropLegal(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
+    Bitboard nocc = ~(board.getBOccupy() | board.getWOccupy());
+    if (board.isBlack()) {
+      generateDrop_<true, true>(board, list, nocc);
+    } else {
+      generateDrop_<false, true>(board, list, nocc);
+    }
+  }
+
+  /**
+   * 王手を防ぐ手のうち合法手のみを生成し, 同時に scorer のスコアを書き込みます。
+   */
+  template <class Scorer>
+  static void generateEvasionLegal(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer, const Bitboard& pinned) {
+    ScoredMoveList<Scorer> list(board, moves, scores, scorer);
     if (board.isBlack()) {
-      generateEvasion_<true>(board, moves);
+      generateEvasion_<true, true>(board, list, pinned);
     } else {
-      generateEvasion_<false>(board, moves);
+      generateEvasion_<false, true>(board, list, pinned);
     }
   }
 
@@ -117,7 +297,7 @@ public:
    * 打ち歩詰めや王手放置の手を含む可能性があります。
    * TODO: 開き王手の生成
    */
-  static void generateCheck(const Board& board, Moves& moves) {
+  static void generateCheck(const Board& board, MoveList& moves) {
     if (board.isBlack()) {
       generateCheck_<true, false>(board, moves);
     } else {
@@ -132,7 +312,7 @@ public:
    * 詰将棋に効果のない遠くからの王手を除外します。
    * TODO: 開き王手の生成
    */
-  static void generateCheckLight(const Board& board, Moves& moves) {
+  static void generateCheckLight(const Board& board, MoveList& moves) {
     if (board.isBlack()) {
       generateCheck_<true, true>(board, moves);
     } else {
@@ -0,0 +1,37 @@
+/* MoveScorer.h
+ *
+ * Kubo Ryosuke
+ */
+
+#ifndef SUNFISH_MOVESCORER__
+#define SUNFISH_MOVESCORER__
+
+#include "../board/Board.h"
+#include "./History.h"
+
+namespace sunfish {
+
+/**
+ * 履歴の良好率
+ */
+class HistoryScorer {
+private:
+
+  const History& history_;
+
+public:
+
+  HistoryScorer(const History& history) : history_(history) {
+  }
+
+  int32_t operator()(const Board&, const Move& move) const {
+    auto key = History::getKey(move);
+    auto data = history_.getData(key);
+    return (int32_t)History::getRatio(data);
+  }
+
+};
+
+} // namespace sunfish
+
+#endif // SUNFISH_MOVESCORER__
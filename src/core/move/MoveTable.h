@@ -102,7 +102,6 @@ public:
   }
 };
 
-#if !USE_BMI2
 /**
  * MagicNumberTable
  */
@@ -132,7 +131,6 @@ public:
     return rightUp_[sq.index()];
   }
 };
-#endif
 
 /**
  * MovePatternTable
@@ -262,8 +260,50 @@ private:
   static const Bitboard king_[Square::N];
   static const Bitboard horseOneStepMove_[Square::N];
   static const Bitboard dragonOneStepMove_[Square::N];
+  /** PEXT の結果をマジックナンバーと同じパターン番号に揃えるためのシフト量 */
+  static uint8_t leftUpShift_[Square::N];
+  static uint8_t rightUpShift_[Square::N];
+
+  static bool pextEnabled_;
+
+  static bool initPext();
+
+  /**
+   * 7x7 のマスクで切り出した駒の配置をパターン番号に変換します。
+   */
+  static unsigned patternIndex(const Bitboard& bb, const Bitboard& mask, const Bitboard& magic, int shift) {
+    Bitboard attack = bb & mask;
+#if USE_PEXT
+    if (pextEnabled_) {
+      return static_cast<unsigned>(pext(attack.high() | attack.low(), mask.high() | mask.low())) << shift;
+    }
+#else
+    (void)shift;
+#endif
+    return static_cast<unsigned>(((attack.high() * magic.high()) ^ (attack.low() * magic.low())) >> (64-7));
+  }
+  static unsigned rankIndex(const Square& sq, const Bitboard& bb) {
+    return patternIndex(bb, DirectionMaskTable7x7::rank(sq), MagicNumberTable::rank(sq), 0);
+  }
+  static unsigned leftUpIndex(const Square& sq, const Bitboard& bb) {
+    return patternIndex(bb, DirectionMaskTable7x7::leftUpX(sq), MagicNumberTable::leftUp(sq), leftUpShift_[sq.index()]);
+  }
+  static unsigned rightUpIndex(const Square& sq, const Bitboard& bb) {
+    return patternIndex(bb, DirectionMaskTable7x7::rightUpX(sq), MagicNumberTable::rightUp(sq), rightUpShift_[sq.index()]);
+  }
 
 public:
+  /**
+   * 横と斜めの利きの算出に PEXT を使用するかどうかを設定します。
+   * CPU が BMI2 に対応していない場合は無視します。
+   */
+  static void setPextEnabled(bool enabled) {
+    pextEnabled_ = enabled && isBmi2Supported();
+  }
+  static bool isPextEnabled() {
+    return pextEnabled_;
+  }
+
   static const Bitboard& bpawn(const Square& sq) {
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
@@ -333,153 +373,63 @@ public:
     // 横方向
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::rank(sq);
-    const auto& m = MagicNumberTable::rank(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::rank(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::rank(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::rank(sq, b);
-#endif
+    return MovePatternTable::rank(sq, rankIndex(sq, bb));
   }
 
   static const Bitboard& rightUpX(const Square& sq, const Bitboard& bb) {
     // 双方向右上がり
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::rightUpX(sq);
-    const auto& m = MagicNumberTable::rightUp(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::rightUpX(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::rightUpX(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::rightUpX(sq, b);
-#endif
+    return MovePatternTable::rightUpX(sq, rightUpIndex(sq, bb));
   }
 
   static const Bitboard& rightDownX(const Square& sq, const Bitboard& bb) {
     // 双方向右下がり
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::leftUpX(sq);
-    const auto& m = MagicNumberTable::leftUp(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::leftUpX(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::leftUpX(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::leftUpX(sq, b);
-#endif
+    return MovePatternTable::leftUpX(sq, leftUpIndex(sq, bb));
   }
 
   static const Bitboard& rightUp(const Square& sq, const Bitboard& bb) {
     // 右上がり
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::rightUpX(sq);
-    const auto& m = MagicNumberTable::rightUp(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::rightUp(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::rightUpX(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::rightUp(sq, b);
-#endif
+    return MovePatternTable::rightUp(sq, rightUpIndex(sq, bb));
   }
 
   static const Bitboard& rightDown(const Square& sq, const Bitboard& bb) {
     // 右下がり
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::leftUpX(sq);
-    const auto& m = MagicNumberTable::leftUp(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::rightDown(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::leftUpX(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::rightDown(sq, b);
-#endif
+    return MovePatternTable::rightDown(sq, leftUpIndex(sq, bb));
   }
 
   static const Bitboard& leftUp(const Square& sq, const Bitboard& bb) {
     // 左上がり
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::leftUpX(sq);
-    const auto& m = MagicNumberTable::leftUp(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::leftUp(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::leftUpX(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::leftUp(sq, b);
-#endif
+    return MovePatternTable::leftUp(sq, leftUpIndex(sq, bb));
   }
 
   static const Bitboard& leftDown(const Square& sq, const Bitboard& bb) {
     // 左下がり
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::rightUpX(sq);
-    const auto& m = MagicNumberTable::rightUp(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::leftDown(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::rightUpX(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::leftDown(sq, b);
-#endif
+    return MovePatternTable::leftDown(sq, rightUpIndex(sq, bb));
   }
 
   static const Bitboard& right(const Square& sq, const Bitboard& bb) {
     // 右
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::rank(sq);
-    const auto& m = MagicNumberTable::rank(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::right(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::rank(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::right(sq, b);
-#endif
+    return MovePatternTable::right(sq, rankIndex(sq, bb));
   }
 
   static const Bitboard& left(const Square& sq, const Bitboard& bb) {
     // 左
     assert(sq.index() >= 0);
     assert(sq.index() < Square::N);
-#if !USE_BMI2
-    Bitboard attack = bb & DirectionMaskTable7x7::rank(sq);
-    const auto& m = MagicNumberTable::rank(sq);
-    auto b = ((attack.high() * m.high()) ^ (attack.low() * m.low())) >> (64-7);
-    return MovePatternTable::left(sq, b & 0x7f);
-#else
-    Bitboard mask = DirectionMaskTable7x7::rank(sq);
-    Bitboard attack = bb & mask;
-    auto b = _pext_u64(attack.high() | attack.low(), mask.high() | mask.low());
-    return MovePatternTable::left(sq, b);
-#endif
+    return MovePatternTable::left(sq, rankIndex(sq, bb));
   }
 
   static const Bitboard& blance(const Square& sq, const Bitboard& bb) {
@@ -0,0 +1,31 @@
+/* MoveTablePext.cpp
+ *
+ * Kubo Ryosuke
+ */
+
+#include "MoveTable.h"
+
+namespace sunfish {
+
+// 生成コード (MoveTable.cpp) に依存しないように起動時に求める
+uint8_t MoveTables::leftUpShift_[Square::N];
+uint8_t MoveTables::rightUpShift_[Square::N];
+bool MoveTables::pextEnabled_ = MoveTables::initPext();
+
+/**
+ * PEXT のシフト量を求め, PEXT を使用するかどうかを返します。
+ */
+bool MoveTables::initPext() {
+  auto shift = [](const Bitboard& mask) {
+    return static_cast<uint8_t>(7 - __builtin_popcountll(mask.high() | mask.low()));
+  };
+
+  SQUARE_EACH(sq) {
+    leftUpShift_[sq.index()] = shift(DirectionMaskTable7x7::leftUpX(sq));
+    rightUpShift_[sq.index()] = shift(DirectionMaskTable7x7::rightUpX(sq));
+  }
+
+  return isPextFast();
+}
+
+} // namespace sunfish
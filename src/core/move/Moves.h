@@ -12,11 +12,13 @@
 
 namespace sunfish {
 
-template <int capacity>
-class TempMoves {
-private:
+/**
+ * 呼び出し側が用意した領域に指し手を格納するリスト
+ */
+class MoveList {
+protected:
 
-  Move moves_[capacity];
+  Move* moves_;
   int size_;
 
 public:
@@ -24,7 +26,19 @@ public:
   using iterator = Move*;
   using const_iterator = const Move*;
 
-  TempMoves() : size_(0) {
+  MoveList() : moves_(nullptr), size_(0) {
+  }
+  explicit MoveList(Move* buffer) : moves_(buffer), size_(0) {
+  }
+  MoveList(const MoveList&) = delete;
+  MoveList& operator=(const MoveList&) = delete;
+
+  /**
+   * 格納先の領域を変更します。
+   */
+  void attach(Move* buffer) {
+    moves_ = buffer;
+    size_ = 0;
   }
 
   void clear() { size_ = 0; }
@@ -81,8 +95,62 @@ public:
 
 };
 
+template <int capacity>
+class TempMoves : public MoveList {
+private:
+
+  Move buffer_[capacity];
+
+public:
+
+  TempMoves() : MoveList(buffer_) {
+  }
+  TempMoves(const TempMoves& src) : MoveList(buffer_) {
+    *this = src;
+  }
+
+  TempMoves& operator=(const TempMoves& src) {
+    size_ = src.size_;
+    for (int i = 0; i < size_; i++) {
+      buffer_[i] = src.moves_[i];
+    }
+    return *this;
+  }
+
+};
+
 using Moves = TempMoves<1024>;
 
+/**
+ * 指し手の追加と同時にスコアを書き込むリスト
+ * scores は moves と同じ添字で参照される呼び出し側の領域です。
+ */
+template <class Scorer>
+class ScoredMoveList {
+private:
+
+  const Board& board_;
+  MoveList& moves_;
+  int32_t* scores_;
+  const Scorer& scorer_;
+
+public:
+
+  ScoredMoveList(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer)
+    : board_(board), moves_(moves), scores_(scores), scorer_(scorer) {
+  }
+  ScoredMoveList(const ScoredMoveList&) = delete;
+  ScoredMoveList& operator=(const ScoredMoveList&) = delete;
+
+  int size() const { return moves_.size(); }
+
+  void add(const Move& move) {
+    scores_[moves_.size()] = scorer_(board_, move);
+    moves_.add(move);
+  }
+
+};
+
 } // namespace sunfish
 
 #endif //SUNFISH_MOVES__
@@ -0,0 +1,218 @@
+/* Perft.cpp
+ *
+ * Kubo Ryosuke
+ */
+
+#include "Perft.h"
+#include "MoveGenerator.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+using namespace sunfish;
+
+class PerftWorker {
+private:
+
+  Board board_;
+  bool enableCheck_;
+  bool legal_;
+  bool phaseTiming_;
+
+public:
+
+  uint64_t nodes;
+  Perft::PhaseStat phases[Perft::PhaseNum];
+
+  PerftWorker(const Board& board, bool enableCheck, bool legal, bool phaseTiming) : board_(board), enableCheck_(enableCheck), legal_(legal), phaseTiming_(phaseTiming), nodes(0) {
+    memset(phases, 0, sizeof(phases));
+  }
+
+  Board& getBoard() {
+    return board_;
+  }
+
+  /**
+   * 指し手生成を1段階実行し, 生成した手の数を記録します。
+   * 時間の計測は有効にした場合のみ行います。
+   */
+  template <class Gen>
+  void generate(Perft::Phase phase, MoveList& moves, Gen gen) {
+    auto& stat = phases[phase];
+    int size = moves.size();
+    if (phaseTiming_) {
+      auto begin = std::chrono::steady_clock::now();
+      gen(board_, moves);
+      auto end = std::chrono::steady_clock::now();
+      stat.seconds += std::chrono::duration<double>(end - begin).count();
+    } else {
+      gen(board_, moves);
+    }
+    stat.calls++;
+    stat.moves += moves.size() - size;
+  }
+
+  void generate(Perft::Phase phase, MoveList& moves, void (*gen)(const Board&, MoveList&)) {
+    generate<void (*)(const Board&, MoveList&)>(phase, moves, gen);
+  }
+
+  void generateLegal(MoveList& moves) {
+    Bitboard pinned = board_.getPinnedPieces();
+    if (board_.isChecking()) {
+      generate(Perft::Evasion, moves, [&pinned](const Board& board, MoveList& list) {
+        MoveGenerator::generateEvasionLegal(board, list, pinned);
+      });
+    } else {
+      generate(Perft::Capture, moves, [&pinned](const Board& board, MoveList& list) {
+        MoveGenerator::generateCapLegal(board, list, pinned);
+      });
+      generate(Perft::NoCapture, moves, [&pinned](const Board& board, MoveList& list) {
+        MoveGenerator::generateNoCapLegal(board, list, pinned);
+      });
+      generate(Perft::Drop, moves, [](const Board& board, MoveList& list) {
+        MoveGenerator::generateDropLegal(board, list);
+      });
+    }
+  }
+
+  void generate(MoveList& moves) {
+    if (legal_) {
+      generateLegal(moves);
+    } else if (board_.isChecking()) {
+      generate(Perft::Evasion, moves, MoveGenerator::generateEvasion);
+    } else {
+      generate(Perft::Capture, moves, MoveGenerator::generateCap);
+      generate(Perft::NoCapture, moves, MoveGenerator::generateNoCap);
+      generate(Perft::Drop, moves, MoveGenerator::generateDrop);
+    }
+    if (enableCheck_ && !board_.isChecking()) {
+      Moves checks;
+      generate(Perft::Check, checks, MoveGenerator::generateCheck);
+    }
+  }
+
+  uint64_t count(int depth) {
+    nodes++;
+
+    if (depth == 0) {
+      return 1;
+    }
+
+    Moves moves;
+    generate(moves);
+
+    uint64_t leaves = 0;
+    for (auto ite = moves.begin(); ite != moves.end(); ite++) {
+      Move move = *ite;
+      if (legal_) {
+        board_.makeMoveLegal(move);
+      } else if (!board_.makeMove(move)) {
+        continue;
+      }
+      leaves += count(depth - 1);
+      board_.unmakeMove(move);
+    }
+
+    return leaves;
+  }
+
+};
+
+} // namespace
+
+namespace sunfish {
+
+Perft::Result Perft::run(const Board& board, int depth) const {
+  Result result;
+  result.leaves = 0;
+  result.nodes = 0;
+  memset(result.phases, 0, sizeof(result.phases));
+
+  auto begin = std::chrono::steady_clock::now();
+
+  if (depth <= 0) {
+    result.leaves = 1;
+    result.nodes = 1;
+    result.seconds = 0.0;
+    return result;
+  }
+
+  // ルートの合法手
+  PerftWorker root(board, enableCheck_, legal_, phaseTiming_);
+  root.nodes++;
+  Moves moves;
+  root.generate(moves);
+  for (auto ite = moves.begin(); ite != moves.end(); ite++) {
+    Move move = *ite;
+    Board tmp = board;
+    if (tmp.makeMove(move)) {
+      result.divide.push_back({ *ite, 0 });
+    }
+  }
+
+  // ルートの手をスレッドで分担する
+  int threads = std::max(1, std::min(threads_, static_cast<int>(result.divide.size())));
+  std::vector<PerftWorker> workers(threads, PerftWorker(board, enableCheck_, legal_, phaseTiming_));
+  std::atomic<size_t> next(0);
+
+  auto work = [&result, &next, depth](PerftWorker& worker) {
+    while (true) {
+      size_t index = next.fetch_add(1);
+      if (index >= result.divide.size()) {
+        break;
+      }
+      auto& entry = result.divide[index];
+      Move move = entry.first;
+      worker.getBoard().makeMove(move);
+      entry.second = worker.count(depth - 1);
+      worker.getBoard().unmakeMove(move);
+    }
+  };
+
+  std::vector<std::thread> ths;
+  for (int i = 1; i < threads; i++) {
+    ths.emplace_back(work, std::ref(workers[i]));
+  }
+  work(workers[0]);
+  for (auto& th : ths) {
+    th.join();
+  }
+
+  result.nodes = root.nodes;
+  for (int phase = 0; phase < PhaseNum; phase++) {
+    result.phases[phase] = root.phases[phase];
+  }
+  for (const auto& worker : workers) {
+    result.nodes += worker.nodes;
+    for (int phase = 0; phase < PhaseNum; phase++) {
+      result.phases[phase].calls += worker.phases[phase].calls;
+      result.phases[phase].moves += worker.phases[phase].moves;
+      result.phases[phase].seconds += worker.phases[phase].seconds;
+    }
+  }
+  for (const auto& entry : result.divide) {
+    result.leaves += entry.second;
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  result.seconds = std::chrono::duration<double>(end - begin).count();
+
+  return result;
+}
+
+const char* Perft::getPhaseName(Phase phase) {
+  switch (phase) {
+  case Capture  : return "capture";
+  case NoCapture: return "no-capture";
+  case Drop     : return "drop";
+  case Evasion  : return "evasion";
+  case Check    : return "check";
+  default       : return "";
+  }
+}
+
+} // namespace sunfish
@@ -0,0 +1,105 @@
+/* Perft.h
+ *
+ * Kubo Ryosuke
+ */
+
+#ifndef SUNFISH_PERFT__
+#define SUNFISH_PERFT__
+
+#include "Move.h"
+#include "../board/Board.h"
+#include <vector>
+#include <cstdint>
+
+namespace sunfish {
+
+/**
+ * 指し手生成の性能と正しさを確認するための perft
+ * MoveGenerator で生成した手を Board::makeMove で進め, 末端局面の数を数えます。
+ * 打ち歩詰めは Board::makeMove で棄却されるため, 末端局面の数に含みません。
+ */
+class Perft {
+public:
+
+  enum Phase {
+    Capture,
+    NoCapture,
+    Drop,
+    Evasion,
+    Check,
+    PhaseNum,
+  };
+
+  struct PhaseStat {
+    /** 指し手生成を呼び出した回数 */
+    uint64_t calls;
+    /** 生成した手の数 */
+    uint64_t moves;
+    /** 指し手生成に要した時間 [sec] (計測を有効にした場合のみ) */
+    double seconds;
+  };
+
+  struct Result {
+    /** 末端局面の数 */
+    uint64_t leaves;
+    /** 展開した局面の数 */
+    uint64_t nodes;
+    /** ルートの手ごとの末端局面の数 */
+    std::vector<std::pair<Move, uint64_t>> divide;
+    PhaseStat phases[PhaseNum];
+    /** 経過時間 [sec] */
+    double seconds;
+  };
+
+private:
+
+  int threads_;
+
+  bool enableCheck_;
+
+  bool legal_;
+
+  bool phaseTiming_;
+
+public:
+
+  /**
+   * @param threads ルートの手を分担するスレッド数
+   */
+  Perft(int threads = 1) : threads_(threads), enableCheck_(true), legal_(false), phaseTiming_(false) {
+  }
+
+  /**
+   * 王手生成 (探索木には含まない) の計測を行うかどうかを設定します。
+   */
+  void setCheckEnabled(bool enabled) {
+    enableCheck_ = enabled;
+  }
+
+  /**
+   * 合法手のみを生成する指し手生成 (generate*Legal) を使用するかどうかを設定します。
+   */
+  void setLegal(bool legal) {
+    legal_ = legal;
+  }
+
+  /**
+   * 指し手生成の呼び出しごとに時間を計測するかどうかを設定します。
+   * 1回の呼び出しは短いため, 計測の負荷を含んだ値になります。
+   */
+  void setPhaseTiming(bool enabled) {
+    phaseTiming_ = enabled;
+  }
+
+  /**
+   * 指定した深さまでの perft を実行します。
+   */
+  Result run(const Board& board, int depth) const;
+
+  static const char* getPhaseName(Phase phase);
+
+};
+
+} // namespace sunfish
+
+#endif // SUNFISH_PERFT__
@@ -0,0 +1,163 @@
+/* Memory.cpp
+ *
+ * Kubo Ryosuke
+ */
+
+#include "Memory.h"
+#include <cstdint>
+
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+namespace {
+
+CONSTEXPR_CONST size_t HugePageSize = 2 * 1024 * 1024;
+
+#if !defined(WIN32)
+CONSTEXPR_CONST int MPOL_INTERLEAVE_ = 3;
+CONSTEXPR_CONST unsigned MPOL_F_MEMS_ALLOWED_ = 1 << 2;
+CONSTEXPR_CONST unsigned long MaxNode = 64;
+#endif
+
+size_t roundUp(size_t size) {
+  if (size >= HugePageSize) {
+    return (size + HugePageSize - 1) & ~(HugePageSize - 1);
+  }
+  return size;
+}
+
+#if !defined(WIN32)
+/**
+ * 複数の NUMA ノードが使用可能であれば interleave を指定します。
+ * 失敗した場合は first-touch (既定のポリシー) のままにします。
+ */
+void interleave(void* ptr, size_t size) {
+#if defined(SYS_get_mempolicy) && defined(SYS_mbind)
+  int mode;
+  unsigned long nodes = 0;
+  if (syscall(SYS_get_mempolicy, &mode, &nodes, MaxNode, nullptr, MPOL_F_MEMS_ALLOWED_) != 0) {
+    return;
+  }
+  if (__builtin_popcountl(nodes) <= 1) {
+    return;
+  }
+  syscall(SYS_mbind, ptr, size, MPOL_INTERLEAVE_, &nodes, MaxNode, 0);
+#else
+  (void)ptr;
+  (void)size;
+#endif
+}
+#endif
+
+} // namespace
+
+namespace sunfish {
+
+namespace memory {
+
+void* allocateLarge(size_t size) {
+  size = roundUp(size);
+
+#if defined(WIN32)
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  void* ptr = MAP_FAILED;
+
+  if (size >= HugePageSize) {
+#if defined(MAP_HUGETLB)
+    // 予約済みの huge page
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (ptr == MAP_FAILED) {
+      // transparent huge page
+      ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(MADV_HUGEPAGE)
+      if (ptr != MAP_FAILED) {
+        madvise(ptr, size, MADV_HUGEPAGE);
+      }
+#endif
+    }
+    if (ptr != MAP_FAILED) {
+      interleave(ptr, size);
+    }
+  } else {
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  return ptr != MAP_FAILED ? ptr : nullptr;
+#endif
+}
+
+void freeLarge(void* ptr, size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+#if defined(WIN32)
+  (void)size;
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  munmap(ptr, roundUp(size));
+#endif
+}
+
+void* mapFile(const char* filename, size_t& size) {
+  size = 0;
+
+#if defined(WIN32)
+  (void)filename;
+  return nullptr;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    return nullptr;
+  }
+
+#if defined(MADV_WILLNEED)
+  // 先読みを開始させておく (完了は待たない)
+  madvise(ptr, (size_t)st.st_size, MADV_WILLNEED);
+#endif
+
+  size = (size_t)st.st_size;
+  return ptr;
+#endif
+}
+
+void unmapFile(void* ptr, size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+#if defined(WIN32)
+  (void)size;
+#else
+  munmap(ptr, size);
+#endif
+}
+
+} // namespace memory
+
+} // namespace sunfish
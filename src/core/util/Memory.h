@@ -9,14 +9,48 @@
 #include "../def.h"
 #include <cstddef>
 
+/**
+ * prefetch を発行するかどうか
+ * 効果を計測する際は PREFETCH=OFF でビルドして無効にします。
+ */
+#ifndef ENABLE_PREFETCH
+# define ENABLE_PREFETCH      1
+#endif
+
 namespace sunfish {
 
 namespace memory {
 
+/**
+ * 大きな領域を確保します。
+ * 可能であれば huge page を使用し, NUMA ノード間で interleave します。
+ * 確保した領域は 0 で初期化されています。
+ */
+void* allocateLarge(size_t size);
+
+/**
+ * allocateLarge で確保した領域を解放します。
+ */
+void freeLarge(void* ptr, size_t size);
+
+/**
+ * ファイルをメモリにマップします。
+ * 書き込みを行っていないページはページキャッシュを通して他のプロセスと共有されます。
+ * 書き込んだページはプロセス内にコピーされ、ファイルには反映されません。
+ * @param size マップしたサイズを受け取ります。
+ * @return {失敗した場合は nullptr を返します。}
+ */
+void* mapFile(const char* filename, size_t& size);
+
+/**
+ * mapFile でマップした領域を解放します。
+ */
+void unmapFile(void* ptr, size_t size);
+
 template <size_t size, int rw = 0, int locality = 1>
 inline void prefetch(const char* addr) {
   CONSTEXPR_CONST size_t CacheLineSize = 64;
-#if defined(UNIX)
+#if defined(UNIX) && ENABLE_PREFETCH
   for (size_t i = 0; i < size; i += CacheLineSize) {
     __builtin_prefetch(addr + i, rw, locality);
   }
@@ -0,0 +1,115 @@
+/* PerfCounter.cpp
+ *
+ * Kubo Ryosuke
+ */
+
+#include "PerfCounter.h"
+
+#if defined(__linux__)
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# include <cstring>
+#endif
+
+namespace {
+
+#if defined(__linux__)
+CONSTEXPR_CONST uint64_t cacheConfig(uint64_t cache, uint64_t op, uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+int openCounter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+} // namespace
+
+namespace sunfish {
+
+PerfCounter::PerfCounter() {
+  for (int i = 0; i < Num; i++) {
+    fds_[i] = -1;
+    values_[i] = 0;
+  }
+
+#if defined(__linux__)
+  fds_[Cycles] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  fds_[Instructions] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  fds_[L1DMiss] = openCounter(PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_L1D,
+                                                                PERF_COUNT_HW_CACHE_OP_READ,
+                                                                PERF_COUNT_HW_CACHE_RESULT_MISS));
+  // 汎用のイベントには L2 が無いため, L2 を外れて LLC に届いた要求数で代用する
+  fds_[L2Miss] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+  fds_[LLCMiss] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+}
+
+PerfCounter::~PerfCounter() {
+#if defined(__linux__)
+  for (int i = 0; i < Num; i++) {
+    if (fds_[i] >= 0) {
+      close(fds_[i]);
+    }
+  }
+#endif
+}
+
+bool PerfCounter::isAvailable() const {
+  for (int i = 0; i < Num; i++) {
+    if (fds_[i] >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerfCounter::start() {
+#if defined(__linux__)
+  for (int i = 0; i < Num; i++) {
+    values_[i] = 0;
+    if (fds_[i] >= 0) {
+      ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+void PerfCounter::stop() {
+#if defined(__linux__)
+  for (int i = 0; i < Num; i++) {
+    if (fds_[i] >= 0) {
+      ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t value;
+      if (read(fds_[i], &value, sizeof(value)) == sizeof(value)) {
+        values_[i] = value;
+      }
+    }
+  }
+#endif
+}
+
+const char* PerfCounter::getName(Type type) {
+  switch (type) {
+  case Cycles      : return "cycles";
+  case Instructions: return "instructions";
+  case L1DMiss     : return "L1D miss";
+  case L2Miss      : return "L2 miss";
+  case LLCMiss     : return "LLC miss";
+  default          : return "";
+  }
+}
+
+} // namespace sunfish
@@ -0,0 +1,66 @@
+/* PerfCounter.h
+ *
+ * Kubo Ryosuke
+ */
+
+#ifndef SUNFISH_PERFCOUNTER__
+#define SUNFISH_PERFCOUNTER__
+
+#include "../def.h"
+#include <cstdint>
+
+namespace sunfish {
+
+/**
+ * CPU のハードウェアカウンタ
+ * Linux の perf_event を使用します。それ以外の環境では常に無効です。
+ */
+class PerfCounter {
+public:
+
+  enum Type {
+    Cycles,
+    Instructions,
+    L1DMiss,
+    L2Miss,
+    LLCMiss,
+    Num,
+  };
+
+  PerfCounter();
+  PerfCounter(const PerfCounter&) = delete;
+  PerfCounter(PerfCounter&&) = delete;
+  ~PerfCounter();
+
+  /**
+   * 1つでもカウンタが使用可能かどうかを返します。
+   */
+  bool isAvailable() const;
+
+  /**
+   * 指定したカウンタが使用可能かどうかを返します。
+   */
+  bool isAvailable(Type type) const {
+    return fds_[type] >= 0;
+  }
+
+  void start();
+
+  void stop();
+
+  uint64_t get(Type type) const {
+    return values_[type];
+  }
+
+  static const char* getName(Type type);
+
+private:
+
+  int fds_[Num];
+  uint64_t values_[Num];
+
+};
+
+} // namespace sunfish
+
+#endif // SUNFISH_PERFCOUNTER__
@@ -0,0 +1,56 @@
+/* compact.cpp
+ * 
+ * Kubo Ryosuke
+ */
+
+#include "config.h"
+#include "searcher/eval/Evaluator.h"
+#include "logger/Logger.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace sunfish;
+
+/**
+ * eval.bin を量子化して eval_q8.bin に書き出します。
+ */
+int compactEvalBin() {
+  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
+  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
+  Loggers::message.addStream(std::cerr);
+
+  Evaluator eval(Evaluator::InitType::Zero);
+  if (!eval.readFile()) {
+    Loggers::error << "could not read eval.bin.";
+    return 1;
+  }
+
+  if (!eval.writeCompactFile()) {
+    Loggers::error << "could not write the quantized table.";
+    return 1;
+  }
+
+  // 量子化による誤差を集計する
+  Evaluator compact(Evaluator::InitType::Zero);
+  if (!compact.readCompactFile()) {
+    Loggers::error << "could not read the quantized table.";
+    return 1;
+  }
+
+  const auto& table = compact.compactTable();
+  int32_t maxError = 0;
+  int64_t sumError = 0ll;
+  for (int king = 0; king < 81; king++) {
+    for (int i = 0; i < KPP_SIZE; i++) {
+      int32_t error = std::abs((int32_t)eval.t_->kpp[king][i] - (int32_t)table.kpp[king][i] * (1 << table.shift[king]));
+      maxError = std::max(maxError, error);
+      sumError += error;
+    }
+  }
+
+  Loggers::message << "maxError=" << maxError
+    << "\tmeanError=" << ((double)sumError / KPP_ALL)
+    << "\tsize=" << sizeof(CompactTable) << "/" << sizeof(Evaluator::Table);
+
+  return 0;
+}
@@ -59,6 +59,9 @@ ConsoleManager::Config ConsoleManager::getDefaultConfig() {
   config.maxDepth = 15;
   config.limitSeconds = 3.0;
   config.worker = 1;
+  config.hashSizeMB = Searcher::DefaultHashSizeMB;
+  config.evalCacheSizeMB = Searcher::DefaultEvalCacheSizeMB;
+  config.lazySmp = false;
   config.inFileName = "";
   config.outFileName = "console.csa";
   return config;
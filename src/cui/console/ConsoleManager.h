@@ -47,6 +47,9 @@ public:
     int maxDepth;
     int limitSeconds;
     int worker;
+    int hashSizeMB;
+    int evalCacheSizeMB;
+    bool lazySmp;
     std::string inFileName;
     std::string outFileName;
   };
@@ -155,6 +158,9 @@ public:
     searcherConfig.limitSeconds = config.limitSeconds;
     searcherConfig.workerSize = config.worker;
     searcherConfig.treeSize = Searcher::standardTreeSize(config.worker);
+    searcherConfig.hashSizeMB = config.hashSizeMB;
+    searcherConfig.evalCacheSizeMB = config.evalCacheSizeMB;
+    searcherConfig.lazySmp = config.lazySmp;
     return searcherConfig;
   }
 
@@ -0,0 +1,179 @@
+/* perft.cpp
+ * 
+ * Kubo Ryosuke
+ */
+
+#include "config.h"
+#include "logger/Logger.h"
+#include "console/ConsoleManager.h"
+#include "core/move/Perft.h"
+#include "core/move/MoveTable.h"
+#include "core/record/CsaReader.h"
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+
+using namespace sunfish;
+
+namespace {
+
+const char* PerftData[] = {
+R"(
+P1-KY-KE-GI-KI-OU-KI-GI-KE-KY
+P2 * -HI *  *  *  *  * -KA * 
+P3-FU-FU-FU-FU-FU-FU-FU-FU-FU
+P4 *  *  *  *  *  *  *  *  * 
+P5 *  *  *  *  *  *  *  *  * 
+P6 *  *  *  *  *  *  *  *  * 
+P7+FU+FU+FU+FU+FU+FU+FU+FU+FU
+P8 * +KA *  *  *  *  * +HI * 
+P9+KY+KE+GI+KI+OU+KI+GI+KE+KY
++
+)",
+R"(
+P1-KY-KE * -KI *  *  *  *  * 
+P2 * -OU-GI-GI *  *  *  *  * 
+P3 * -FU-FU-FU * -FU-KE *  * 
+P4-FU *  *  * +GI *  *  * -FU
+P5 *  * +GI *  *  * -FU *  * 
+P6+FU+HI *  * +UM *  *  *  * 
+P7 * +FU+KE+FU+OU * +FU * +KE
+P8 *  * +KI *  *  *  *  *  * 
+P9+KY *  * -RY *  *  *  * +KY
+P+00FU00FU00FU00KI00KI
+P-00FU00FU00FU00FU00KY00KA
+-
+)",
+R"(
+P1-KY-HI *  *  *  *  * -KE-OU
+P2 *  *  *  *  *  * -KI-GI-KY
+P3 *  * +KA * -GI-KI * -FU-FU
+P4 * -FU-FU-FU *  * -FU *  * 
+P5-FU-KE *  * +GI+FU * +FU+FU
+P6 * +GI+FU+FU *  * +FU *  * 
+P7+FU+FU * +KI * -FU+KE *  * 
+P8 * +OU+KI *  *  *  * +HI * 
+P9+KY+KE *  *  * -KA *  * +KY
+P+00FU
+P-00FU
+-
+)",
+R"(
+P1-KY *  *  *  *  * -OU-KE-KY
+P2 *  *  *  * -GI * -KI *  * 
+P3-FU *  *  * -HI *  * -GI-FU
+P4 *  * -FU+KA * -KI * -FU * 
+P5 * -FU *  *  * -FU-FU *  * 
+P6 *  * +FU-FU+FU *  *  * +FU
+P7+FU *  * +OU * +UM+KI *  * 
+P8 *  *  *  *  *  *  * +HI * 
+P9+KY+KE *  *  *  *  *  * +KY
+P+00GI00KE00KE00FU00FU00FU00FU00FU
+P-00KI00GI00FU
++
+)",
+};
+
+std::string format(const Perft::Result& result, bool divide, bool phaseTiming) {
+  std::ostringstream oss;
+
+  if (divide) {
+    for (const auto& entry : result.divide) {
+      oss << std::left << std::setw(10) << entry.first.toString() << std::right
+          << std::setw(16) << entry.second << "\n";
+    }
+  }
+
+  double nps = result.seconds > 0.0 ? result.nodes / result.seconds : 0.0;
+  oss << std::left << std::setw(15) << "leaves" << std::right << std::setw(16) << result.leaves << "\n";
+  oss << std::left << std::setw(15) << "nodes" << std::right << std::setw(16) << result.nodes << "\n";
+  oss << std::left << std::setw(15) << "time (sec)" << std::right
+      << std::fixed << std::setprecision(3) << std::setw(16) << result.seconds << "\n";
+  oss << std::left << std::setw(15) << "nps" << std::right
+      << std::setprecision(0) << std::setw(16) << nps << "\n";
+
+  oss << std::left << std::setw(15) << "phase" << std::right
+      << std::setw(16) << "calls" << std::setw(16) << "moves";
+  if (phaseTiming) {
+    oss << std::setw(10) << "time" << std::setw(14) << "calls/sec";
+  }
+  oss << "\n";
+  for (int phase = 0; phase < Perft::PhaseNum; phase++) {
+    const auto& stat = result.phases[phase];
+    oss << std::left << std::setw(15) << Perft::getPhaseName(static_cast<Perft::Phase>(phase)) << std::right
+        << std::setw(16) << stat.calls << std::setw(16) << stat.moves;
+    if (phaseTiming) {
+      oss << std::setprecision(3) << std::setw(10) << stat.seconds
+          << std::setprecision(0) << std::setw(14) << (stat.seconds > 0.0 ? stat.calls / stat.seconds : 0.0);
+    }
+    oss << "\n";
+  }
+
+  return oss.str();
+}
+
+} // namespace
+
+/**
+ * 指し手生成の perft を実行します。
+ * 局面の指定が無い場合は組み込みの局面集を使用します。
+ */
+int perft(int depth, bool legal, bool phaseTiming, const std::vector<std::string>& files, const ConsoleManager::Config& config) {
+  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
+  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
+  Loggers::message.addStream(std::cerr);
+
+  std::vector<Board> boards;
+  if (files.empty()) {
+    for (auto p : PerftData) {
+      std::istringstream iss(p);
+      Board board;
+      CsaReader::readBoard(iss, board);
+      boards.push_back(board);
+    }
+  } else {
+    for (const auto& file : files) {
+      Record record;
+      if (!CsaReader::read(file, record)) {
+        Loggers::error << "could not read a file: " << file;
+        return 1;
+      }
+      boards.push_back(record.getBoard());
+    }
+  }
+
+  Perft perft(config.worker);
+  perft.setLegal(legal);
+  perft.setPhaseTiming(phaseTiming);
+
+  Loggers::message << "pext: " << (MoveTables::isPextEnabled() ? "enabled" : "disabled")
+                   << ", legal: " << (legal ? "enabled" : "disabled");
+  Perft::Result total;
+  total.leaves = 0;
+  total.nodes = 0;
+  total.seconds = 0.0;
+  memset(total.phases, 0, sizeof(total.phases));
+
+  for (const auto& board : boards) {
+    Loggers::message << board.toStringCsa();
+
+    auto result = perft.run(board, depth);
+
+    Loggers::message << format(result, true, phaseTiming);
+
+    total.leaves += result.leaves;
+    total.nodes += result.nodes;
+    total.seconds += result.seconds;
+    for (int phase = 0; phase < Perft::PhaseNum; phase++) {
+      total.phases[phase].calls += result.phases[phase].calls;
+      total.phases[phase].moves += result.phases[phase].moves;
+      total.phases[phase].seconds += result.phases[phase].seconds;
+    }
+  }
+
+  if (boards.size() >= 2) {
+    Loggers::message << "total\n" << format(total, false, phaseTiming);
+  }
+
+  return 0;
+}
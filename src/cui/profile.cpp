@@ -8,26 +8,20 @@
 #include "console/ConsoleManager.h"
 #include "searcher/Searcher.h"
 #include "core/record/CsaReader.h"
+#include "core/util/PerfCounter.h"
+#include "core/util/Memory.h"
+#include "core/util/Random.h"
+#include "core/util/Timer.h"
+#include "core/avx2.h"
+#include <iomanip>
+#include <sstream>
+#include <vector>
 
 using namespace sunfish;
 
-int profile(const ConsoleManager::Config& config, bool full) {
-  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
-  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
-  Loggers::message.addStream(std::cerr);
-  Loggers::send.addStream(std::cerr, true, true, ESC_SEQ_COLOR_BLUE, ESC_SEQ_COLOR_RESET);
-  Loggers::receive.addStream(std::cerr, true, true, ESC_SEQ_COLOR_MAGENTA, ESC_SEQ_COLOR_RESET);
-#ifndef NDEBUG
-  Loggers::debug.addStream(std::cerr, ESC_SEQ_COLOR_CYAN, ESC_SEQ_COLOR_RESET);
-  Loggers::test.addStream(std::cerr, ESC_SEQ_COLOR_GREEN, ESC_SEQ_COLOR_RESET);
-  Loggers::develop.addStream(std::cerr, ESC_SEQ_COLOR_WHITE, ESC_SEQ_COLOR_RESET);
-#endif
+namespace {
 
-  Searcher searcher;
-  auto searcherConfig = ConsoleManager::buildSearcherConfig(searcher.getConfig(), config);
-  searcher.setConfig(searcherConfig);
-
-  const char* data[] = {
+const char* ProfileData[] = {
 R"(
 P1-KY-KE * -KI *  *  *  *  * 
 P2 * -OU-GI-GI *  *  *  *  * 
@@ -112,9 +106,161 @@ P+00GI00KE00KE00FU00FU00FU00FU00FU
 P-00KI00GI00FU
 +
 )",
-  };
+};
+
+/**
+ * 64 bytes 化する前の TT バケット (72 bytes)
+ * ttBench で現在のバケットと比較するために残しています。
+ */
+class LegacyTTEs {
+private:
+
+  static CONSTEXPR_CONST uint32_t Size = 4;
+  TTE slots_[Size];
+  volatile uint32_t lastAccess_;
+
+public:
+
+  LegacyTTEs() : lastAccess_(0) {
+  }
 
-  for (auto p : data) {
+  void init(uint32_t) {
+    for (uint32_t i = 0; i < Size; i++) {
+      slots_[i].init();
+    }
+    lastAccess_ = 0;
+  }
+
+  void set(const TTE& entity) {
+    uint32_t l = lastAccess_ % Size;
+    for (uint32_t i = 0; i < Size; i++) {
+      const uint32_t index = (l + i) % Size;
+      if (slots_[index].getHash() == entity.getHash()) {
+        slots_[index] = entity;
+        lastAccess_ = index;
+        return;
+      }
+    }
+
+    l++;
+    for (uint32_t i = 0; i < Size; i++) {
+      const uint32_t index = (l + i) % Size;
+      if (slots_[index].getAge() != entity.getAge()) {
+        slots_[index] = entity;
+        lastAccess_ = index;
+        return;
+      }
+    }
+
+    const uint32_t index = l % Size;
+    slots_[index] = entity;
+    lastAccess_ = index;
+  }
+
+  bool get(uint64_t hash, TTE& entity) {
+    uint32_t l = lastAccess_ % Size;
+    for (uint32_t i = 0; i < Size; i++) {
+      const uint32_t index = (l + i) % Size;
+      if (slots_[index].checkHash(hash)) {
+        entity = slots_[index];
+        lastAccess_ = index;
+        return true;
+      }
+    }
+    return false;
+  }
+
+};
+
+static_assert(sizeof(LegacyTTEs) == 72, "invalid struct size");
+
+/**
+ * 変更前のバケットによる TT
+ * TT と同じ HashTable で確保し, バケットの構造だけが異なるようにします。
+ */
+class LegacyTT : public HashTable<LegacyTTEs> {
+public:
+
+  LegacyTT(uint32_t bits) : HashTable<LegacyTTEs>(bits) {
+  }
+
+  void set(uint64_t hash, const TTE& entity) {
+    getEntity(hash).set(entity);
+  }
+
+  bool get(uint64_t hash, TTE& entity) {
+    return getEntity(hash).get(hash, entity) && entity.checkHash(hash);
+  }
+
+};
+
+struct ProbeResult {
+  double independent;
+  double dependent;
+  uint64_t hit;
+  uint64_t dependentHit;
+};
+
+/**
+ * probe(hash) を繰り返して 1 回あたりの時間 [nsec] を計測します。
+ * independent は前の結果に依存しない連続参照 (スループット),
+ * dependent は前の結果で次のキーを選ぶ参照 (レイテンシ) です。
+ * next は hashes の添字の巡回置換で, 偶数番目のキーのみ登録されていることを前提とします。
+ */
+template <class Probe>
+ProbeResult measureProbe(const std::vector<uint64_t>& hashes, const std::vector<uint32_t>& next,
+                         int loop, Probe probe) {
+  ProbeResult result;
+  const uint64_t count = (uint64_t)hashes.size() * loop;
+  const uint64_t mask = hashes.size() - 1;
+
+  Timer timer;
+  timer.set();
+  uint64_t hit = 0;
+  for (int l = 0; l < loop; l++) {
+    for (const auto& hash : hashes) {
+      hit += probe(hash) ? 1 : 0;
+    }
+  }
+  result.independent = timer.get() * 1.0e+9 / count;
+  result.hit = hit;
+
+  timer.set();
+  uint64_t index = 0;
+  hit = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    bool found = probe(hashes[index]);
+    hit += found ? 1 : 0;
+    // 偶数番目のキーのみ登録済みなので flip は常に 0 だが, 次の参照先を結果に依存させる。
+    uint64_t flip = (found ? 1 : 0) ^ ((index & 1) == 0 ? 1 : 0);
+    index = next[index ^ flip] & mask;
+  }
+  result.dependent = timer.get() * 1.0e+9 / count;
+  result.dependentHit = hit;
+
+  return result;
+}
+
+} // namespace
+
+int profile(const ConsoleManager::Config& config, bool full) {
+  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
+  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
+  Loggers::message.addStream(std::cerr);
+  Loggers::send.addStream(std::cerr, true, true, ESC_SEQ_COLOR_BLUE, ESC_SEQ_COLOR_RESET);
+  Loggers::receive.addStream(std::cerr, true, true, ESC_SEQ_COLOR_MAGENTA, ESC_SEQ_COLOR_RESET);
+#ifndef NDEBUG
+  Loggers::debug.addStream(std::cerr, ESC_SEQ_COLOR_CYAN, ESC_SEQ_COLOR_RESET);
+  Loggers::test.addStream(std::cerr, ESC_SEQ_COLOR_GREEN, ESC_SEQ_COLOR_RESET);
+  Loggers::develop.addStream(std::cerr, ESC_SEQ_COLOR_WHITE, ESC_SEQ_COLOR_RESET);
+#endif
+
+  Searcher searcher;
+  auto searcherConfig = ConsoleManager::buildSearcherConfig(searcher.getConfig(), config);
+  searcher.setConfig(searcherConfig);
+
+
+  for (auto p : ProfileData) {
     Loggers::message << p;
 
     std::istringstream iss(p);
@@ -136,3 +282,256 @@ P-00KI00GI00FU
 
   return 0;
 }
+
+/**
+ * 探索中のキャッシュミスをハードウェアカウンタで計測します。
+ * プリフェッチの効果は PREFETCH=OFF でビルドしたものと結果を比較します。
+ */
+int perfStat(const ConsoleManager::Config& config) {
+  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
+  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
+  Loggers::message.addStream(std::cerr);
+
+  PerfCounter counter;
+  if (!counter.isAvailable()) {
+    Loggers::warning << "hardware performance counters are not available.";
+  }
+
+  Searcher searcher;
+  auto searcherConfig = ConsoleManager::buildSearcherConfig(searcher.getConfig(), config);
+  searcher.setConfig(searcherConfig);
+
+  uint64_t nodes = 0;
+  float time = 0.0f;
+  counter.start();
+  for (auto p : ProfileData) {
+    std::istringstream iss(p);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    Move move;
+    searcher.idsearch(board, move);
+
+    const auto& info = searcher.getInfo();
+    nodes += info.node + info.qnode;
+    time += info.time;
+  }
+  counter.stop();
+
+  std::ostringstream oss;
+  oss << "prefetch: " << (ENABLE_PREFETCH ? "enabled" : "disabled") << "\n";
+  auto print = [&oss](const char* name, double value, bool available) {
+    oss << std::left << std::setw(15) << name << std::right;
+    if (!available) {
+      oss << std::setw(16) << "-" << "\n";
+      return;
+    }
+    oss << std::fixed << std::setprecision(0) << std::setw(16) << value << "\n";
+  };
+  print("nodes", nodes, true);
+  print("time (ms)", time * 1.0e+3, true);
+  for (int type = 0; type < PerfCounter::Num; type++) {
+    auto t = static_cast<PerfCounter::Type>(type);
+    print(PerfCounter::getName(t), counter.get(t), counter.isAvailable(t));
+  }
+  for (int type = PerfCounter::L1DMiss; type < PerfCounter::Num; type++) {
+    auto t = static_cast<PerfCounter::Type>(type);
+    std::string name = std::string(PerfCounter::getName(t)) + "/node";
+    print(name.c_str(), nodes != 0 ? (double)counter.get(t) / nodes * 1000 : 0.0, counter.isAvailable(t));
+  }
+  oss << "(per-node values are x1000)";
+
+  Loggers::message << oss.str();
+
+  return 0;
+}
+
+/**
+ * 評価関数の構成ごとに同じ問題を探索し, 速度と結果を比較します。
+ */
+int evalBench(const ConsoleManager::Config& config) {
+  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
+  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
+  Loggers::message.addStream(std::cerr);
+
+  Searcher searcher;
+  auto searcherConfig = ConsoleManager::buildSearcherConfig(searcher.getConfig(), config);
+  searcher.setConfig(searcherConfig);
+
+  auto variant0 = Evaluator::getVariant();
+
+  std::ostringstream oss;
+  oss << std::left << std::setw(10) << "variant" << std::right
+      << std::setw(12) << "nodes" << std::setw(10) << "time" << std::setw(10) << "nps"
+      << "  moves/values" << "\n";
+
+  for (int i = 0; i < static_cast<int>(EvaluatorVariant::Num); i++) {
+    auto variant = static_cast<EvaluatorVariant>(i);
+    Evaluator::setVariant(variant);
+
+    searcher.clearTT();
+    searcher.clearHistory();
+    searcher.getEvaluator().clearCache();
+
+    uint64_t nodes = 0;
+    float time = 0.0f;
+    std::ostringstream results;
+    for (auto p : ProfileData) {
+      std::istringstream iss(p);
+      Board board;
+      CsaReader::readBoard(iss, board);
+
+      Move move;
+      bool ok = searcher.idsearch(board, move);
+
+      const auto& info = searcher.getInfo();
+      nodes += info.node + info.qnode;
+      time += info.time;
+      results << ' ' << (ok ? move.toString() : "-") << '(' << info.eval.int32() << ')';
+    }
+
+    oss << std::left << std::setw(10) << Evaluator::getVariantName(variant) << std::right
+        << std::setw(12) << nodes
+        << std::fixed << std::setprecision(3) << std::setw(10) << time
+        << std::setprecision(0) << std::setw(10) << (time > 0.0f ? nodes / time : 0.0f)
+        << ' ' << results.str() << "\n";
+  }
+
+  Evaluator::setVariant(variant0);
+
+  Loggers::message << oss.str();
+
+  return 0;
+}
+
+/**
+ * 評価関数の速度を計測します。
+ * SIMD が使える場合はスカラー版と比較します。
+ */
+int evalSpeed(const ConsoleManager::Config&) {
+  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
+  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
+  Loggers::message.addStream(std::cerr);
+
+  const int loop = 100000;
+
+  std::vector<Board> boards;
+  for (auto p : ProfileData) {
+    std::istringstream iss(p);
+    boards.emplace_back();
+    CsaReader::readBoard(iss, boards.back());
+  }
+
+  Evaluator eval(Evaluator::InitType::Random);
+  bool simdEnabled = Evaluator::isSimdEnabled();
+
+  auto measure = [&](bool simd) {
+    Evaluator::setSimdEnabled(simd);
+
+    Timer timer;
+    timer.set();
+
+    int32_t check = 0;
+    for (int l = 0; l < loop; l++) {
+      for (const auto& board : boards) {
+        check += eval.evaluate(board).positional().int32();
+      }
+    }
+
+    float elapsed = timer.get();
+    double count = (double)loop * boards.size();
+    Loggers::message << (simd ? "avx2   : " : "scalar : ")
+      << std::fixed << std::setprecision(0) << (count / elapsed) << "[evals/sec]"
+      << " (" << std::setprecision(3) << elapsed << "[sec], check " << check << ")";
+  };
+
+  Loggers::message << "avx2 supported: " << (isAvx2Supported() ? "yes" : "no");
+  measure(false);
+  if (isAvx2Supported()) {
+    measure(true);
+  }
+
+  Evaluator::setSimdEnabled(simdEnabled);
+
+  return 0;
+}
+
+/**
+ * TT の参照時間を現在のバケット (64 bytes) と変更前のバケット (72 bytes) で比較します。
+ * テーブルのバケット数は --hash で指定したサイズから決めます。
+ */
+int ttBench(const ConsoleManager::Config& config) {
+  Loggers::error.addStream(std::cerr, ESC_SEQ_COLOR_RED, ESC_SEQ_COLOR_RESET);
+  Loggers::warning.addStream(std::cerr, ESC_SEQ_COLOR_YELLOW, ESC_SEQ_COLOR_RESET);
+  Loggers::message.addStream(std::cerr);
+
+  const int hashCount = 1024 * 1024;
+  const int loop = 8;
+
+  TT tt;
+  if (!tt.setSizeMB(config.hashSizeMB)) {
+    return 1;
+  }
+  const uint64_t buckets = tt.getSize();
+  uint32_t bits = 0;
+  while ((1llu << bits) < buckets) {
+    bits++;
+  }
+  LegacyTT legacy(bits);
+  if (legacy.getSize() != buckets) {
+    return 1;
+  }
+
+  Random random;
+  std::vector<uint64_t> hashes(hashCount);
+  for (auto& hash : hashes) {
+    hash = random.getInt64();
+  }
+  // 全てのキーを 1 周する巡回置換 (Sattolo)
+  std::vector<uint32_t> next(hashCount);
+  for (int i = 0; i < hashCount; i++) {
+    next[i] = i;
+  }
+  for (int i = hashCount - 1; i > 0; i--) {
+    std::swap(next[i], next[random.getInt64(i)]);
+  }
+
+  // 半分だけ登録しておく
+  for (int i = 0; i < hashCount; i += 2) {
+    tt.entryPV(hashes[i], 1, 0);
+    TTE e;
+    e.updatePV(hashes[i], 1, 0, 1);
+    legacy.set(hashes[i], e);
+  }
+
+  auto current = measureProbe(hashes, next, loop, [&tt](uint64_t hash) {
+    TTE e;
+    return tt.get(hash, e);
+  });
+  auto old = measureProbe(hashes, next, loop, [&legacy](uint64_t hash) {
+    TTE e;
+    return legacy.get(hash, e);
+  });
+
+  std::ostringstream oss;
+  oss << "buckets: " << buckets << ", keys: " << hashCount << " (half registered), loop: " << loop << "\n";
+  oss << std::left << std::setw(10) << "bucket" << std::right
+      << std::setw(8) << "bytes" << std::setw(12) << "table[MB]"
+      << std::setw(16) << "ns/probe(thr)" << std::setw(16) << "ns/probe(lat)" << "\n";
+  auto print = [&oss, buckets](const char* name, size_t bytes, const ProbeResult& r) {
+    oss << std::left << std::setw(10) << name << std::right
+        << std::setw(8) << bytes
+        << std::setw(12) << (bytes * buckets / 1024 / 1024)
+        << std::fixed << std::setprecision(2)
+        << std::setw(16) << r.independent
+        << std::setw(16) << r.dependent << "\n";
+  };
+  print("current", sizeof(TTEs), current);
+  print("legacy", sizeof(LegacyTTEs), old);
+  oss << "hits (current): " << current.hit << ", " << current.dependentHit << "\n";
+  oss << "hits (legacy) : " << old.hit << ", " << old.dependentHit;
+
+  Loggers::message << oss.str();
+
+  return 0;
+}
@@ -6,6 +6,8 @@
 #include "sunfish.h"
 #include "config.h"
 #include "console/ConsoleManager.h"
+#include "searcher/eval/Evaluator.h"
+#include "core/move/MoveTable.h"
 #include "program_options/ProgramOptions.h"
 #include "logger/Logger.h"
 #include <iostream>
@@ -25,11 +27,21 @@ int network();
 int learn();
 int analyzeEvalBin();
 
+// compact.cpp
+int compactEvalBin();
+
 // solve.cpp
 int solve(const std::vector<std::string>& problems, const ConsoleManager::Config&);
 
 // profile.cpp
 int profile(const ConsoleManager::Config&, bool);
+int perfStat(const ConsoleManager::Config&);
+int evalBench(const ConsoleManager::Config&);
+int ttBench(const ConsoleManager::Config&);
+int evalSpeed(const ConsoleManager::Config&);
+
+// perft.cpp
+int perft(int depth, bool legal, bool phaseTiming, const std::vector<std::string>& files, const ConsoleManager::Config&);
 
 // test.cpp
 int test();
@@ -58,15 +70,29 @@ int main(int argc, char** argv, char** /*envp*/) {
   po.addOption("depth", "d", "max depth (default: 15)", true);
   po.addOption("time", "t", "max time for 1 move (default: 3)", true);
   po.addOption("worker", "r", "the number of worker threads", true);
+  po.addOption("hash", "size of transposition table [MBytes]", true);
+  po.addOption("evalhash", "size of evaluation cache [MBytes]", true);
+  po.addOption("lazysmp", "use Lazy SMP instead of YBWC");
+  po.addOption("qeval", "use the quantized evaluation table (eval_q8.bin)");
+  po.addOption("evalvar", "evaluator variant [default/nohash/nodiff/nokpp]", true);
+  po.addOption("nopext", "do not use PEXT for sliding piece attacks");
   po.addOption("book", "generate book", true);
   po.addOption("network", "n", "network mode");
 #ifndef NLEARN
   po.addOption("learn", "l", "learning");
   po.addOption("analyze", "a", "");
 #endif // NLEARN
+  po.addOption("compact", "quantize eval.bin into eval_q8.bin");
   po.addOption("problem", "p", "solve problems");
   po.addOption("profile", "solve problems");
   po.addOption("profile1", "solve one problem");
+  po.addOption("perfstat", "measure cache misses during search (compare with a PREFETCH=OFF build)");
+  po.addOption("evalbench", "compare evaluator variants");
+  po.addOption("evalspeed", "measure evaluations per second (scalar and AVX2)");
+  po.addOption("ttbench", "compare TT probe time of 64-byte and 72-byte buckets");
+  po.addOption("perft", "count leaf nodes of move generation (CSA files or built-in positions)", true);
+  po.addOption("legal", "use the legal move generator in --perft");
+  po.addOption("phase-time", "time each move generation call in --perft (includes timer overhead)");
 #ifndef NDEBUG
   po.addOption("test", "unit test");
   po.addOption("dev", "development method", true);
@@ -78,6 +104,26 @@ int main(int argc, char** argv, char** /*envp*/) {
     std::cerr << "WARNING: `" << invalidArg.arg << "' is invalid argument: " << invalidArg.reason << std::endl;
   }
 
+  // 量子化した評価関数
+  if (po.has("qeval")) {
+    Evaluator::setCompactEnabled(true);
+  }
+
+  // 飛び駒の利きの算出方法 (既定では CPU に応じて自動で選択)
+  if (po.has("nopext")) {
+    MoveTables::setPextEnabled(false);
+  }
+
+  // 評価関数の構成
+  if (po.has("evalvar")) {
+    EvaluatorVariant variant;
+    if (!Evaluator::parseVariant(po.getValue("evalvar"), variant)) {
+      std::cerr << "ERROR: unknown evaluator variant: " << po.getValue("evalvar") << std::endl;
+      return 1;
+    }
+    Evaluator::setVariant(variant);
+  }
+
   if (po.has("help")) {
     // show help
     std::cerr << po.help() << std::endl;
@@ -98,6 +144,9 @@ int main(int argc, char** argv, char** /*envp*/) {
     return analyzeEvalBin();
 
 #endif // NLEARN
+  } else if (po.has("compact")) {
+    return compactEvalBin();
+
 #ifndef NDEBUG
   } else if (po.has("test")) {
     // unit test
@@ -178,6 +227,23 @@ int main(int argc, char** argv, char** /*envp*/) {
     config.worker = worker;
   }
 
+  // ハッシュ表のサイズ
+  if (po.has("hash")) {
+    int hash = std::stoi(po.getValue("hash"));
+    config.hashSizeMB = hash;
+  }
+
+  // 評価値キャッシュのサイズ
+  if (po.has("evalhash")) {
+    int evalHash = std::stoi(po.getValue("evalhash"));
+    config.evalCacheSizeMB = evalHash;
+  }
+
+  // 並列探索方式
+  if (po.has("lazysmp")) {
+    config.lazySmp = true;
+  }
+
   // 最大思考時間
   if (po.has("time")) {
     config.limitSeconds = std::stod(po.getValue("time"));
@@ -198,6 +264,32 @@ int main(int argc, char** argv, char** /*envp*/) {
     return profile(config, false);
   }
 
+  if (po.has("perfstat")) {
+    // hardware performance counters
+    return perfStat(config);
+  }
+
+  if (po.has("ttbench")) {
+    // TT bucket layout
+    return ttBench(config);
+  }
+
+  if (po.has("evalbench")) {
+    // evaluator variants
+    return evalBench(config);
+  }
+
+  if (po.has("evalspeed")) {
+    // evaluation speed
+    return evalSpeed(config);
+  }
+
+  if (po.has("perft")) {
+    // move generation
+    int depth = std::stoi(po.getValue("perft"));
+    return perft(depth, po.has("legal"), po.has("phase-time"), po.getStdArgs(), config);
+  }
+
   return play(config);
 }
 
@@ -16,6 +16,7 @@
 #include <list>
 #include <algorithm>
 #include <cstdlib>
+#include <vector>
 
 #define SEARCH_WINDOW  256
 #define NORM           1.0e-2f
@@ -428,6 +429,9 @@ bool BatchLearning::generateGradient(uint32_t wn) {
   gm0->init();
   g0->init();
 
+  std::vector<Board> boards;
+  std::vector<ValuePair> values;
+
   while (true) {
     // ルート局面
     CompactBoard cb;
@@ -462,16 +466,28 @@ bool BatchLearning::generateGradient(uint32_t wn) {
       return true;
     };
 
-    Board board0 = root;
-    readPV(board0);
-    Value val0 = evalMerged_.evaluate(board0).value();
-
+    // 先頭が棋譜の手, 以降が他の手の PV の末端局面
+    boards.clear();
+    boards.push_back(root);
+    readPV(boards.back());
     while (true) {
-      Board board = root;
-      if (!readPV(board)) {
+      boards.push_back(root);
+      if (!readPV(boards.back())) {
+        boards.pop_back();
         break;
       }
-      Value val = evalMerged_.evaluate(board).value();
+    }
+
+    // 同じ根から生じた局面は玉の位置を共有しやすいのでまとめて評価する
+    values.resize(boards.size());
+    evalMerged_.evaluateBatch(boards.data(), boards.size(), values.data());
+
+    const Board& board0 = boards[0];
+    Value val0 = values[0].value();
+
+    for (size_t i = 1; i < boards.size(); i++) {
+      const Board& board = boards[i];
+      Value val = values[i].value();
 
       float diff = val.int32() - val0.int32();
       diff = black ? diff : -diff;
@@ -774,6 +790,7 @@ bool BatchLearning::run() {
     auto searchConfig = searcher.getConfig();
     searchConfig.workerSize = 1;
     searchConfig.treeSize = Searcher::standardTreeSize(searchConfig.workerSize);
+    searchConfig.hashSizeMB = config_.getInt(LCONF_HASH);
     searchConfig.enableLimit = false;
     searchConfig.enableTimeManagement = false;
     searchConfig.ponder = false;
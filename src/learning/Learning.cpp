@@ -9,6 +9,7 @@
 #include "./LearningConfig.h"
 #include "./BatchLearning.h"
 #include "./OnlineLearning.h"
+#include "searcher/Searcher.h"
 #include "config/Config.h"
 #include "logger/Logger.h"
 
@@ -23,6 +24,7 @@ bool Learning::run() {
   config.addDef(LCONF_DEPTH, "3");
   config.addDef(LCONF_THREADS, "1");
   config.addDef(LCONF_ITERATION, "10");
+  config.addDef(LCONF_HASH, std::to_string(Searcher::DefaultHashSizeMB));
 
   // 設定読み込み
   if (!config.read(CONFPATH)) {
@@ -13,6 +13,7 @@
 #define LCONF_DEPTH       "depth"
 #define LCONF_THREADS     "threads"
 #define LCONF_ITERATION   "iteration"
+#define LCONF_HASH        "hash"
 
 #define LCONF_MODE_BATCH  "batch"
 #define LCONF_MODE_ONLINE "online"
@@ -407,6 +407,7 @@ bool OnlineLearning::run() {
     searchConfig.maxDepth = config_.getInt(LCONF_DEPTH);
     searchConfig.workerSize = 1;
     searchConfig.treeSize = Searcher::standardTreeSize(searchConfig.workerSize);
+    searchConfig.hashSizeMB = config_.getInt(LCONF_HASH);
     searchConfig.enableLimit = false;
     searchConfig.enableTimeManagement = false;
     searchConfig.ponder = false;
@@ -10,6 +10,7 @@
 #include <mutex>
 #include <fstream>
 #include <sstream>
+#include <functional>
 #include <thread>
 
 #define WARN_IGNORED(key, value) Loggers::warning << __FILE_LINE__ << ": not supported: key=[" << (key) << "] value=[" << (value) << "]"
@@ -22,6 +23,9 @@
 #define CONF_LIMIT     "limit"
 #define CONF_REPEAT    "repeat"
 #define CONF_WORKER    "worker"
+#define CONF_HASH      "hash"
+#define CONF_EVALHASH  "evalhash"
+#define CONF_LAZYSMP   "lazysmp"
 #define CONF_PONDER    "ponder"
 #define CONF_KEEPALIVE "keepalive"
 #define CONF_KEEPIDLE  "keepidle"
@@ -46,6 +50,9 @@ CsaClient::CsaClient() {
   config_.addDef(CONF_LIMIT, "10");
   config_.addDef(CONF_REPEAT, "1");
   config_.addDef(CONF_WORKER, "1");
+  config_.addDef(CONF_HASH, std::to_string(Searcher::DefaultHashSizeMB));
+  config_.addDef(CONF_EVALHASH, std::to_string(Searcher::DefaultEvalCacheSizeMB));
+  config_.addDef(CONF_LAZYSMP, "0");
   config_.addDef(CONF_PONDER, "1");
   config_.addDef(CONF_KEEPALIVE, "1");
   config_.addDef(CONF_KEEPIDLE, "120");
@@ -54,6 +61,14 @@ CsaClient::CsaClient() {
   config_.addDef(CONF_FLOODGATE, "0");
   config_.addDef(CONF_KIFU, "Kifu");
   config_.addDef(CONF_MONITOR, "");
+
+  // 相手番中の思考が始まったら enemyTurn に通知する
+  searcher_.setStartHandler([this]() {
+    {
+      std::lock_guard<std::mutex> lock(ponderMutex_);
+    }
+    ponderCond_.notify_one();
+  });
 }
 
 const CsaClient::ReceiveFlagSet* CsaClient::getFlagSets() {
@@ -110,6 +125,9 @@ bool CsaClient::execute() {
   searchConfigBase_.enableLimit = searchConfigBase_.limitSeconds != 0.0;
   searchConfigBase_.workerSize = std::max(config_.getInt(CONF_WORKER), 1);
   searchConfigBase_.treeSize = Searcher::standardTreeSize(searchConfigBase_.workerSize);
+  searchConfigBase_.hashSizeMB = std::max(config_.getInt(CONF_HASH), 1);
+  searchConfigBase_.evalCacheSizeMB = std::max(config_.getInt(CONF_EVALHASH), 1);
+  searchConfigBase_.lazySmp = config_.getBool(CONF_LAZYSMP);
   searcher_.setConfig(searchConfigBase_);
 
   // 連続対局
@@ -307,8 +325,12 @@ bool CsaClient::enemyTurn() {
 
   if (enablePonder) {
     // 探索が開始されていることを確認
-    while (!searcher_.isRunning() && !ponderCompleted_.load()) {
-      std::this_thread::yield();
+    {
+      // 探索開始と終了は ponderCond_ で通知される
+      std::unique_lock<std::mutex> lock(ponderMutex_);
+      ponderCond_.wait(lock, [this]() {
+        return searcher_.isRunning() || ponderCompleted_.load();
+      });
     }
 
     // 相手番中の思考終了
@@ -371,7 +393,11 @@ void CsaClient::ponder() {
   searcher_.clearRecord();
   Loggers::message << "end ponder";
 
-  ponderCompleted_.store(true);
+  {
+    std::lock_guard<std::mutex> lock(ponderMutex_);
+    ponderCompleted_.store(true);
+  }
+  ponderCond_.notify_one();
 }
 
 /**
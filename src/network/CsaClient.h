@@ -18,6 +18,7 @@
 #include <queue>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 
 namespace sunfish {
@@ -123,6 +124,8 @@ private:
   RemainingTime whiteTime_;
 
   std::atomic<bool> ponderCompleted_;
+  std::mutex ponderMutex_;
+  std::condition_variable ponderCond_;
 
   struct GameSummary {
     /** 自分の手番が黒か */
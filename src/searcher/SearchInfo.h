@@ -21,6 +21,10 @@ struct SearchInfoBase {
   uint64_t failHighIsKiller2;
   uint64_t hashProbed;
   uint64_t hashHit;
+  uint64_t evalCacheProbed;
+  uint64_t evalCacheHit;
+  uint64_t lazyEvalProbed;
+  uint64_t lazyEvalCut;
   uint64_t hashExact;
   uint64_t hashLower;
   uint64_t hashUpper;
@@ -53,6 +57,8 @@ struct SearchInfoBase {
   uint64_t onerepExtension;
   uint64_t recapExtension;
   uint64_t split;
+  uint64_t lateJoin;
+  uint64_t idleTime;
   uint64_t node;
   uint64_t qnode;
 };
@@ -63,6 +69,8 @@ struct SearchInfo : public SearchInfoBase {
   Move move;
   Value eval;
   int32_t lastDepth;
+  int32_t hashfull;
+  int64_t treeBytes;
   PV pv;
 };
 
@@ -7,6 +7,7 @@
 #include "tree/Worker.h"
 #include "tree/NodeStat.h"
 #include "see/See.h"
+#include "progress/Progression.h"
 #include "core/def.h"
 #include "core/move/MoveGenerator.h"
 #include "logger/Logger.h"
@@ -28,6 +29,7 @@
 #define ENABLE_MATE_HISTORY           1
 #define ENABLE_STORE_PV               1
 #define ENABLE_SINGULAR_EXTENSION     1
+#define ENABLE_LAZY_EVAL              1
 #define SHALLOW_SEE                   0 // should be 0
 
 #define ENABLE_MOVE_COUNT_EXPT        0
@@ -130,6 +132,8 @@ namespace search_param {
   CONSTEXPR_CONST int REC_THRESHOLD = Searcher::Depth1Ply * 3;
   CONSTEXPR_CONST int RAZOR_DEPTH = Searcher::Depth1Ply * 4;
   CONSTEXPR_CONST int QUIES_RELIEVE_PLY = 7;
+  CONSTEXPR_CONST int LAZY_EVAL_MARGIN_OPENING = 384;
+  CONSTEXPR_CONST int LAZY_EVAL_MARGIN_ENDING = 768;
 
 }
 
@@ -159,6 +163,17 @@ namespace search_func {
     return 256 + 64 / Searcher::Depth1Ply * std::max(depth, 0);
   }
 
+  /**
+   * 1手による位置評価の変化の上限
+   * 終盤ほど KPP の変化が大きいため, 進行度に応じて広げます。
+   */
+  inline int lazyEvalMargin(int progress) {
+    using namespace search_param;
+    const int scale = Progression::Scale;
+    progress = std::min(std::max(progress, 0), scale);
+    return LAZY_EVAL_MARGIN_OPENING + (LAZY_EVAL_MARGIN_ENDING - LAZY_EVAL_MARGIN_OPENING) * progress / scale;
+  }
+
   inline int futilityMoveCounts(bool improving, int depth) {
     int d = depth + (improving ? Searcher::Depth1Ply * 1 / 4 : 0);
     int x = (d * d) / (Searcher::Depth1Ply * Searcher::Depth1Ply);
@@ -172,6 +187,79 @@ namespace search_func {
     return key ^ m;
   }
 
+  inline void countEvalCache(const Tree& tree, Worker& worker) {
+    worker.info.evalCacheProbed++;
+    if (tree.isEvalCacheHit()) {
+      worker.info.evalCacheHit++;
+    }
+  }
+
+  /**
+   * 指し手生成
+   * ENABLE_LEGAL_MOVE_GEN が有効な場合は pinned を使って合法手のみを生成します。
+   */
+  inline void generateCap(const Board& board, MoveList& moves, const Bitboard& pinned) {
+#if ENABLE_LEGAL_MOVE_GEN
+    MoveGenerator::generateCapLegal(board, moves, pinned);
+#else
+    MoveGenerator::generateCap(board, moves);
+#endif
+  }
+
+  inline void generateNoCap(const Board& board, MoveList& moves, const Bitboard& pinned) {
+#if ENABLE_LEGAL_MOVE_GEN
+    MoveGenerator::generateNoCapLegal(board, moves, pinned);
+#else
+    MoveGenerator::generateNoCap(board, moves);
+#endif
+  }
+
+  inline void generateDrop(const Board& board, MoveList& moves) {
+#if ENABLE_LEGAL_MOVE_GEN
+    MoveGenerator::generateDropLegal(board, moves);
+#else
+    MoveGenerator::generateDrop(board, moves);
+#endif
+  }
+
+  inline void generateEvasion(const Board& board, MoveList& moves, const Bitboard& pinned) {
+#if ENABLE_LEGAL_MOVE_GEN
+    MoveGenerator::generateEvasionLegal(board, moves, pinned);
+#else
+    MoveGenerator::generateEvasion(board, moves);
+#endif
+  }
+
+  /**
+   * 指し手生成と同時に scorer のスコアを scores に書き込みます。
+   */
+  template <class Scorer>
+  inline void generateNoCap(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer, const Bitboard& pinned) {
+#if ENABLE_LEGAL_MOVE_GEN
+    MoveGenerator::generateNoCapLegal(board, moves, scores, scorer, pinned);
+#else
+    MoveGenerator::generateNoCap(board, moves, scores, scorer);
+#endif
+  }
+
+  template <class Scorer>
+  inline void generateDrop(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer) {
+#if ENABLE_LEGAL_MOVE_GEN
+    MoveGenerator::generateDropLegal(board, moves, scores, scorer);
+#else
+    MoveGenerator::generateDrop(board, moves, scores, scorer);
+#endif
+  }
+
+  template <class Scorer>
+  inline void generateEvasion(const Board& board, MoveList& moves, int32_t* scores, const Scorer& scorer, const Bitboard& pinned) {
+#if ENABLE_LEGAL_MOVE_GEN
+    MoveGenerator::generateEvasionLegal(board, moves, scores, scorer, pinned);
+#else
+    MoveGenerator::generateEvasion(board, moves, scores, scorer);
+#endif
+  }
+
 }
 
 /**
@@ -180,6 +268,7 @@ namespace search_func {
 Searcher::Searcher()
 : trees_(nullptr)
 , workers_(nullptr)
+, splitGeneration_(0)
 , forceInterrupt_(false)
 , isRunning_(false) {
   initConfig();
@@ -193,6 +282,7 @@ Searcher::Searcher(Evaluator& eval)
 : trees_(nullptr)
 , workers_(nullptr)
 , eval_(eval)
+, splitGeneration_(0)
 , forceInterrupt_(false)
 , isRunning_(false) {
   initConfig();
@@ -283,6 +373,10 @@ void Searcher::mergeInfo() {
     info_.failHighIsKiller2          += worker.info.failHighIsKiller2;
     info_.hashProbed                 += worker.info.hashProbed;
     info_.hashHit                    += worker.info.hashHit;
+    info_.evalCacheProbed            += worker.info.evalCacheProbed;
+    info_.evalCacheHit               += worker.info.evalCacheHit;
+    info_.lazyEvalProbed             += worker.info.lazyEvalProbed;
+    info_.lazyEvalCut                += worker.info.lazyEvalCut;
     info_.hashExact                  += worker.info.hashExact;
     info_.hashLower                  += worker.info.hashLower;
     info_.hashUpper                  += worker.info.hashUpper;
@@ -315,6 +409,8 @@ void Searcher::mergeInfo() {
     info_.onerepExtension            += worker.info.onerepExtension;
     info_.recapExtension             += worker.info.recapExtension;
     info_.split                      += worker.info.split;
+    info_.lateJoin                   += worker.info.lateJoin;
+    info_.idleTime                   += worker.info.idleTime;
     info_.node                       += worker.info.node;
     info_.qnode                      += worker.info.qnode;
   }
@@ -325,6 +421,9 @@ void Searcher::mergeInfo() {
  */
 void Searcher::before(const Board& initialBoard, bool fastStart) {
 
+  // 遅延評価の margin
+  lazyEvalMargin_ = search_func::lazyEvalMargin(Progression::evaluate(initialBoard));
+
 #if ENABLE_MOVE_COUNT_EXPT
   expt::move_count_based_pruning.clear();
 #endif
@@ -354,7 +453,8 @@ void Searcher::before(const Board& initialBoard, bool fastStart) {
     auto& tree = trees_[id];
     tree.init(id, initialBoard, eval_, record_);
   }
-  idleTreeCount_.store(config_.treeSize - 1);
+  idleTrees_.init(1, config_.treeSize);
+  openSplits_.init(config_.treeSize, config_.treeSize);
 
   // worker の初期化
   for (int id = 0; id < config_.workerSize; id++) {
@@ -364,7 +464,7 @@ void Searcher::before(const Board& initialBoard, bool fastStart) {
       worker.startOnChildThread();
     }
   }
-  idleWorkerCount_.store(config_.workerSize - 1);
+  idleWorkers_.init(1, config_.workerSize);
 
   // 最初の tree を確保
   auto& tree0 = trees_[MAIN_TREEID];
@@ -377,6 +477,9 @@ void Searcher::before(const Board& initialBoard, bool fastStart) {
 
   forceInterrupt_.store(false);
   isRunning_.store(true);
+  if (startHandler_) {
+    startHandler_();
+  }
 
   timeManager_.init();
 
@@ -458,6 +561,8 @@ void Searcher::after() {
   info_.nps = (info_.node + info_.qnode) / info_.time;
   info_.move = tree0.getPV().get(0).move;
   info_.pv.copy(tree0.getPV());
+  info_.hashfull = tt_.hashfull();
+  info_.treeBytes = Tree::getMemorySize();
 
   isRunning_.store(false);
   forceInterrupt_.store(false);
@@ -484,12 +589,17 @@ std::string Searcher::getInfoString() const {
   lines.emplace_back("nps            ", format (std::ceil(info_.nps)));
   lines.emplace_back("eval           ", format (info_.eval.int32()));
   lines.emplace_back("split          ", format (info_.split));
+  lines.emplace_back("late join      ", format (info_.lateJoin));
+  lines.emplace_back("bytes per tree ", format (info_.treeBytes));
+  lines.emplace_back("idle time [ms] ", format (info_.idleTime / 1000));
   lines.emplace_back("fail high first", format2(info_.failHighFirst, info_.failHigh));
   lines.emplace_back("fail high hash ", format2(info_.failHighIsHash, info_.failHigh));
   lines.emplace_back("fail high kill1", format2(info_.failHighIsKiller1, info_.failHigh));
   lines.emplace_back("fail high kill2", format2(info_.failHighIsKiller2, info_.failHigh));
   lines.emplace_back("expand hash    ", format2(info_.expandHashMove, info_.expand));
   lines.emplace_back("hash hit       ", format2(info_.hashHit, info_.hashProbed));
+  lines.emplace_back("eval cache hit ", format2(info_.evalCacheHit, info_.evalCacheProbed));
+  lines.emplace_back("lazy eval cut  ", format2(info_.lazyEvalCut, info_.lazyEvalProbed));
   lines.emplace_back("hash extract   ", format2(info_.hashExact, info_.hashProbed));
   lines.emplace_back("hash lower     ", format2(info_.hashLower, info_.hashProbed));
   lines.emplace_back("hash upper     ", format2(info_.hashUpper, info_.hashProbed));
@@ -497,6 +607,7 @@ std::string Searcher::getInfoString() const {
   lines.emplace_back("hash update    ", format2(info_.hashUpdate, info_.hashStore));
   lines.emplace_back("hash collide   ", format2(info_.hashCollision, info_.hashStore));
   lines.emplace_back("hash reject    ", format2(info_.hashReject, info_.hashStore));
+  lines.emplace_back("hashfull       ", format (info_.hashfull));
   lines.emplace_back("mate hit       ", format2(info_.mateHit, info_.mateProbed));
   lines.emplace_back("shek superior  ", format2(info_.shekSuperior, info_.shekProbed));
   lines.emplace_back("shek inferior  ", format2(info_.shekInferior, info_.shekProbed));
@@ -570,15 +681,25 @@ void Searcher::setRecord(const Record& record) {
 inline bool Searcher::isInterrupted(Tree& tree) {
   if (tree.getTlp().shutdown.load()) {
   }
-  if (forceInterrupt_.load()) {
-    return true;
-  }
-  if (config_.enableLimit && timer_.get() >= config_.limitSeconds) {
+  // 時間切れは pollTimer で forceInterrupt_ に反映される。
+  if (forceInterrupt_.load(std::memory_order_relaxed)) {
     return true;
   }
   return false;
 }
 
+static_assert((Searcher::PollNodes & (Searcher::PollNodes - 1)) == 0, "PollNodes must be a power of 2");
+
+/**
+ * 一定ノード数ごとに時間切れを確認します。
+ */
+inline void Searcher::pollTimer(uint64_t nodes) {
+  if ((nodes & (PollNodes - 1)) == 0 &&
+      config_.enableLimit && timer_.get() >= config_.limitSeconds) {
+    forceInterrupt_.store(true, std::memory_order_relaxed);
+  }
+}
+
 /**
  * 探索を強制的に打ち切ります。
  */
@@ -730,12 +851,12 @@ void Searcher::exceptPriorMoves(Tree& tree) {
     const Move& move = *ite;
 
     if ((node.expStat & HashDone) && move == node.hash) {
-      ite = tree.getMoves().remove(ite);
+      ite = tree.removeMove(ite);
       continue;
     }
     if (((node.expStat & Killer1Done) && move == node.killer1) ||
         ((node.expStat & Killer2Done) && move == node.killer2)) {
-      ite = tree.getMoves().remove(ite);
+      ite = tree.removeMove(ite);
       continue;
     }
 
@@ -746,16 +867,21 @@ void Searcher::exceptPriorMoves(Tree& tree) {
 /**
  * pick best move by history
  */
-bool Searcher::pickOneHistory(Tree& tree) {
+bool Searcher::pickOneHistory(Tree& tree, bool scored) {
   Moves::iterator best = tree.getEnd();
   uint32_t bestValue = 0;
 
   for (auto ite = tree.getNextMove(); ite != tree.getEnd(); ) {
     const Move& move = *ite;
 
-    auto key = History::getKey(move);
-    auto data = history_.getData(key);
-    auto value = History::getRatio(data);
+    uint32_t value;
+    if (scored) {
+      value = (uint32_t)tree.getSortValue(ite);
+    } else {
+      auto key = History::getKey(move);
+      auto data = history_.getData(key);
+      value = History::getRatio(data);
+    }
     if (value > bestValue) {
       best = ite;
       bestValue = value;
@@ -909,16 +1035,19 @@ bool Searcher::nextMove(Tree& tree) {
 
     case GenPhase::Capture:
       tree.setThroughPhase(false);
+#if ENABLE_LEGAL_MOVE_GEN
+      node.pinned = board.getPinnedPieces();
+#endif
       if (tree.isChecking()) {
         int offset = moves.end() - tree.getNextMove();
-        MoveGenerator::generateEvasion(board, moves);
+        search_func::generateEvasion(board, moves, node.pinned);
         sortSee(tree, offset, Value::Zero, Value::Zero, false, true, false, false);
         node.genPhase = GenPhase::End;
         break;
 
       } else {
         int offset = moves.end() - tree.getNextMove();
-        MoveGenerator::generateCap(board, moves);
+        search_func::generateCap(board, moves, node.pinned);
         sortSee(tree, offset, Value::Zero, Value::Zero, true, false, false, false);
         node.genPhase = GenPhase::History1;
         break;
@@ -927,12 +1056,13 @@ bool Searcher::nextMove(Tree& tree) {
 
     case GenPhase::History1:
       node.count = 0;
-      MoveGenerator::generateNoCap(board, moves);
-      MoveGenerator::generateDrop(board, moves);
+      // 生成時の history のスコアで最初の1手を選ぶ
+      search_func::generateNoCap(board, moves, tree.getSortValues(), HistoryScorer(history_), node.pinned);
+      search_func::generateDrop(board, moves, tree.getSortValues(), HistoryScorer(history_));
       exceptPriorMoves(tree);
       node.genPhase = GenPhase::History2;
       tree.setThroughPhase(true);
-      if (pickOneHistory(tree)) {
+      if (pickOneHistory(tree, true)) {
         tree.selectNextMove();
         return true;
       }
@@ -941,7 +1071,7 @@ bool Searcher::nextMove(Tree& tree) {
     case GenPhase::History2:
       node.genPhase = GenPhase::Misc;
       tree.setThroughPhase(true);
-      if (pickOneHistory(tree)) {
+      if (pickOneHistory(tree, false)) {
         tree.selectNextMove();
         return true;
       }
@@ -989,14 +1119,17 @@ bool Searcher::nextMoveQuies(Tree& tree, int qply, Value standPat, Value alpha)
       break;
 
     case GenPhase::CaptureOnly:
+#if ENABLE_LEGAL_MOVE_GEN
+      node.pinned = board.getPinnedPieces();
+#endif
       if (tree.isChecking()) {
-        MoveGenerator::generateEvasion(board, moves);
-        sortHistory(tree);
+        search_func::generateEvasion(board, moves, tree.getSortValues(), HistoryScorer(history_), node.pinned);
+        tree.sortAfterCurrent();
         node.genPhase = GenPhase::End;
         break;
 
       } else {
-        MoveGenerator::generateCap(board, moves);
+        search_func::generateCap(board, moves, node.pinned);
         if (qply >= search_param::QUIES_RELIEVE_PLY) {
           sortSee(tree, 0, standPat, alpha, false, false, true, true);
         } else {
@@ -1104,6 +1237,22 @@ Value Searcher::qsearch(Tree& tree, bool black, int qply, Value alpha, Value bet
 
   auto& worker = getWorker(tree);
   worker.info.qnode++;
+  pollTimer(worker.info.qnode);
+
+#if ENABLE_LAZY_EVAL
+  // lazy evaluation
+  if (tree.isLazyEval()) {
+    // 位置評価の変化が margin 以内であれば stand-pat で beta-cut できる
+    worker.info.lazyEvalProbed++;
+    Value lowerBound = tree.getValue() * (black ? 1 : -1) - lazyEvalMargin_;
+    if (lowerBound >= beta) {
+      worker.info.lazyEvalCut++;
+      return lowerBound;
+    }
+    tree.evaluateLazy(eval_);
+    search_func::countEvalCache(tree, worker);
+  }
+#endif
 
   // stand-pat
   Value standPat = tree.getValue() * (black ? 1 : -1);
@@ -1166,9 +1315,16 @@ Value Searcher::qsearch(Tree& tree, bool black, int qply, Value alpha, Value bet
 
   while (nextMoveQuies(tree, qply, standPat, alpha)) {
     // make move
+#if ENABLE_LAZY_EVAL
+    if (!tree.makeMoveLazy(eval_)) {
+      continue;
+    }
+#else
     if (!tree.makeMove(eval_)) {
       continue;
     }
+    search_func::countEvalCache(tree, worker);
+#endif
 
     // reccursive call
     Value currval;
@@ -1374,6 +1530,7 @@ Value Searcher::search(Tree& tree, bool black, int depth, Value alpha, Value bet
   }
 
   worker.info.node++;
+  pollTimer(worker.info.node);
 
   bool isNullWindow = (beta == alpha + 1);
 
@@ -1454,6 +1611,12 @@ Value Searcher::search(Tree& tree, bool black, int depth, Value alpha, Value bet
   Move best = Move::empty();
   bool doSingularExtension = false;
 
+  // 空いている worker は node ごとに1回だけ数えて split を試みる
+  // 後から空いた worker は joinSplit で途中参加する
+  const bool splittable = !config_.lazySmp &&
+    (depth >= Depth1Ply * 4 || (depth >= Depth1Ply * 3 && rootDepth_ < Depth1Ply * 12));
+  bool idleChecked = false;
+
 #if ENABLE_RAZOR_EXPT
   bool isRazoring = false;
 #endif
@@ -1759,10 +1922,17 @@ Value Searcher::search(Tree& tree, bool black, int depth, Value alpha, Value bet
       }
     }
 
+#if ENABLE_PREFETCH
+    // prefetch (子局面のハッシュ表)
+    // 枝刈りされた手では読み込まないように着手の直前で行う
+    tt_.prefetch(board.getHashAfter(move));
+#endif // ENABLE_PREFETCH
+
     // make move
     if (!tree.makeMove(eval_)) {
       continue;
     }
+    search_func::countEvalCache(tree, worker);
 
     Value newStandPat = tree.getValue() * (black ? 1 : -1);
 
@@ -1855,10 +2025,11 @@ Value Searcher::search(Tree& tree, bool black, int depth, Value alpha, Value bet
     }
 
     // split
-    if ((depth >= Depth1Ply * 4 || (depth >= Depth1Ply * 3 && rootDepth_ < Depth1Ply * 12)) &&
-        (!isCheckPrev || tree.getEnd() - tree.getCurrentMove() >= 4) &&
-        idleWorkerCount_.load() >= 1 && idleTreeCount_.load() >= 2) {
-      if (split(tree, black, depth, alpha, beta, best, standPat, stat, improving)) {
+    if (splittable && !idleChecked &&
+        (!isCheckPrev || tree.getEnd() - tree.getCurrentMove() >= 4)) {
+      idleChecked = true;
+      if (idleWorkers_.count() >= 1 && idleTrees_.count() >= 2 &&
+          split(tree, black, depth, alpha, beta, best, standPat, stat, improving)) {
         worker.info.split++;
         if (isInterrupted(tree)) {
           return Value::Zero;
@@ -1924,89 +2095,146 @@ search_end:
 
 void Searcher::releaseTree(int tid) {
   auto& tree = trees_[tid];
-  auto& parent = trees_[tree.getTlp().parentTreeId];
+  int parentId = tree.getTlp().parentTreeId;
   tree.unuse();
-  idleTreeCount_.fetch_add(1);
-  parent.getTlp().childCount.fetch_sub(1);
+  idleTrees_.release(tid);
+  if (parentId != Tree::InvalidId) {
+    auto& parent = trees_[parentId];
+    if (parent.getTlp().childCount.fetch_sub(1) == 1) {
+      // park している親の worker を起こす
+      workers_[parent.getTlp().workerId].wakeUp();
+    }
+  }
 }
 
 /**
- * split
+ * 進行中の split point に途中参加します。
+ * @return {参加できなかった場合は false を返します。}
  */
-bool Searcher::split(Tree& parent, bool black, int depth, Value alpha, Value beta, Move best, Value standPat, NodeStat stat, bool improving) {
-  int currTreeId = Tree::InvalidId;
+bool Searcher::joinSplit(int wid) {
+  // 残り深さが最も大きい split point を選ぶ
+  // ここでは lock を取らず, 選んだ親だけを後で lock して確認する。
+  int parentId = Tree::InvalidId;
+  int maxDepth = 0;
+  openSplits_.forEach([this, &parentId, &maxDepth](int id) {
+    int depth = trees_[id].getTlp().splitDepth.load(std::memory_order_relaxed);
+    if (depth > maxDepth) {
+      parentId = id;
+      maxDepth = depth;
+    }
+  });
+  if (parentId == Tree::InvalidId) {
+    return false;
+  }
 
-  {
-    std::lock_guard<std::mutex> lock(splitMutex_);
+  int tid = idleTrees_.acquireAny();
+  if (tid == -1) {
+    return false;
+  }
 
-    if (idleTreeCount_.load() <= 1 || idleWorkerCount_.load() == 0) {
+  if (!removeIdleWorker(wid)) {
+    // 既に他の split point に確保されている。
+    idleTrees_.release(tid);
+    return false;
+  }
+
+  auto& parent = trees_[parentId];
+  {
+    std::lock_guard<std::mutex> lock(parent.getMutex());
+    // 開いている間は childCount が 0 にならないので
+    // ここで数を増やせば親の tree は保持される。
+    if (!openSplits_.contains(parentId) ||
+        parent.getTlp().shutdown.load() || isShutdown(parent)) {
+      idleTrees_.release(tid);
+      addIdleWorker(wid);
       return false;
     }
+    parent.getTlp().childCount.fetch_add(1);
+  }
 
-    // カレントスレッドに割り当てる tree を決定
-    for (int tid = 1; tid < config_.treeSize; tid++) {
-      auto& tree = trees_[tid];
-      if (!tree.getTlp().used) {
-        currTreeId = tid;
-        tree.use(parent, parent.getTlp().workerId);
-        idleTreeCount_.fetch_sub(1);
-        break;
-      }
-    }
+  trees_[tid].use(parent, wid);
+  workers_[wid].info.lateJoin++;
+  workers_[wid].setJob(tid);
+  return true;
+}
 
-    // 他の worker と tree を確保
-    int childCount = 1;
-    for (int wid = 0; wid < config_.workerSize; wid++) {
-      auto& worker = workers_[wid];
-      if (!worker.job.load()) {
-        for (int tid = 1; tid < config_.treeSize; tid++) {
-          auto& tree = trees_[tid];
-          if (!tree.getTlp().used) {
-            tree.use(parent, wid);
-            idleTreeCount_.fetch_sub(1);
+/**
+ * split
+ */
+bool Searcher::split(Tree& parent, bool black, int depth, Value alpha, Value beta, Move best, Value standPat, NodeStat stat, bool improving) {
+  // カレントスレッドに割り当てる tree を確保
+  int currTreeId = idleTrees_.acquireAny();
+  if (currTreeId == -1) {
+    return false;
+  }
 
-            worker.setJob(tid);
-            idleWorkerCount_.fetch_sub(1);
+  // split point の初期化
+  // 子の探索を開始する前に全て書き込んでおく。
+  parent.getTlp().shutdown.store(false);
+  parent.getTlp().childCount.store(1);
+  parent.getTlp().black     = black;
+  parent.getTlp().depth     = depth;
+  parent.getTlp().alpha     = alpha;
+  parent.getTlp().beta      = beta;
+  parent.getTlp().best      = best;
+  parent.getTlp().standPat  = standPat;
+  parent.getTlp().stat      = stat;
+  parent.getTlp().improving = improving;
 
-            childCount++;
+  auto& tree = trees_[currTreeId];
+  tree.use(parent, parent.getTlp().workerId);
 
-            if (idleTreeCount_.load() == 0 || idleWorkerCount_.load() == 0) {
-              goto lab_assign_end;
-            }
+  // 他の worker と tree を確保
+  while (true) {
+    int wid = idleWorkers_.acquireAny();
+    if (wid == -1) {
+      break;
+    }
 
-            break;
-          }
-        }
-      }
+    int tid = idleTrees_.acquireAny();
+    if (tid == -1) {
+      idleWorkers_.release(wid);
+      break;
     }
-    lab_assign_end:
-      ;
 
-    parent.getTlp().childCount.store(childCount);
-    parent.getTlp().black     = black;
-    parent.getTlp().depth     = depth;
-    parent.getTlp().alpha     = alpha;
-    parent.getTlp().beta      = beta;
-    parent.getTlp().best      = best;
-    parent.getTlp().standPat  = standPat;
-    parent.getTlp().stat      = stat;
-    parent.getTlp().improving = improving;
+    trees_[tid].use(parent, wid);
+    parent.getTlp().childCount.fetch_add(1);
+    workers_[wid].setJob(tid);
+  }
+
+  if (parent.getTlp().childCount.load() == 1) {
+    // 他の worker を確保できなかった。
+    tree.unuse();
+    idleTrees_.release(currTreeId);
+    return false;
+  }
+
+  // 後から空いた worker が参加できるようにする
+  parent.getTlp().splitDepth.store(depth, std::memory_order_relaxed);
+  openSplits_.release(parent.getTlp().treeId);
+  splitGeneration_.fetch_add(1);
+
+  // 空いている tree の数 (途中参加できる数) だけ park している worker を起こす
+  int joinable = idleTrees_.count();
+  if (joinable > 0) {
+    idleWorkers_.forEach(joinable, [this](int wid) {
+      workers_[wid].wakeUp();
+    });
   }
 
-  auto& tree = trees_[currTreeId];
   auto& worker = workers_[parent.getTlp().workerId];
   worker.swapTree(currTreeId);
   searchTlp(tree);
   worker.swapTree(parent.getTlp().treeId);
 
   {
-    std::lock_guard<std::mutex> lock(splitMutex_);
-    tree.unuse();
-    idleTreeCount_.fetch_add(1);
-    parent.getTlp().childCount.fetch_sub(1);
+    std::lock_guard<std::mutex> lock(parent.getMutex());
+    openSplits_.acquire(parent.getTlp().treeId);
   }
 
-  if (!tree.getTlp().shutdown.load()) {
+  releaseTree(currTreeId);
+
+  if (!parent.getTlp().shutdown.load() && !isShutdown(parent)) {
     // suspend
     worker.waitForJob(&parent);
   } else {
@@ -2023,10 +2251,6 @@ bool Searcher::split(Tree& parent, bool black, int depth, Value alpha, Value bet
 }
 
 void Searcher::searchTlp(Tree& tree) {
-  {
-    std::lock_guard<std::mutex> lock(splitMutex_);
-  }
-
   auto& parent = trees_[tree.getTlp().parentTreeId];
   auto& worker = getWorker(tree);
 
@@ -2054,6 +2278,7 @@ void Searcher::searchTlp(Tree& tree) {
       std::lock_guard<std::mutex> lock(parent.getMutex());
 
       if (!nextMove(parent)) {
+        openSplits_.acquire(parent.getTlp().treeId);
         return;
       }
 
@@ -2148,6 +2373,7 @@ void Searcher::searchTlp(Tree& tree) {
     if (!tree.makeMove(eval_)) {
       continue;
     }
+    search_func::countEvalCache(tree, worker);
 
     Value newStandPat = tree.getValue() * (black ? 1 : -1);
 
@@ -2187,7 +2413,7 @@ void Searcher::searchTlp(Tree& tree) {
     {
       std::lock_guard<std::mutex> lock(parent.getMutex());
 
-      if (tree.getTlp().shutdown.load()) {
+      if (isShutdown(tree)) {
         return;
       }
 
@@ -2218,31 +2444,37 @@ void Searcher::searchTlp(Tree& tree) {
 }
 
 void Searcher::shutdownSiblings(Tree& parent) {
-  std::lock_guard<std::mutex> lock(splitMutex_);
+  parent.getTlp().shutdown.store(true);
+  openSplits_.acquire(parent.getTlp().treeId);
+}
 
-  for (int id = 0; id < config_.treeSize; id++) {
-    int parentId = trees_[id].getTlp().parentTreeId;
-    while (parentId != Tree::InvalidId) {
-      if (parentId == parent.getTlp().treeId) {
-        trees_[id].getTlp().shutdown.store(true);
-        break;
-      }
-      parentId = trees_[parentId].getTlp().parentTreeId;
+bool Searcher::isShutdown(Tree& tree) {
+  int parentId = tree.getTlp().parentTreeId;
+  while (parentId != Tree::InvalidId) {
+    auto& parent = trees_[parentId];
+    if (parent.getTlp().shutdown.load()) {
+      return true;
     }
+    parentId = parent.getTlp().parentTreeId;
   }
+  return false;
 }
 
 /**
  * search on root node
  */
-Value Searcher::searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move& best,
+Value Searcher::searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move& best, int32_t* rootValues,
     bool breakOnFailLow /*= false*/, bool forceFullWindow /*= false*/) {
   const auto& board = tree.getBoard();
+  auto& worker = getWorker(tree);
   bool black = board.isBlack();
   bool isFirst = true;
+  bool isMain = &tree == &trees_[MAIN_TREEID];
   Value oldAlpha = alpha;
 
-  rootDepth_ = depth;
+  if (isMain) {
+    rootDepth_ = depth;
+  }
 
   while (nextMove(tree)) {
     Move move = *tree.getCurrentMove();
@@ -2258,7 +2490,7 @@ Value Searcher::searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move&
     if (isCheckCurr) {
       // check
       newDepth += search_param::EXT_CHECK;
-      info_.checkExtension++;
+      worker.info.checkExtension++;
     }
 
     // late move reduction
@@ -2274,6 +2506,7 @@ Value Searcher::searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move&
     // make move
     bool ok = tree.makeMove(eval_);
     assert(ok);
+    search_func::countEvalCache(tree, worker);
 
     Value currval;
 
@@ -2304,6 +2537,7 @@ Value Searcher::searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move&
     tree.unmakeMove();
 
     // 中断判定
+    pollTimer(0);
     if (isInterrupted(tree)) {
       return alpha;
     }
@@ -2315,12 +2549,14 @@ Value Searcher::searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move&
     // ソート用に値をセット
     auto index = tree.getIndexByMove(move);
     if (forceFullWindow || currval > alpha) {
-      rootValues_[index] = currval.int32();
+      rootValues[index] = currval.int32();
     } else {
-      rootValues_[index] = -Value::Inf;
+      rootValues[index] = -Value::Inf;
     }
 
-    timeManager_.addMove(move, currval);
+    if (isMain) {
+      timeManager_.addMove(move, currval);
+    }
 
     // 値更新
     if (currval > alpha) {
@@ -2329,10 +2565,12 @@ Value Searcher::searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move&
       best = move;
       tree.updatePV(depth);
 
-      if (depth >= Depth1Ply * ITERATE_INFO_THRESHOLD || currval >= Value::Mate) {
-        showPV(depth / Depth1Ply, tree.getPV(), black ? currval : -currval);
+      if (isMain) {
+        if (depth >= Depth1Ply * ITERATE_INFO_THRESHOLD || currval >= Value::Mate) {
+          showPV(depth / Depth1Ply, tree.getPV(), black ? currval : -currval);
+        }
+        info_.lastDepth = depth / Depth1Ply;
       }
-      info_.lastDepth = depth / Depth1Ply;
 
       // beta-cut or update best move
       if (alpha >= beta) {
@@ -2372,7 +2610,7 @@ bool Searcher::searchAsp(int depth, Move& best, Value baseAlpha, Value baseBeta,
     const Value alpha = Value::max(alphas[lower], baseAlpha);
     const Value beta = Value::min(betas[upper], baseBeta);
 
-    value = searchRoot(tree0, depth, alpha, beta, best, true);
+    value = searchRoot(tree0, depth, alpha, beta, best, rootValues_, true);
 
     // 中断判定
     if (isInterrupted(tree0)) {
@@ -2480,25 +2718,14 @@ void Searcher::showEndOfIterate(int depth) {
   Loggers::message << oss.str();
 }
 
-void Searcher::generateMovesOnRoot() {
-  auto& tree0 = trees_[0];
-
-  auto& moves = tree0.getMoves();
-  const auto& board = tree0.getBoard();
+void Searcher::generateMovesOnRoot(Tree& tree) {
+  auto& moves = tree.getMoves();
+  const auto& board = tree.getBoard();
 
   // 合法手生成
-  tree0.initGenPhase();
-  MoveGenerator::generate(board, moves);
-  tree0.resetGenPhase();
-
-  // 非合法手除去
-  for (auto ite = moves.begin(); ite != moves.end();) {
-    if (!board.isValidMove(*ite)) {
-      ite = moves.remove(ite);
-    } else {
-      ++ite;
-    }
-  }
+  tree.initGenPhase();
+  MoveGenerator::generateLegal(board, moves);
+  tree.resetGenPhase();
 
 #if ENABLE_ROOT_MOVES_SHUFFLE
   // シャッフル
@@ -2506,6 +2733,113 @@ void Searcher::generateMovesOnRoot() {
 #endif
 }
 
+/**
+ * Lazy SMP の helper を開始します。
+ */
+void Searcher::startHelpers() {
+  int helperSize = std::min(config_.workerSize, config_.treeSize);
+
+  helperResults_.resize(helperSize);
+
+  for (int wid = 1; wid < helperSize; wid++) {
+    // worker と同じ ID の tree を割り当てる
+    auto& tree = trees_[wid];
+    auto& worker = workers_[wid];
+    idleTrees_.acquire(wid);
+    tree.use(wid);
+
+    // 指し手の順序を helper ごとに変える
+    generateMovesOnRoot(tree);
+    auto& moves = tree.getMoves();
+    random_.shuffle(moves.begin(), moves.end());
+
+    helperResults_[wid].depth = 0;
+
+    idleWorkers_.acquire(wid);
+    worker.setJob(wid);
+  }
+}
+
+/**
+ * Lazy SMP の helper を停止します。
+ */
+void Searcher::stopHelpers() {
+  int helperSize = std::min(config_.workerSize, config_.treeSize);
+
+  forceInterrupt_.store(true);
+
+  for (int wid = 1; wid < helperSize; wid++) {
+    workers_[wid].waitForIdle();
+  }
+}
+
+bool Searcher::selectHelperResult(int completedDepth, Move& best, Value& value) {
+  int helperSize = std::min(config_.workerSize, config_.treeSize);
+
+  int selected = 0;
+  int depth = completedDepth;
+  for (int wid = 1; wid < helperSize; wid++) {
+    const auto& result = helperResults_[wid];
+    if (result.depth > depth && !result.best.isEmpty()) {
+      selected = wid;
+      depth = result.depth;
+    }
+  }
+
+  if (selected == 0) {
+    return false;
+  }
+
+  const auto& result = helperResults_[selected];
+  best = result.best;
+  value = result.value;
+  info_.lastDepth = result.depth;
+  info_.eval = result.value;
+
+  if (config_.logging) {
+    Loggers::message << "helper " << selected << ": " << result.depth << ": "
+      << result.best.toString() << ": " << result.value.int32();
+  }
+
+  return true;
+}
+
+/**
+ * Lazy SMP の helper による反復深化探索
+ * helper ごとに深さを間引いて, 探索する深さを分散させます。
+ */
+void Searcher::searchHelper(Tree& tree) {
+  CONSTEXPR_CONST int SkipTableSize = 20;
+  static const int skipSize[SkipTableSize] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+  static const int skipPhase[SkipTableSize] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+  int index = (tree.getTlp().workerId - 1) % SkipTableSize;
+  int32_t rootValues[1024] = { 0 };
+  Move best;
+
+  for (int depth = 1; depth <= config_.maxDepth; depth++) {
+    if (((depth + skipPhase[index]) / skipSize[index]) % 2 != 0) {
+      continue;
+    }
+
+    tree.selectFirstMove();
+    Value value = searchRoot(tree, depth * Depth1Ply + Depth1Ply / 2, -Value::Inf, Value::Inf, best, rootValues);
+
+    // 中断判定
+    if (isInterrupted(tree)) {
+      break;
+    }
+
+    auto& result = helperResults_[tree.getTlp().workerId];
+    result.depth = depth;
+    result.best = best;
+    result.value = value;
+
+    tree.setSortValues(rootValues);
+    tree.sortAll();
+  }
+}
+
 /**
  * 指定した局面に対して探索を実行します。
  * @return {負けたか中断された場合にfalseを返します。}
@@ -2518,9 +2852,13 @@ bool Searcher::search(const Board& initialBoard, Move& best,
   auto& tree0 = trees_[0];
   int depth = config_.maxDepth;
 
-  generateMovesOnRoot();
+  generateMovesOnRoot(tree0);
 
-  Value value = searchRoot(tree0, depth * Depth1Ply + Depth1Ply / 2, alpha, beta, best);
+  if (config_.lazySmp) {
+    startHelpers();
+  }
+
+  Value value = searchRoot(tree0, depth * Depth1Ply + Depth1Ply / 2, alpha, beta, best, rootValues_);
 
   info_.lastDepth = depth;
   info_.eval = value;
@@ -2532,6 +2870,14 @@ bool Searcher::search(const Board& initialBoard, Move& best,
     result = false;
   }
 
+  if (config_.lazySmp) {
+    // 中断された場合は helper の完了した反復を使う
+    stopHelpers();
+    if (!result && selectHelperResult(0, best, value)) {
+      result = value > alpha;
+    }
+  }
+
   // 後処理
   after();
 
@@ -2547,15 +2893,24 @@ bool Searcher::idsearch(Move& best, Value alpha, Value beta) {
   auto& tree0 = trees_[0];
   bool result = false;
 
-  generateMovesOnRoot();
+  generateMovesOnRoot(tree0);
 
-  Value value = searchRoot(tree0, Depth1Ply, -Value::Inf, Value::Inf, best, false, true);
+  Value value = searchRoot(tree0, Depth1Ply, -Value::Inf, Value::Inf, best, rootValues_, false, true);
   tree0.setSortValues(rootValues_);
   tree0.sortAll();
 
+  if (config_.lazySmp) {
+    startHelpers();
+  }
+
+  int completedDepth = 0;
   for (int depth = 1; depth <= config_.maxDepth; depth++) {
     bool cont = searchAsp(depth * Depth1Ply + Depth1Ply / 2, best, alpha, beta, value);
 
+    if (!isInterrupted(tree0)) {
+      completedDepth = depth;
+    }
+
 #if DEBUG_ROOT_MOVES
     std::ostringstream oss;
     for (auto ite = tree0.getBegin(); ite != tree0.getEnd(); ite++) {
@@ -2587,6 +2942,13 @@ bool Searcher::idsearch(Move& best, Value alpha, Value beta) {
     timeManager_.nextDepth();
   }
 
+  if (config_.lazySmp) {
+    stopHelpers();
+    if (selectHelperResult(completedDepth, best, value)) {
+      result = value > alpha;
+    }
+  }
+
   return result;
 
 }
@@ -11,9 +11,10 @@
 #include "SearchInfo.h"
 #include "eval/EvaluateTable.h"
 #include "tree/Tree.h"
-#include "history/History.h"
+#include "tree/IdleBitmap.h"
 #include "tt/TT.h"
 #include "time/TimeManager.h"
+#include "core/move/History.h"
 #include "core/record/Record.h"
 #include "core/util/Timer.h"
 #include "core/util/Random.h"
@@ -21,6 +22,7 @@
 #include <mutex>
 #include <atomic>
 #include <climits>
+#include <functional>
 
 namespace sunfish {
 
@@ -68,10 +70,13 @@ public:
     int32_t maxDepth;
     int32_t treeSize;
     int32_t workerSize;
+    int32_t hashSizeMB;
+    int32_t evalCacheSizeMB;
     float limitSeconds;
     bool enableLimit;
     bool enableTimeManagement;
     bool threadPooling;
+    bool lazySmp;
     bool ponder;
     bool logging;
 #if !defined(NLEARN)
@@ -80,6 +85,11 @@ public:
   };
 
   static const int DefaultMaxDepth = 7;
+  static const int DefaultHashSizeMB = 40;
+  static const int DefaultEvalCacheSizeMB = 4;
+
+  /** 時間切れを確認する間隔(ノード数) */
+  static CONSTEXPR_CONST uint64_t PollNodes = 1024;
 
 private:
 
@@ -112,11 +122,24 @@ private:
   MateHistory mateHistory_;
 
   /** values of child node of root node */
-  int rootValues_[1024];
+  int32_t rootValues_[1024];
 
   int rootDepth_;
 
-  std::mutex splitMutex_;
+  /** 遅延評価で許容する位置評価の変化 */
+  int lazyEvalMargin_;
+
+  /** 空いている tree */
+  IdleBitmap idleTrees_;
+
+  /** 空いている worker */
+  IdleBitmap idleWorkers_;
+
+  /** 途中参加できる split point */
+  IdleBitmap openSplits_;
+
+  /** split point が開かれるたびに増える番号 */
+  std::atomic<uint32_t> splitGeneration_;
 
   /** 中断フラグ */
   std::atomic<bool> forceInterrupt_;
@@ -124,9 +147,20 @@ private:
   /** 実行中フラグ */
   std::atomic<bool> isRunning_;
 
+  /** 探索開始時に呼び出す関数 */
+  std::function<void()> startHandler_;
+
   /** 思考時間制御 */
   TimeManager timeManager_;
 
+  /** Lazy SMP の helper が最後に完了した反復 */
+  struct HelperResult {
+    int depth;
+    Move best;
+    Value value;
+  };
+  std::vector<HelperResult> helperResults_;
+
   /** record */
   std::vector<Move> record_;
 
@@ -139,10 +173,13 @@ private:
     config_.maxDepth = DefaultMaxDepth;
     config_.treeSize = 1;
     config_.workerSize = 1;
+    config_.hashSizeMB = DefaultHashSizeMB;
+    config_.evalCacheSizeMB = DefaultEvalCacheSizeMB;
     config_.enableLimit = true;
     config_.limitSeconds = 10.0;
     config_.enableTimeManagement = true;
     config_.threadPooling = true;
+    config_.lazySmp = false;
     config_.ponder = false;
     config_.logging = true;
 #if !defined(NLEARN)
@@ -202,6 +239,11 @@ private:
    */
   bool isInterrupted(Tree& tree);
 
+  /**
+   * 時間切れを確認します。
+   */
+  void pollTimer(uint64_t nodes);
+
   /**
    * get see value
    */
@@ -220,8 +262,9 @@ private:
 
   /**
    * pick best move by history
+   * scored が true の場合は指し手生成時に書き込んだソート値を使用します。
    */
-  bool pickOneHistory(Tree& tree);
+  bool pickOneHistory(Tree& tree, bool scored);
 
   /**
    * sort moves by history
@@ -281,10 +324,15 @@ private:
 
   void shutdownSiblings(Tree& parent);
 
+  /**
+   * 祖先の split point で beta-cut が発生したかを判定します。
+   */
+  bool isShutdown(Tree& tree);
+
   /**
    * search on root node
    */
-  Value searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move& best,
+  Value searchRoot(Tree& tree, int depth, Value alpha, Value beta, Move& best, int32_t* rootValues,
       bool breakOnFailLow = false, bool forceFullWindow = false);
 
   /**
@@ -297,7 +345,28 @@ private:
 
   void showEndOfIterate(int depth);
 
-  void generateMovesOnRoot();
+  void generateMovesOnRoot(Tree& tree);
+
+  /**
+   * Lazy SMP の helper を開始します。
+   */
+  void startHelpers();
+
+  /**
+   * Lazy SMP の helper を停止します。
+   */
+  void stopHelpers();
+
+  /**
+   * Lazy SMP の helper による反復深化探索
+   */
+  void searchHelper(Tree& tree);
+
+  /**
+   * helper が main thread より深い反復を完了していればその結果を採用します。
+   * @return {helper の結果を採用した場合に true を返します。}
+   */
+  bool selectHelperResult(int completedDepth, Move& best, Value& value);
 
   /**
    * iterative deepening search from root node
@@ -307,9 +376,6 @@ private:
 
 public:
 
-  std::atomic<int> idleTreeCount_;
-  std::atomic<int> idleWorkerCount_;
-
   /**
    * コンストラクタ
    */
@@ -340,6 +406,17 @@ public:
     if (config_.workerSize != org.workerSize) {
       reallocateWorkers();
     }
+    if (config_.hashSizeMB != org.hashSizeMB) {
+      if (!tt_.setSizeMB(config_.hashSizeMB)) {
+        // 確保に失敗した場合は元のテーブルを使い続ける。
+        config_.hashSizeMB = org.hashSizeMB;
+      }
+    }
+    if (config_.evalCacheSizeMB != org.evalCacheSizeMB) {
+      if (!eval_.setCacheSizeMB(config_.evalCacheSizeMB)) {
+        config_.evalCacheSizeMB = org.evalCacheSizeMB;
+      }
+    }
   }
 
   /**
@@ -380,6 +457,14 @@ public:
     return isRunning_.load();
   }
 
+  /**
+   * 探索を開始したとき (isRunning が true になった直後) に呼び出す関数を設定します。
+   * 探索スレッド上で呼び出されます。
+   */
+  void setStartHandler(std::function<void()> handler) {
+    startHandler_ = std::move(handler);
+  }
+
   /**
    * 指定した局面に対して探索を実行します。
    * @return {負けたいか中断された場合にfalseを返します。}
@@ -417,23 +502,33 @@ public:
     history_.init();
   }
 
-  std::mutex& getSplitMutex() {
-    return splitMutex_;
+  void addIdleWorker(int wid) {
+    idleWorkers_.release(wid);
   }
 
-  void addIdleWorker() {
-    idleWorkerCount_.fetch_add(1);
-  }
-
-  void reduceIdleWorker() {
-    idleWorkerCount_.fetch_sub(1);
+  /**
+   * 空いている worker を使用中にします。
+   * @return {既に他の split point に確保されていた場合は false を返します。}
+   */
+  bool removeIdleWorker(int wid) {
+    return idleWorkers_.acquire(wid);
   }
 
   void releaseTree(int tid);
 
+  bool joinSplit(int wid);
+
+  uint32_t getSplitGeneration() const {
+    return splitGeneration_.load();
+  }
+
   void searchTlp(int tid) {
     auto& tree = trees_[tid];
-    searchTlp(tree);
+    if (config_.lazySmp) {
+      searchHelper(tree);
+    } else {
+      searchTlp(tree);
+    }
   }
 
   static int standardTreeSize(int workerSize) {
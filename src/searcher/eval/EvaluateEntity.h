@@ -8,23 +8,38 @@
 
 #include "Value.h"
 #include "core/def.h"
-#include <cassert>
+#include <atomic>
+#include <cstdint>
 
 namespace sunfish {
 
-template <int KeyLength>
+/**
+ * 評価値キャッシュのエントリ
+ * 位置評価値と KPP の先手・後手の値を格納します。
+ * ハッシュ値の上位 32 bit と KPP の値の XOR を位置評価値と同じ語に格納し、
+ * 読み出し時に照合することで排他制御なしで複数のスレッドから共有できるようにします。
+ * 書き込みが競合して壊れたエントリは照合に失敗し、ミスとして扱われます。
+ * 下位の bit はテーブルの添字で照合されます。
+ */
 class EvaluateEntity {
 private:
-  static CONSTEXPR_CONST int ValueInf = 1U << (KeyLength - 1);
-  static CONSTEXPR_CONST uint64_t ValueMask = (uint64_t)((1U << KeyLength) - 1U);
-  static CONSTEXPR_CONST uint64_t HashMask = ~ValueMask;
 
-  static_assert(ValueInf >= Value::Inf, "error");
+  /** KPP の値が無いことを表す値 */
+  static CONSTEXPR_CONST uint64_t NoKpp = 0x8000000080000000ull;
+
+  /** 上位 32 bit: 位置評価値, 下位 32 bit: 照合用の値 */
+  std::atomic<uint64_t> key_;
+  /** 上位 32 bit: 先手玉の KPP, 下位 32 bit: 後手玉の KPP */
+  std::atomic<uint64_t> kpp_;
 
-  uint64_t data_;
+  static uint32_t check(uint64_t hash, uint64_t kpp) {
+    return (uint32_t)(hash >> 32) ^ (uint32_t)kpp ^ (uint32_t)(kpp >> 32);
+  }
 
-  static int32_t convertValue(int32_t value) {
-    return ValueInf - value;
+  void store(uint64_t hash, const Value& positional, uint64_t kpp) {
+    uint64_t key = ((uint64_t)(uint32_t)positional.int32() << 32) | check(hash, kpp);
+    key_.store(key, std::memory_order_relaxed);
+    kpp_.store(kpp, std::memory_order_relaxed);
   }
 
 public:
@@ -34,31 +49,46 @@ public:
   }
 
   void init() {
-    data_ = 0ull;
+    key_.store(0ull, std::memory_order_relaxed);
+    kpp_.store(NoKpp, std::memory_order_relaxed);
   }
 
   void init(unsigned) {
     init();
   }
 
-  bool get(uint64_t hash, Value& value) const {
-    uint64_t temp = data_;
-    if ((temp & HashMask) == (hash & HashMask)) {
-      value = convertValue((int32_t)(temp & ValueMask));
-      assert(value > -ValueInf);
-      assert(value < ValueInf);
-      return true;
+  /**
+   * 位置評価値を取得します。
+   * kppValid が false の場合は kppBlack, kppWhite を変更しません。
+   */
+  bool get(uint64_t hash, Value& positional, Value& kppBlack, Value& kppWhite, bool& kppValid) const {
+    uint64_t kpp = kpp_.load(std::memory_order_relaxed);
+    uint64_t key = key_.load(std::memory_order_relaxed);
+    if ((uint32_t)key != check(hash, kpp)) {
+      return false;
+    }
+    positional = (int32_t)(uint32_t)(key >> 32);
+    kppValid = kpp != NoKpp;
+    if (kppValid) {
+      kppBlack = (int32_t)(uint32_t)(kpp >> 32);
+      kppWhite = (int32_t)(uint32_t)kpp;
     }
-    return false;
+    return true;
+  }
+
+  bool get(uint64_t hash, Value& positional) const {
+    Value kppBlack;
+    Value kppWhite;
+    bool kppValid;
+    return get(hash, positional, kppBlack, kppWhite, kppValid);
+  }
+
+  void set(uint64_t hash, const Value& positional, const Value& kppBlack, const Value& kppWhite) {
+    store(hash, positional, ((uint64_t)(uint32_t)kppBlack.int32() << 32) | (uint32_t)kppWhite.int32());
   }
 
-  void set(uint64_t hash, const Value& value) {
-    assert(value > -ValueInf);
-    assert(value < ValueInf);
-    uint32_t v = (uint32_t)convertValue(value.int32());
-    assert((v & ~ValueMask) == 0U);
-    uint64_t temp = (hash & HashMask) | v;
-    data_ = temp;
+  void set(uint64_t hash, const Value& positional) {
+    store(hash, positional, NoKpp);
   }
 };
 
@@ -12,12 +12,13 @@
 
 namespace sunfish {
 
-template <int KeyLength>
-class EvaluateTable : public HashTable<EvaluateEntity<KeyLength>> {
+class EvaluateTable : public HashTable<EvaluateEntity> {
 public:
-  using BaseType = HashTable<EvaluateEntity<KeyLength>>;
+  using BaseType = HashTable<EvaluateEntity>;
 
-  EvaluateTable() : BaseType(KeyLength) {
+  static CONSTEXPR_CONST uint32_t MinBits = 10;
+
+  EvaluateTable(uint32_t bits = BaseType::DefaultBits) : BaseType(bits) {
   }
   EvaluateTable(const EvaluateTable&) = delete;
   EvaluateTable(EvaluateTable&&) = delete;
@@ -26,9 +27,26 @@ public:
     return BaseType::getEntity(hash).get(hash, value);
   }
 
+  bool get(uint64_t hash, Value& positional, Value& kppBlack, Value& kppWhite, bool& kppValid) const {
+    return BaseType::getEntity(hash).get(hash, positional, kppBlack, kppWhite, kppValid);
+  }
+
   void set(uint64_t hash, const Value& value) {
     BaseType::getEntity(hash).set(hash, value);
   }
+
+  void set(uint64_t hash, const Value& positional, const Value& kppBlack, const Value& kppWhite) {
+    BaseType::getEntity(hash).set(hash, positional, kppBlack, kppWhite);
+  }
+
+  /**
+   * サイズを MBytes 単位で指定します。
+   * @return 確保に失敗した場合は false
+   */
+  bool setSizeMB(uint32_t mbytes) {
+    uint64_t bytes = (uint64_t)mbytes * 1024llu * 1024llu;
+    return BaseType::init(BaseType::bitsForBytes(bytes, MinBits), MinBits);
+  }
 };
 
 } // namespace sunfish
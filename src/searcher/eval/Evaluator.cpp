@@ -5,21 +5,32 @@
 
 #include "Evaluator.h"
 #include "core/util/Random.h"
+#include "core/avx2.h"
+#include "core/util/Memory.h"
 #include "logger/Logger.h"
 #include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
 
 #define DEFAULT_FV_FILENAME "eval.bin"
+#define COMPACT_FV_FILENAME "eval_q8.bin"
 #define FVBIN_FILENAME      "fv.bin"
 
-#define ENABLE_DIFF         1
-#define ENABLE_KPP          1
-#define ENABLE_HASHTABLE    1
-
 namespace {
 
 using namespace sunfish;
 
+/** パラメータファイルの識別子 */
+const char FileMagic[8] = { 'S', 'F', 'E', 'V', 'A', 'L', '\0', '\0' };
+
+/** 量子化したパラメータファイルの識別子 */
+const char CompactFileMagic[8] = { 'S', 'F', 'E', 'V', 'A', 'L', 'Q', '8' };
+
 const int8_t sqIndexBPawn[] = {
   -1,  0,  1,  2,  3,  4,  5,  6,  7,
   -1,  8,  9, 10, 11, 12, 13, 14, 15,
@@ -153,12 +164,33 @@ bool Feature<T>::readFile(const char* filename) {
     return false;
   }
 
+  FileHeader header;
+  file.read((char*)&header, sizeof(header));
+  bool hasHeader = file && memcmp(header.magic, FileMagic, sizeof(FileMagic)) == 0;
+  if (hasHeader) {
+    if (!checkHeader(header)) {
+      return false;
+    }
+    file.seekg(header.headerSize);
+  } else {
+    // ヘッダの無い古い形式
+    file.clear();
+    file.seekg(0);
+  }
+
   file.read((char*)t_->kpp, sizeof(t_->kpp));
   file.read((char*)t_->kkp, sizeof(t_->kkp));
 
+  if (!file) {
+    return false;
+  }
 
   file.close();
 
+  if (hasHeader && checksum(*t_) != header.checksum) {
+    return false;
+  }
+
   return true;
 }
 
@@ -168,20 +200,129 @@ bool Feature<T>::readFile(const char* filename) {
  */
 template <class T>
 bool Feature<T>::writeFile(const char* filename) const {
-  std::ofstream file(filename, std::ios::binary | std::ios::out);
+  // マップ中のファイルを切り詰めないように別名で書き出してから置き換える。
+  std::string tmpname = std::string(filename) + ".tmp";
+  std::ofstream file(tmpname, std::ios::binary | std::ios::out);
 
   if (!file) {
     return false;
   }
 
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FileMagic, sizeof(FileMagic));
+  header.version = FileVersion;
+  header.headerSize = sizeof(FileHeader);
+  header.valueSize = sizeof(ValueType);
+  header.tableSize = sizeof(Table);
+  header.checksum = checksum(*t_);
+
+  file.write((const char*)&header, sizeof(header));
   file.write((const char*)t_->kpp, sizeof(t_->kpp));
   file.write((const char*)t_->kkp, sizeof(t_->kkp));
 
   file.close();
 
+  if (!file) {
+    std::remove(tmpname.c_str());
+    return false;
+  }
+
+  if (std::rename(tmpname.c_str(), filename) != 0) {
+    std::remove(filename);
+    if (std::rename(tmpname.c_str(), filename) != 0) {
+      return false;
+    }
+  }
+
   return true;
 }
 
+/**
+ * ファイルをメモリにマップしてパラメータとして使用します。
+ * @param filename
+ * @param verify
+ */
+template <class T>
+bool Feature<T>::mapFile(const char* filename, bool verify) {
+  size_t size;
+  void* ptr = memory::mapFile(filename, size);
+
+  if (ptr == nullptr) {
+    return false;
+  }
+
+  const FileHeader* header = nullptr;
+  size_t offset = 0;
+  if (size >= sizeof(FileHeader) &&
+      memcmp(static_cast<const FileHeader*>(ptr)->magic, FileMagic, sizeof(FileMagic)) == 0) {
+    header = static_cast<const FileHeader*>(ptr);
+    offset = header->headerSize;
+  }
+
+  Table* table = reinterpret_cast<Table*>(static_cast<char*>(ptr) + offset);
+
+  if ((header != nullptr && !checkHeader(*header)) ||
+      size != offset + sizeof(Table) ||
+      (header != nullptr && verify && checksum(*table) != header->checksum)) {
+    memory::unmapFile(ptr, size);
+    return false;
+  }
+
+  release();
+  t_ = table;
+  mapped_ = ptr;
+  mappedSize_ = size;
+
+  return true;
+}
+
+template <class T>
+bool Feature<T>::checkHeader(const FileHeader& header) {
+  return header.version == FileVersion &&
+         header.headerSize >= sizeof(FileHeader) &&
+         header.headerSize % sizeof(uint64_t) == 0 &&
+         header.valueSize == sizeof(ValueType) &&
+         header.tableSize == sizeof(Table);
+}
+
+template <class T>
+void Feature<T>::release() {
+  if (mapped_ != nullptr) {
+    memory::unmapFile(mapped_, mappedSize_);
+    mapped_ = nullptr;
+    mappedSize_ = 0;
+    t_ = nullptr;
+  } else if (allocated && t_ != nullptr) {
+    delete t_;
+    t_ = nullptr;
+  }
+  allocated = false;
+}
+
+/**
+ * パラメータのチェックサムを計算します。
+ * 8 バイト単位の FNV-1a です。
+ */
+template <class T>
+uint64_t Feature<T>::checksum(const Table& table) {
+  CONSTEXPR_CONST uint64_t Offset = 0xcbf29ce484222325llu;
+  CONSTEXPR_CONST uint64_t Prime = 0x00000100000001b3llu;
+
+  const char* p = reinterpret_cast<const char*>(&table);
+  size_t words = sizeof(Table) / sizeof(uint64_t);
+  uint64_t hash = Offset;
+  for (size_t i = 0; i < words; i++) {
+    uint64_t w;
+    memcpy(&w, p + i * sizeof(uint64_t), sizeof(w));
+    hash = (hash ^ w) * Prime;
+  }
+  for (size_t i = words * sizeof(uint64_t); i < sizeof(Table); i++) {
+    hash = (hash ^ (uint8_t)p[i]) * Prime;
+  }
+  return hash;
+}
+
 /**
  * KPP のインデクスを左右反転します。
  */
@@ -419,9 +560,291 @@ int kppHandIndex(Piece piece) {
 template int kppHandIndex<true>(Piece piece);
 template int kppHandIndex<false>(Piece piece);
 
+namespace {
+
+/**
+ * 盤上の駒に対応する KPP/KKP のインデクス
+ */
+struct BoardIndex {
+  int16_t kppB; // 先手玉から見た KPP のインデクス
+  int16_t kppW; // 後手玉から見た KPP のインデクス
+  int16_t kkp;  // KKP のインデクス (後手の駒は盤面を反転)
+};
+
+/**
+ * 駒と升目から BoardIndex を引くテーブル
+ */
+class BoardIndexTable {
+private:
+  BoardIndex table_[Piece::Num][Square::N];
+public:
+  BoardIndexTable() {
+    PIECE_EACH(piece) {
+      if (piece.kindOnly() == Piece::King) {
+        continue;
+      }
+      SQUARE_EACH(sq) {
+        auto& index = table_[piece.index()][sq.index()];
+        if (piece.isBlack()) {
+          index.kppB = kppBoardIndex<true>(piece, sq);
+          index.kppW = kppBoardIndex<false>(piece, sq.reverse());
+          index.kkp = kkpBoardIndex(piece, sq);
+        } else {
+          index.kppB = kppBoardIndex<false>(piece, sq);
+          index.kppW = kppBoardIndex<true>(piece, sq.reverse());
+          index.kkp = kkpBoardIndex(piece, sq.reverse());
+        }
+      }
+    }
+  }
+  const BoardIndex& get(const Piece& piece, const Square& sq) const {
+    return table_[piece.index()][sq.index()];
+  }
+};
+
+const BoardIndexTable boardIndexTable;
+
+bool simdEnabled = isAvx2Supported();
+
+bool compactEnabled = false;
+
+#if USE_AVX2
+/**
+ * list の全ての組 (j <= i) について KPP の値を合計します。
+ * 三角行列のインデクスを 8 要素ずつ計算し、vpgatherdd で 32bit 単位に読んでから
+ * 下位の K のビット幅を符号拡張します。
+ */
+template <class K>
+AVX2_TARGET
+int32_t sumKppAvx2(const K* kpp, const int* list, int num) {
+  CONSTEXPR_CONST int Shift = 32 - 8 * sizeof(K);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i sum = _mm256_setzero_si256();
+
+  for (int i = 0; i < num; i++) {
+    __m256i x = _mm256_set1_epi32(list[i]);
+    for (int j = 0; j <= i; j += 8) {
+      // 範囲外の要素を読まないようにマスクする
+      __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(i + 1 - j), lane);
+      __m256i y = _mm256_maskload_epi32(&list[j], mask);
+      __m256i hi = _mm256_max_epi32(x, y);
+      __m256i lo = _mm256_min_epi32(x, y);
+      __m256i index = _mm256_add_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(hi, _mm256_add_epi32(hi, one)), 1), lo);
+      __m256i v = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)kpp, index, mask, sizeof(K));
+      sum = _mm256_add_epi32(sum, _mm256_srai_epi32(_mm256_slli_epi32(v, Shift), Shift));
+    }
+  }
+
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+#endif
+
+/**
+ * SIMD 命令で KPP を合計します。
+ * @return {SIMD 命令が使えない場合は false を返します。}
+ */
+template <class T, class U>
+bool sumKppSimd(const T*, const int*, int, U&) {
+  return false;
+}
+
+template <class K>
+bool sumKppSimdImpl(const K* kpp, const int* list, int num, int32_t& sum) {
+#if USE_AVX2
+  if (simdEnabled) {
+    sum = sumKppAvx2(kpp, list, num);
+    return true;
+  }
+#else
+  (void)kpp; (void)list; (void)num; (void)sum;
+#endif
+  return false;
+}
+
+bool sumKppSimd(const int16_t* kpp, const int* list, int num, int32_t& sum) {
+  return sumKppSimdImpl(kpp, list, num, sum);
+}
+
+bool sumKppSimd(const int8_t* kpp, const int* list, int num, int32_t& sum) {
+  return sumKppSimdImpl(kpp, list, num, sum);
+}
+
+/**
+ * list の全ての組 (j <= i) について KPP の値を合計します。
+ */
+template <class T, class U = int32_t>
+U sumKpp(const T* kpp, const int* list, int num) {
+  U sum = 0;
+  if (sumKppSimd(kpp, list, num, sum)) {
+    return sum;
+  }
+  for (int i = 0; i < num; i++) {
+    int x = list[i];
+    for (int j = 0; j <= i; j++) {
+      sum += kpp[kpp_index_safe(x, list[j])];
+    }
+  }
+  return sum;
+}
+
+/**
+ * 一括評価で使用する局面ごとの作業領域
+ */
+struct BatchEntry {
+  int bList[52]; // 52 = 40(総駒数) - 2(玉) + 14(駒台)
+  int wList[52];
+  int num;
+  int bking;
+  int wkingR;
+  int32_t kkp;
+  int32_t kppBlack;
+  int32_t kppWhite;
+};
+
+CONSTEXPR_CONST int BatchLanes = 8;
+
+#if USE_AVX2
+/**
+ * 同じ玉の位置を持つ最大 8 局面の KPP をまとめて合計します。
+ * 局面ごとに 1 レーンを割り当て、全ての局面で同じ (i, j) の組を同時に読みます。
+ * @param lists 各局面の KPP インデクスの一覧
+ * @param nums 各局面の要素数 (使用しないレーンは 0)
+ * @param sums 各局面の合計を受け取ります。
+ */
+template <class K>
+AVX2_TARGET
+void sumKppBatchAvx2(const K* kpp, const int* const* lists, const int* nums, int32_t* sums) {
+  CONSTEXPR_CONST int Shift = 32 - 8 * sizeof(K);
+  const __m256i one = _mm256_set1_epi32(1);
+  alignas(32) int listT[52][BatchLanes];
+
+  int maxNum = 0;
+  for (int lane = 0; lane < BatchLanes; lane++) {
+    maxNum = std::max(maxNum, nums[lane]);
+  }
+  for (int i = 0; i < maxNum; i++) {
+    for (int lane = 0; lane < BatchLanes; lane++) {
+      listT[i][lane] = i < nums[lane] ? lists[lane][i] : 0;
+    }
+  }
+
+  const __m256i numv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(nums));
+  __m256i sum = _mm256_setzero_si256();
+
+  for (int i = 0; i < maxNum; i++) {
+    __m256i mask = _mm256_cmpgt_epi32(numv, _mm256_set1_epi32(i));
+    __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i*>(listT[i]));
+    for (int j = 0; j <= i; j++) {
+      __m256i y = _mm256_load_si256(reinterpret_cast<const __m256i*>(listT[j]));
+      __m256i hi = _mm256_max_epi32(x, y);
+      __m256i lo = _mm256_min_epi32(x, y);
+      __m256i index = _mm256_add_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(hi, _mm256_add_epi32(hi, one)), 1), lo);
+      __m256i v = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)kpp, index, mask, sizeof(K));
+      sum = _mm256_add_epi32(sum, _mm256_srai_epi32(_mm256_slli_epi32(v, Shift), Shift));
+    }
+  }
+
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), sum);
+}
+#endif
+
+/**
+ * 同じ玉の位置を持つ最大 8 局面の KPP をまとめて合計します。
+ */
+template <class K>
+void sumKppBatch(const K* kpp, const int* const* lists, const int* nums, int32_t* sums) {
+#if USE_AVX2
+  if (simdEnabled) {
+    sumKppBatchAvx2(kpp, lists, nums, sums);
+    return;
+  }
+#endif
+  for (int lane = 0; lane < BatchLanes; lane++) {
+    sums[lane] = nums[lane] != 0 ? sumKpp(kpp, lists[lane], nums[lane]) : 0;
+  }
+}
+
+/**
+ * 駒を取られた側の玉に関する KPP の変化値を算出します。
+ * @param list 着手後の局面の KPP インデクス
+ * @param captured 取られた駒のインデクス
+ * @param hand 取った駒の着手後の駒台のインデクス (着手前は hand-1)
+ */
+template <class K>
+int32_t kppCaptureDiff(const K* kpp, const int* list, int num, int captured, int hand) {
+  int32_t diff = 0;
+  for (int i = 0; i < num; i++) {
+    int x = list[i];
+    diff += kpp[kpp_index_safe(x, hand)];
+    diff -= kpp[kpp_index_safe(x, hand-1)];
+    diff -= kpp[kpp_index_safe(x, captured)];
+  }
+  diff += kpp[kpp_index(hand, hand-1)];
+  diff += kpp[kpp_index_safe(hand, captured)];
+  diff -= kpp[kpp_index(hand-1, hand-1)];
+  diff -= kpp[kpp_index(captured, captured)];
+  diff -= kpp[kpp_index_safe(hand-1, captured)];
+  return diff;
+}
+
+/**
+ * 局面の KPP インデクスの一覧を作成します。
+ * @return 要素数
+ */
+int makeKppList(const Board& board, int* bList, int* wList) {
+  int num = 14;
+
+#define ON_HAND(piece, pieceL, index) { \
+  int count = board.getBlackHand(Piece::piece); \
+  bList[index] = KPP_HB ## pieceL + count; \
+  wList[index+1] = KPP_HW ## pieceL + count; \
+  count = board.getWhiteHand(Piece::piece); \
+  bList[index+1] = KPP_HW ## pieceL + count; \
+  wList[index] = KPP_HB ## pieceL + count; \
+}
+
+  ON_HAND(Pawn, PAWN, 0);
+  ON_HAND(Lance, LANCE, 2);
+  ON_HAND(Knight, KNIGHT, 4);
+  ON_HAND(Silver, SILVER, 6);
+  ON_HAND(Gold, GOLD, 8);
+  ON_HAND(Bishop, BISHOP, 10);
+  ON_HAND(Rook, ROOK, 12);
+
+#undef ON_HAND
+
+  // 盤上の駒
+  for (int i = 0; i < board.getPieceListSize(); i++) {
+    auto sq = board.getPieceListSquare(i);
+    const auto& index = boardIndexTable.get(board.getBoardPiece(sq), sq);
+    bList[num] = index.kppB;
+    wList[num] = index.kppW;
+    num++;
+  }
+
+  return num;
+}
+
+/**
+ * KPP の値を元のスケールに戻すための倍率を返します。
+ */
+inline int32_t kppScale(const Evaluator::Table&, int) {
+  return 1;
+}
+
+inline int32_t kppScale(const CompactTable& table, int king) {
+  return 1 << table.shift[king];
+}
+
+} // namespace
+
 template <class T>
 template <class U, bool update>
-U Feature<T>::extract(const Board& board, U delta) {
+U Feature<T>::extract(const Board& board, U delta, U* kppBlack, U* kppWhite) {
   U positional = 0;
   auto bking = board.getBKingSquare();
   auto wking = board.getWKingSquare();
@@ -431,8 +854,6 @@ U Feature<T>::extract(const Board& board, U delta) {
   int num = 14;
   int bList[52]; // 52 = 40(総駒数) - 2(玉) + 14(駒台)
   int wList[52];
-  int nTemp;
-  int wTemp[34]; // 34 = 18(と金) + 16(成香, 成桂, 成銀, 金)
 
 #define ON_HAND(piece, pieceL, i) { \
   int count = board.getBlackHand(Piece::piece); \
@@ -463,74 +884,118 @@ U Feature<T>::extract(const Board& board, U delta) {
 
 #undef ON_HAND
 
-#define ON_BOARD(blackBB, whiteBB, pieceL, SQ_INDEX_B, SQ_INDEX_W) { \
-  nTemp = 0; \
-  auto bb = (blackBB); \
-  BB_EACH_OPE(sq, bb, { \
-    if (update) { \
-      t_->kkp[bking.index()][wking.index()][KKP_B ## pieceL+SQ_INDEX_B(sq)] += ValueType(delta); \
-    } else { \
-      positional += t_->kkp[bking.index()][wking.index()][KKP_B ## pieceL+SQ_INDEX_B(sq)]; \
-    } \
-    bList[num++] = KPP_BB ## pieceL + SQ_INDEX_B(sq); \
-    wTemp[nTemp++] = KPP_BW ## pieceL + SQ_INDEX_W(sq.reverse()); \
-  }); \
-  bb = (whiteBB); \
-  BB_EACH_OPE(sq, bb, { \
-    if (update) { \
-      t_->kkp[wkingR.index()][bkingR.index()][KKP_B ## pieceL+SQ_INDEX_B(sq.reverse())] -= ValueType(delta); \
-    } else { \
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][KKP_B ## pieceL+SQ_INDEX_B(sq.reverse())]; \
-    } \
-    bList[num++] = KPP_BW ## pieceL + SQ_INDEX_W(sq); \
-    wTemp[nTemp++] = KPP_BB ## pieceL + SQ_INDEX_B(sq.reverse()); \
-  }); \
-  for (int i = 0; i < nTemp; i++) { wList[num-i-1] = wTemp[i]; } \
-}
-
-  ON_BOARD(board.getBPawn(), board.getWPawn(), PAWN, SQ_INDEX_BPAWN, SQ_INDEX_WPAWN);
-  ON_BOARD(board.getBLance(),board.getWLance(), LANCE, SQ_INDEX_BPAWN, SQ_INDEX_WPAWN);
-  ON_BOARD(board.getBKnight(), board.getWKnight(), KNIGHT, SQ_INDEX_BKNIGHT, SQ_INDEX_WKNIGHT);
-  ON_BOARD(board.getBSilver(), board.getWSilver(), SILVER, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBGold() | board.getBTokin() | board.getBProLance() | board.getBProKnight() | board.getBProSilver(),
-           board.getWGold() | board.getWTokin() | board.getWProLance() | board.getWProKnight() | board.getWProSilver(), GOLD,
-           SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBBishop(), board.getWBishop(), BISHOP, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBHorse(), board.getWHorse(), HORSE, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBRook(), board.getWRook(), ROOK, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBDragon(), board.getWDragon(), DRAGON, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-
-#undef ON_BOARD
-
-#if ENABLE_KPP
-  for (int i = 0; i < num; i++) {
-    int bx = bList[i];
-    int wx = wList[i];
-    for (int j = 0; j <= i; j++) {
-      int by = bList[j];
-      int wy = wList[j];
-      assert(by <= bx);
-      assert(wy <= wx);
+  // 盤上の駒
+  for (int i = 0; i < board.getPieceListSize(); i++) {
+    auto sq = board.getPieceListSquare(i);
+    auto piece = board.getBoardPiece(sq);
+    const auto& index = boardIndexTable.get(piece, sq);
+    if (piece.isBlack()) {
       if (update) {
-        t_->kpp[bking.index()][kpp_index(bx, by)] += ValueType(delta);
-        t_->kpp[wkingR.index()][kpp_index(wx, wy)] -= ValueType(delta);
+        t_->kkp[bking.index()][wking.index()][index.kkp] += ValueType(delta);
       } else {
-        positional += t_->kpp[bking.index()][kpp_index(bx, by)];
-        positional -= t_->kpp[wkingR.index()][kpp_index(wx, wy)];
+        positional += t_->kkp[bking.index()][wking.index()][index.kkp];
+      }
+    } else {
+      if (update) {
+        t_->kkp[wkingR.index()][bkingR.index()][index.kkp] -= ValueType(delta);
+      } else {
+        positional -= t_->kkp[wkingR.index()][bkingR.index()][index.kkp];
       }
     }
+    bList[num] = index.kppB;
+    wList[num] = index.kppW;
+    num++;
+  }
+
+  U black = 0;
+  U white = 0;
+
+  if (update) {
+    for (int i = 0; i < num; i++) {
+      int bx = bList[i];
+      int wx = wList[i];
+      for (int j = 0; j <= i; j++) {
+        t_->kpp[bking.index()][kpp_index_safe(bx, bList[j])] += ValueType(delta);
+        t_->kpp[wkingR.index()][kpp_index_safe(wx, wList[j])] -= ValueType(delta);
+      }
+    }
+  } else {
+    black = sumKpp<T, U>(t_->kpp[bking.index()], bList, num);
+    white = sumKpp<T, U>(t_->kpp[wkingR.index()], wList, num);
+    positional += black - white;
+  }
+
+  if (kppBlack != nullptr) {
+    *kppBlack = black;
+  }
+  if (kppWhite != nullptr) {
+    *kppWhite = white;
   }
-#endif // ENABLE_KPP
 
   return positional;
 }
 
-template int32_t Feature<float>::extract<int32_t, false>(const Board& board, int32_t delta);
-template float Feature<float>::extract<float, true>(const Board& board, float delta);
+template int32_t Feature<float>::extract<int32_t, false>(const Board& board, int32_t delta, int32_t*, int32_t*);
+template float Feature<float>::extract<float, true>(const Board& board, float delta, float*, float*);
+
+/**
+ * KPP の加算に SIMD 命令を使うかどうかを設定します。
+ * CPU が対応していない場合は常に無効になります。
+ */
+void Evaluator::setSimdEnabled(bool enabled) {
+  simdEnabled = enabled && isAvx2Supported();
+}
+
+bool Evaluator::isSimdEnabled() {
+  return simdEnabled;
+}
+
+void Evaluator::setCompactEnabled(bool enabled) {
+  compactEnabled = enabled;
+}
+
+bool Evaluator::isCompactEnabled() {
+  return compactEnabled;
+}
+
+EvaluatorVariant Evaluator::variant_ = EvaluatorVariant::Default;
 
-Evaluator::Evaluator(InitType initType /*= InitType::File*/) {
+const char* Evaluator::getVariantName(EvaluatorVariant variant) {
+  switch (variant) {
+  case EvaluatorVariant::Default    : return "default";
+  case EvaluatorVariant::NoHashTable: return "nohash";
+  case EvaluatorVariant::NoDiff     : return "nodiff";
+  case EvaluatorVariant::NoKpp      : return "nokpp";
+  default                           : return "";
+  }
+}
+
+bool Evaluator::parseVariant(const std::string& name, EvaluatorVariant& variant) {
+  for (int i = 0; i < static_cast<int>(EvaluatorVariant::Num); i++) {
+    auto v = static_cast<EvaluatorVariant>(i);
+    if (name == getVariantName(v)) {
+      variant = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+Evaluator::Evaluator(InitType initType /*= InitType::File*/)
+: Feature<int16_t>(initType != InitType::File)
+, evaluateCache_(std::make_shared<EvaluateTable>()) {
   switch (initType) {
   case InitType::File:
+    if (compactEnabled) {
+      if (readCompactFile()) {
+        break;
+      }
+      Loggers::warning << "could not read " COMPACT_FV_FILENAME;
+    }
+    if (mapFile()) {
+      break;
+    }
+    allocate();
     init();
     if (!readFile()) {
       if (convertFromFvBin()) {
@@ -553,7 +1018,11 @@ Evaluator::Evaluator(InitType initType /*= InitType::File*/) {
   }
 }
 
-Evaluator::Evaluator(Evaluator& ref) : Feature<int16_t>(ref) {
+Evaluator::Evaluator(Evaluator& ref)
+: Feature<int16_t>(ref)
+, evaluateCache_(ref.evaluateCache_)
+, compact_(ref.compact_) {
+  assert(t_ != nullptr || compact_ != nullptr);
 }
 
 void Evaluator::init() {
@@ -585,6 +1054,121 @@ bool Evaluator::writeFile() const {
   return Feature<ValueType>::writeFile(DEFAULT_FV_FILENAME);
 }
 
+/**
+ * ファイルをメモリにマップしてパラメータとして使用します。
+ */
+bool Evaluator::mapFile() {
+  return Feature<ValueType>::mapFile(DEFAULT_FV_FILENAME);
+}
+
+/**
+ * パラメータを量子化してファイルに書き出します。
+ * KPP は玉の位置ごとに値が int8_t に収まる最小のシフト量を選び、丸めて格納します。
+ * @param filename
+ */
+bool Evaluator::writeCompactFile(const char* filename) const {
+  std::unique_ptr<CompactTable> compact(new CompactTable());
+
+  for (int king = 0; king < 81; king++) {
+    const auto* kpp = t_->kpp[king];
+    int32_t maxAbs = 0;
+    for (int i = 0; i < KPP_SIZE; i++) {
+      maxAbs = std::max(maxAbs, (int32_t)std::abs((int32_t)kpp[i]));
+    }
+    int shift = 0;
+    while (((maxAbs + ((1 << shift) >> 1)) >> shift) > INT8_MAX) {
+      shift++;
+    }
+    compact->shift[king] = (uint8_t)shift;
+    for (int i = 0; i < KPP_SIZE; i++) {
+      int32_t v = kpp[i];
+      int32_t half = (1 << shift) >> 1;
+      int32_t q = v >= 0 ? (v + half) >> shift : -((-v + half) >> shift);
+      compact->kpp[king][i] = (int8_t)std::max(std::min(q, (int32_t)INT8_MAX), -(int32_t)INT8_MAX);
+    }
+  }
+  memcpy(compact->kkp, t_->kkp, sizeof(compact->kkp));
+
+  std::string tmpname = std::string(filename) + ".tmp";
+  std::ofstream file(tmpname, std::ios::binary | std::ios::out);
+
+  if (!file) {
+    return false;
+  }
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CompactFileMagic, sizeof(CompactFileMagic));
+  header.version = FileVersion;
+  header.headerSize = sizeof(FileHeader);
+  header.valueSize = sizeof(int8_t);
+  header.tableSize = sizeof(CompactTable);
+
+  file.write((const char*)&header, sizeof(header));
+  file.write((const char*)compact.get(), sizeof(CompactTable));
+
+  file.close();
+
+  if (!file) {
+    std::remove(tmpname.c_str());
+    return false;
+  }
+
+  if (std::rename(tmpname.c_str(), filename) != 0) {
+    std::remove(filename);
+    if (std::rename(tmpname.c_str(), filename) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * パラメータを量子化して eval_q8.bin に書き出します。
+ */
+bool Evaluator::writeCompactFile() const {
+  return writeCompactFile(COMPACT_FV_FILENAME);
+}
+
+/**
+ * 量子化したパラメータをファイルから読み込んで使用します。
+ * @param filename
+ */
+bool Evaluator::readCompactFile(const char* filename) {
+  size_t size;
+  void* ptr = memory::mapFile(filename, size);
+
+  if (ptr == nullptr) {
+    return false;
+  }
+
+  const auto* header = static_cast<const FileHeader*>(ptr);
+  if (size < sizeof(FileHeader) ||
+      memcmp(header->magic, CompactFileMagic, sizeof(CompactFileMagic)) != 0 ||
+      header->version != FileVersion ||
+      header->valueSize != sizeof(int8_t) ||
+      header->tableSize != sizeof(CompactTable) ||
+      size != header->headerSize + sizeof(CompactTable)) {
+    memory::unmapFile(ptr, size);
+    return false;
+  }
+
+  const auto* table = reinterpret_cast<const CompactTable*>(static_cast<const char*>(ptr) + header->headerSize);
+  compact_ = std::shared_ptr<const CompactTable>(table, [ptr, size](const CompactTable*) {
+    memory::unmapFile(ptr, size);
+  });
+
+  return true;
+}
+
+/**
+ * 量子化したパラメータを eval_q8.bin から読み込んで使用します。
+ */
+bool Evaluator::readCompactFile() {
+  return readCompactFile(COMPACT_FV_FILENAME);
+}
+
 /**
  * fv.bin があれば読み込んで並べ替えを行います。
  */
@@ -737,25 +1321,318 @@ Value Evaluator::evaluateMaterial_(const Board& board) const {
 /**
  * 局面の評価値を算出します。
  * @param board
+ * @param material
  */
-Value Evaluator::evaluate_(const Board& board) {
-  Value positional = extract<int32_t, false>(board, 0);
+template <>
+const Evaluator::Table& Evaluator::getTable_<Evaluator::Table>() const {
+  return *t_;
+}
 
-#if ENABLE_HASHTABLE
-  evaluateCache_.set(board.getNoTurnHash(), positional);
-#endif
+template <>
+const CompactTable& Evaluator::getTable_<CompactTable>() const {
+  return *compact_;
+}
 
-  return positional;
+template <class Tbl, class P>
+ValuePair Evaluator::evaluate_(const Board& board, const Value& material) {
+  const auto& tbl = getTable_<Tbl>();
+  auto bking = board.getBKingSquare();
+  auto wkingR = board.getWKingSquare().reverse();
+
+  int bList[52]; // 52 = 40(総駒数) - 2(玉) + 14(駒台)
+  int wList[52];
+  int num = makeKppList(board, bList, wList);
+
+  int32_t kppBlack = 0;
+  int32_t kppWhite = 0;
+  if (P::Kpp) {
+    kppBlack = sumKpp(tbl.kpp[bking.index()], bList, num) * kppScale(tbl, bking.index());
+    kppWhite = sumKpp(tbl.kpp[wkingR.index()], wList, num) * kppScale(tbl, wkingR.index());
+  }
+
+  Value positional = evaluateKkp_<Tbl>(board) + kppBlack - kppWhite;
+
+  if (P::HashTable) {
+    evaluateCache_->set(board.getNoTurnHash(), positional, kppBlack, kppWhite);
+  }
+
+  return ValuePair(material, positional, kppBlack, kppWhite);
+}
+#define INSTANTIATE__(Tbl, P) \
+template ValuePair Evaluator::evaluate_<Tbl, P>(const Board&, const Value&);
+EVALUATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
+
+/**
+ * 複数の局面の評価値をまとめて算出します。
+ * 同じ玉の位置を持つ局面を連続して処理することで kpp[king] の行をキャッシュに載せたまま使い、
+ * 最大 8 局面ずつ SIMD で並列に合計します。
+ * @param boards
+ * @param num
+ * @param results
+ */
+template <class Tbl, class P>
+void Evaluator::evaluateBatch_(const Board* boards, size_t num, ValuePair* results) {
+  const auto& tbl = getTable_<Tbl>();
+  std::vector<BatchEntry> entries(num);
+
+  for (size_t i = 0; i < num; i++) {
+    const auto& board = boards[i];
+    auto& entry = entries[i];
+    entry.num = makeKppList(board, entry.bList, entry.wList);
+    entry.bking = board.getBKingSquare().index();
+    entry.wkingR = board.getWKingSquare().reverse().index();
+    entry.kkp = evaluateKkp_<Tbl>(board).int32();
+    entry.kppBlack = 0;
+    entry.kppWhite = 0;
+  }
+
+  if (P::Kpp) {
+    std::vector<uint32_t> order(num);
+    for (bool black : { true, false }) {
+      auto kingOf = [black](const BatchEntry& entry) {
+        return black ? entry.bking : entry.wkingR;
+      };
+
+      // 玉の位置ごとに局面を並べ替える (計数ソート)
+      uint32_t offsets[Square::N + 1] = { 0 };
+      for (size_t i = 0; i < num; i++) {
+        offsets[kingOf(entries[i]) + 1]++;
+      }
+      for (int sq = 0; sq < Square::N; sq++) {
+        offsets[sq + 1] += offsets[sq];
+      }
+      for (size_t i = 0; i < num; i++) {
+        order[offsets[kingOf(entries[i])]++] = static_cast<uint32_t>(i);
+      }
+
+      // 同じ玉の位置を持つ局面を最大 8 局面ずつ合計する
+      size_t begin = 0;
+      while (begin < num) {
+        int king = kingOf(entries[order[begin]]);
+        size_t end = begin + 1;
+        while (end < num && end - begin < BatchLanes && kingOf(entries[order[end]]) == king) {
+          end++;
+        }
+
+        const int* lists[BatchLanes];
+        int nums[BatchLanes];
+        int32_t sums[BatchLanes];
+        for (size_t lane = 0; lane < BatchLanes; lane++) {
+          if (begin + lane < end) {
+            const auto& entry = entries[order[begin + lane]];
+            lists[lane] = black ? entry.bList : entry.wList;
+            nums[lane] = entry.num;
+          } else {
+            lists[lane] = nullptr;
+            nums[lane] = 0;
+          }
+        }
+
+        sumKppBatch(tbl.kpp[king], lists, nums, sums);
+
+        int32_t scale = kppScale(tbl, king);
+        for (size_t lane = 0; begin + lane < end; lane++) {
+          auto& entry = entries[order[begin + lane]];
+          (black ? entry.kppBlack : entry.kppWhite) = sums[lane] * scale;
+        }
+
+        begin = end;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    const auto& board = boards[i];
+    const auto& entry = entries[i];
+    Value positional = entry.kkp + entry.kppBlack - entry.kppWhite;
+
+    if (P::HashTable) {
+      evaluateCache_->set(board.getNoTurnHash(), positional, entry.kppBlack, entry.kppWhite);
+    }
+
+    results[i] = ValuePair(evaluateMaterial_(board), positional, entry.kppBlack, entry.kppWhite);
+  }
+}
+#define INSTANTIATE__(Tbl, P) \
+template void Evaluator::evaluateBatch_<Tbl, P>(const Board*, size_t, ValuePair*);
+EVALUATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
+
+/**
+ * 着手後の評価で参照する評価値キャッシュと KPP の行をプリフェッチします。
+ * 玉が動いた場合は移動先の玉の行の先頭を, それ以外は移動先の駒の行の先頭を読み込みます。
+ * @param board 着手前の局面を指定します。
+ * @param move
+ */
+template <class Tbl, class P>
+void Evaluator::prefetch_(const Board& board, const Move& move) const {
+  if (P::HashTable) {
+    prefetch(board.getNoTurnHashAfter(move));
+  }
+
+  if (!P::Kpp || !P::Diff) {
+    return;
+  }
+
+  CONSTEXPR_CONST size_t KppPrefetchSize = 256;
+  const auto& tbl = getTable_<Tbl>();
+  bool black = board.isBlack();
+  auto piece = move.piece();
+  auto to = move.to();
+
+  if (piece == Piece::King) {
+    int king = black ? to.index() : to.reverse().index();
+    memory::prefetch<KppPrefetchSize>(reinterpret_cast<const char*>(tbl.kpp[king]));
+    return;
+  }
+
+  if (move.promote()) {
+    piece = piece.promote();
+  }
+  const auto& index = boardIndexTable.get(black ? piece.black() : piece.white(), to);
+  int bking = board.getBKingSquare().index();
+  int wkingR = board.getWKingSquare().reverse().index();
+  const auto* bkpp = &tbl.kpp[bking][index.kppB * (index.kppB + 1) / 2];
+  const auto* wkpp = &tbl.kpp[wkingR][index.kppW * (index.kppW + 1) / 2];
+  memory::prefetch<KppPrefetchSize>(reinterpret_cast<const char*>(bkpp));
+  memory::prefetch<KppPrefetchSize>(reinterpret_cast<const char*>(wkpp));
+}
+#define INSTANTIATE__(Tbl, P) \
+template void Evaluator::prefetch_<Tbl, P>(const Board&, const Move&) const;
+EVALUATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
+
+/**
+ * 複数の局面の評価値をまとめて算出します。
+ * @param boards
+ * @param num
+ * @param results
+ */
+void Evaluator::evaluateBatch(const Board* boards, size_t num, ValuePair* results) {
+  EVALUATOR_DISPATCH__(evaluateBatch_, (boards, num, results));
+}
+
+/**
+ * 複数の局面の評価値をまとめて算出します。
+ * @param boards
+ * @param num
+ * @param results
+ */
+void Evaluator::evaluateBatch(const CompactBoard* boards, size_t num, ValuePair* results) {
+  std::vector<Board> tmp;
+  tmp.reserve(num);
+  for (size_t i = 0; i < num; i++) {
+    tmp.emplace_back(boards[i]);
+  }
+  evaluateBatch(tmp.data(), num, results);
+}
+
+/**
+ * 局面の KKP の合計を算出します。
+ * @param board
+ */
+template <class Tbl>
+Value Evaluator::evaluateKkp_(const Board& board) const {
+  const auto& tbl = getTable_<Tbl>();
+  auto bking = board.getBKingSquare();
+  auto wking = board.getWKingSquare();
+  const auto* bkkp = tbl.kkp[bking.index()][wking.index()];
+  const auto* wkkp = tbl.kkp[wking.reverse().index()][bking.reverse().index()];
+  int32_t kkp = 0;
+
+  HAND_EACH(piece) {
+    kkp += bkkp[kkpHandIndex(piece) + board.getBlackHand(piece)];
+    kkp -= wkkp[kkpHandIndex(piece) + board.getWhiteHand(piece)];
+  }
+
+  for (int i = 0; i < board.getPieceListSize(); i++) {
+    auto sq = board.getPieceListSquare(i);
+    auto piece = board.getBoardPiece(sq);
+    const auto& index = boardIndexTable.get(piece, sq);
+    if (piece.isBlack()) {
+      kkp += bkkp[index.kkp];
+    } else {
+      kkp -= wkkp[index.kkp];
+    }
+  }
+
+  return kkp;
+}
+template Value Evaluator::evaluateKkp_<Evaluator::Table>(const Board&) const;
+template Value Evaluator::evaluateKkp_<CompactTable>(const Board&) const;
+
+/**
+ * 玉の移動による評価値の変化値を算出します。
+ * 動いた玉の KPP のみを計算し直し、もう一方は差分計算します。
+ * @param board 着手後の局面を指定します。
+ * @param material 着手後の駒割りを指定します。
+ * @param prevValuePair
+ * @param move
+ */
+template <bool black, class Tbl, class P>
+ValuePair Evaluator::evaluateKingDiff_(const Board& board, const Value& material, const ValuePair& prevValuePair, const Move& move) {
+  const auto& tbl = getTable_<Tbl>();
+  assert(move.piece() == Piece::King);
+  assert(prevValuePair.isKppValid());
+
+  auto bking = board.getBKingSquare();
+  auto wkingR = board.getWKingSquare().reverse();
+  auto captured = move.captured();
+  auto to = move.to();
+
+  int bList[52]; // 52 = 40(総駒数) - 2(玉) + 14(駒台)
+  int wList[52];
+  int num = makeKppList(board, bList, wList);
+
+  Value kppBlack = prevValuePair.kppBlack();
+  Value kppWhite = prevValuePair.kppWhite();
+
+  if (P::Kpp) {
+    if (black) {
+      kppBlack = sumKpp(tbl.kpp[bking.index()], bList, num) * kppScale(tbl, bking.index());
+      if (!captured.isEmpty()) {
+        const auto& index = boardIndexTable.get(captured.white(), to);
+        auto hand = captured.hand();
+        int kppIndexCapHandW = kppHandIndex<false>(hand) + board.getBlackHand(hand);
+        kppWhite += kppCaptureDiff(tbl.kpp[wkingR.index()], wList, num, index.kppW, kppIndexCapHandW) * kppScale(tbl, wkingR.index());
+      }
+    } else {
+      kppWhite = sumKpp(tbl.kpp[wkingR.index()], wList, num) * kppScale(tbl, wkingR.index());
+      if (!captured.isEmpty()) {
+        const auto& index = boardIndexTable.get(captured.black(), to);
+        auto hand = captured.hand();
+        int kppIndexCapHandB = kppHandIndex<false>(hand) + board.getWhiteHand(hand);
+        kppBlack += kppCaptureDiff(tbl.kpp[bking.index()], bList, num, index.kppB, kppIndexCapHandB) * kppScale(tbl, bking.index());
+      }
+    }
+  }
+
+  Value positional = evaluateKkp_<Tbl>(board) + kppBlack - kppWhite;
+
+  if (P::HashTable) {
+    evaluateCache_->set(board.getNoTurnHash(), positional, kppBlack, kppWhite);
+  }
+
+  return ValuePair(material, positional, kppBlack, kppWhite);
 }
+#define INSTANTIATE__(Tbl, P) \
+template ValuePair Evaluator::evaluateKingDiff_<true, Tbl, P>(const Board&, const Value&, const ValuePair&, const Move&); \
+template ValuePair Evaluator::evaluateKingDiff_<false, Tbl, P>(const Board&, const Value&, const ValuePair&, const Move&);
+EVALUATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
 
 /**
  * 指定した指し手による評価値の変化値を算出します。
  * @param board 着手後の局面を指定します。
  * @param prevValuePair
  * @param move
+ * @param cacheHit
  */
-template <bool black>
-ValuePair Evaluator::evaluateDiff_(const Board& board, const ValuePair& prevValuePair, const Move& move) {
+template <bool black, class Tbl, class P>
+ValuePair Evaluator::evaluateDiff_(const Board& board, const ValuePair& prevValuePair, const Move& move, bool* cacheHit) {
+
+  const auto& tbl = getTable_<Tbl>();
 
   Value material = prevValuePair.material();;
   Value positional;
@@ -764,29 +1641,43 @@ ValuePair Evaluator::evaluateDiff_(const Board& board, const ValuePair& prevValu
 
   assert(board.isBlack() != black);
 
+  if (cacheHit != nullptr) {
+    *cacheHit = false;
+  }
+
   // ハッシュ表から引く
-#if ENABLE_HASHTABLE
-  if (evaluateCache_.get(board.getNoTurnHash(), positional)) {
-    if (!captured.isEmpty()) {
-      if (black) {
-        material += material::pieceExchange(captured);
-      } else {
-        material -= material::pieceExchange(captured);
+  // KPP の値も引き継ぎ, 後の玉の移動で差分計算できるようにする
+  if (P::HashTable) {
+    Value kppBlack;
+    Value kppWhite;
+    bool kppValid;
+    if (evaluateCache_->get(board.getNoTurnHash(), positional, kppBlack, kppWhite, kppValid)) {
+      if (cacheHit != nullptr) {
+        *cacheHit = true;
       }
-    }
-    if (move.promote()) {
-      if (black) {
-        material += material::piecePromote(piece);
-      } else {
-        material -= material::piecePromote(piece);
+      if (!captured.isEmpty()) {
+        if (black) {
+          material += material::pieceExchange(captured);
+        } else {
+          material -= material::pieceExchange(captured);
+        }
+      }
+      if (move.promote()) {
+        if (black) {
+          material += material::piecePromote(piece);
+        } else {
+          material -= material::piecePromote(piece);
+        }
       }
+      if (kppValid) {
+        return ValuePair(material, positional, kppBlack, kppWhite);
+      }
+      return ValuePair(material, positional);
     }
-    return ValuePair(material, positional);
   }
-#endif
 
   // 玉の移動の場合は差分計算不可
-  if (!ENABLE_DIFF || piece == Piece::King) {
+  if (!P::Diff || piece == Piece::King) {
     if (!captured.isEmpty()) {
       if (black) {
         material += material::pieceExchange(captured);
@@ -794,16 +1685,20 @@ ValuePair Evaluator::evaluateDiff_(const Board& board, const ValuePair& prevValu
         material -= material::pieceExchange(captured);
       }
     }
-#if !ENABLE_DIFF
-    if (move.promote()) {
-      if (black) {
-        material += material::piecePromote(piece);
-      } else {
-        material -= material::piecePromote(piece);
+    if (!P::Diff) {
+      if (move.promote()) {
+        if (black) {
+          material += material::piecePromote(piece);
+        } else {
+          material -= material::piecePromote(piece);
+        }
+      }
+    } else {
+      if (prevValuePair.isKppValid()) {
+        return evaluateKingDiff_<black, Tbl, P>(board, material, prevValuePair, move);
       }
     }
-#endif
-    return ValuePair(material, evaluate_(board));
+    return evaluate_<Tbl, P>(board, material);
   }
 
   positional = prevValuePair.positional();
@@ -833,279 +1728,240 @@ ValuePair Evaluator::evaluateDiff_(const Board& board, const ValuePair& prevValu
     if (black) {
       int num = board.getBlackHand(piece);
       int kkpIndex = kkpHandIndex(piece) + num;
-      positional += t_->kkp[bking.index()][wking.index()][kkpIndex];
-      positional -= t_->kkp[bking.index()][wking.index()][kkpIndex+1];
+      positional += tbl.kkp[bking.index()][wking.index()][kkpIndex];
+      positional -= tbl.kkp[bking.index()][wking.index()][kkpIndex+1];
       kppIndexFromB = kppHandIndex<true>(piece.index()) + num;
       kppIndexFromW = kppHandIndex<false>(piece.index()) + num;
     } else {
       int num = board.getWhiteHand(piece);
       int kkpIndex = kkpHandIndex(piece) + num;
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpIndex];
-      positional += t_->kkp[wkingR.index()][bkingR.index()][kkpIndex+1];
+      positional -= tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex];
+      positional += tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex+1];
       kppIndexFromB = kppHandIndex<false>(piece.index()) + num;
       kppIndexFromW = kppHandIndex<true>(piece.index()) + num;
     }
   } else {
     // 盤上の駒を動かした場合
     auto from = move.from();
+    const auto& index = boardIndexTable.get(black ? piece.black() : piece.white(), from);
     if (black) {
-      positional -= t_->kkp[bking.index()][wking.index()][kkpBoardIndex(piece, from)];
-      kppIndexFromB = kppBoardIndex<true>(piece, from);
-      kppIndexFromW = kppBoardIndex<false>(piece, from.reverse());
+      positional -= tbl.kkp[bking.index()][wking.index()][index.kkp];
     } else {
-      positional += t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(piece, from.reverse())];
-      kppIndexFromB = kppBoardIndex<false>(piece, from);
-      kppIndexFromW = kppBoardIndex<true>(piece, from.reverse());
+      positional += tbl.kkp[wkingR.index()][bkingR.index()][index.kkp];
     }
+    kppIndexFromB = index.kppB;
+    kppIndexFromW = index.kppW;
   }
 
   // 移動先
-  if (isProm) {
-    // 駒が成った場合
-    if (black) {
-      material += material::piecePromote(piece);
-      auto promoted = piece.promote();
-      positional += t_->kkp[bking.index()][wking.index()][kkpBoardIndex(promoted, to)];
-      kppIndexToB = kppBoardIndex<true>(promoted, to);
-      kppIndexToW = kppBoardIndex<false>(promoted, to.reverse());
-    } else {
-      material -= material::piecePromote(piece);
-      auto promoted = piece.promote();
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(promoted, to.reverse())];
-      kppIndexToB = kppBoardIndex<false>(promoted, to);
-      kppIndexToW = kppBoardIndex<true>(promoted, to.reverse());
+  {
+    if (isProm) {
+      // 駒が成った場合
+      if (black) {
+        material += material::piecePromote(piece);
+      } else {
+        material -= material::piecePromote(piece);
+      }
     }
-  } else {
-    // 成らなかった場合
+    auto pieceTo = isProm ? piece.promote() : piece;
+    const auto& index = boardIndexTable.get(black ? pieceTo.black() : pieceTo.white(), to);
     if (black) {
-      positional += t_->kkp[bking.index()][wking.index()][kkpBoardIndex(piece, to)];
-      kppIndexToB = kppBoardIndex<true>(piece, to);
-      kppIndexToW = kppBoardIndex<false>(piece, to.reverse());
+      positional += tbl.kkp[bking.index()][wking.index()][index.kkp];
     } else {
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(piece, to.reverse())];
-      kppIndexToB = kppBoardIndex<false>(piece, to);
-      kppIndexToW = kppBoardIndex<true>(piece, to.reverse());
+      positional -= tbl.kkp[wkingR.index()][bkingR.index()][index.kkp];
     }
+    kppIndexToB = index.kppB;
+    kppIndexToW = index.kppW;
   }
 
   // 駒を取った場合
   if (!captured.isEmpty()) {
+    const auto& index = boardIndexTable.get(black ? captured.white() : captured.black(), to);
     if (black) {
       material += material::pieceExchange(captured);
-      positional += t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(captured, to.reverse())];
-      kppIndexCapturedB = kppBoardIndex<false>(captured, to);
-      kppIndexCapturedW = kppBoardIndex<true>(captured, to.reverse());
+      positional += tbl.kkp[wkingR.index()][bkingR.index()][index.kkp];
     } else {
       material -= material::pieceExchange(captured);
-      positional -= t_->kkp[bking.index()][wking.index()][kkpBoardIndex(captured, to)];
-      kppIndexCapturedB = kppBoardIndex<true>(captured, to);
-      kppIndexCapturedW = kppBoardIndex<false>(captured, to.reverse());
+      positional -= tbl.kkp[bking.index()][wking.index()][index.kkp];
     }
+    kppIndexCapturedB = index.kppB;
+    kppIndexCapturedW = index.kppW;
     auto hand = captured.hand();
     if (black) {
       int num = board.getBlackHand(hand);
       int kkpIndex = kkpHandIndex(hand) + num;
-      positional += t_->kkp[bking.index()][wking.index()][kkpIndex];
-      positional -= t_->kkp[bking.index()][wking.index()][kkpIndex-1];
+      positional += tbl.kkp[bking.index()][wking.index()][kkpIndex];
+      positional -= tbl.kkp[bking.index()][wking.index()][kkpIndex-1];
       kppIndexCapHandB = kppHandIndex<true>(hand) + num;
       kppIndexCapHandW = kppHandIndex<false>(hand) + num;
     } else {
       int num = board.getWhiteHand(hand);
       int kkpIndex = kkpHandIndex(hand) + num;
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpIndex];
-      positional += t_->kkp[wkingR.index()][bkingR.index()][kkpIndex-1];
+      positional -= tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex];
+      positional += tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex-1];
       kppIndexCapHandB = kppHandIndex<false>(hand) + num;
       kppIndexCapHandW = kppHandIndex<true>(hand) + num;
     }
   }
 
-  int num = 14;
   int bList[52]; // 52 = 40(総駒数) - 2(玉) + 14(駒台)
   int wList[52];
-  int nTemp;
-  int wTemp[34]; // 34 = 18(と金) + 16(成香, 成桂, 成銀, 金)
-
-#define ON_HAND(piece, pieceL, index) { \
-  int count = board.getBlackHand(Piece::piece); \
-  bList[index] = KPP_HB ## pieceL + count; \
-  wList[index+1] = KPP_HW ## pieceL + count; \
-  count = board.getWhiteHand(Piece::piece); \
-  bList[index+1] = KPP_HW ## pieceL + count; \
-  wList[index] = KPP_HB ## pieceL + count; \
-}
-
-  ON_HAND(Pawn, PAWN, 0);
-  ON_HAND(Lance, LANCE, 2);
-  ON_HAND(Knight, KNIGHT, 4);
-  ON_HAND(Silver, SILVER, 6);
-  ON_HAND(Gold, GOLD, 8);
-  ON_HAND(Bishop, BISHOP, 10);
-  ON_HAND(Rook, ROOK, 12);
+  int num = makeKppList(board, bList, wList);
+
+  Value kppBlackDiff = 0;
+  Value kppWhiteDiff = 0;
+
+  if (P::Kpp) {
+    if (isHand) {
+      // 持ち駒を打った場合
+      for (int i = 0; i < num; i++) {
+        int b = bList[i];
+        int w = wList[i];
+        // 持ち駒の現在の数
+        kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexFromB)];
+        kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW)];
+        // 持ち駒の元の数
+        kppBlackDiff -= tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexFromB+1)];
+        kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW+1)];
+        // 移動先の駒
+        kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexToB)];
+        kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexToW)];
+        // 現在の局面では存在しないはずのインデクス
+        assert(b != kppIndexFromB+1);
+        assert(w != kppIndexFromW+1);
+      }
+      // 2重に足している特徴の組み合わせ(ループ内で足しすぎているので引く)
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexToB)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexToW)];
+      // 前の局面に存在しなかった特徴の組み合わせ(ループ内で引きすぎている分を足す)
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index(kppIndexFromB+1, kppIndexFromB)];
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(kppIndexFromB+1, kppIndexToB)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index(kppIndexFromW+1, kppIndexFromW)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(kppIndexFromW+1, kppIndexToW)];
+      // 前の局面にしか存在しない特徴の組み合わせ(現局面には存在しないので引く)
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexFromB+1, kppIndexFromB+1)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexFromW+1, kppIndexFromW+1)];
+    } else if (captured.isEmpty()) {
+      // 駒を取らずに盤上の駒を移動した場合
+      for (int i = 0; i < num; i++) {
+        int b = bList[i];
+        int w = wList[i];
+        // 移動元の駒
+        kppBlackDiff -= tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexFromB)];
+        kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW)];
+        // 移動先の駒
+        kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexToB)];
+        kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexToW)];
+        // 現在の局面では存在しないはずのインデクス
+        assert(b != kppIndexFromB);
+        assert(w != kppIndexFromW);
+      }
+      // 前の局面に存在しなかった特徴の組み合わせ(ループ内で引きすぎている分を足す)
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexToB)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexToW)];
+      // 前の局面にしか存在しない特徴の組み合わせ(現局面には存在しないので引く)
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexFromB)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexFromW)];
+    } else {
+      // 駒を取った場合
+      for (int i = 0; i < num; i++) {
+        int b = bList[i];
+        int w = wList[i];
+        // 移動元の駒
+        kppBlackDiff -= tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexFromB)];
+        kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW)];
+        // 移動先の駒
+        kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexToB)];
+        kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexToW)];
+        // 取られた駒
+        kppBlackDiff -= tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexCapturedB)];
+        kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexCapturedW)];
+        // 持ち駒の現在の数
+        kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexCapHandB)];
+        kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexCapHandW)];
+        // 持ち駒の元の数
+        kppBlackDiff -= tbl.kpp[bking.index()][kpp_index_safe(b, kppIndexCapHandB-1)];
+        kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index_safe(w, kppIndexCapHandW-1)];
+        // 現在の局面では存在しないはずのインデクス
+        assert(b != kppIndexFromB);
+        assert(w != kppIndexFromW);
+        assert(b != kppIndexCapturedB);
+        assert(w != kppIndexCapturedW);
+        assert(b != kppIndexCapHandB-1);
+        assert(w != kppIndexCapHandW-1);
+      }
+      // 2重に足している特徴の組み合わせ(ループ内で足しすぎているので引く)
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexToB, kppIndexCapHandB)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexToW, kppIndexCapHandW)];
+      // 前の局面に存在しなかった特徴の組み合わせ(ループ内で引きすぎている分を足す)
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexToB)];
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexCapHandB)];
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index_safe(kppIndexCapturedB, kppIndexToB)];
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index(kppIndexCapturedB, kppIndexCapHandB)];
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index(kppIndexToB, kppIndexCapHandB-1)];
+      kppBlackDiff += tbl.kpp[bking.index()][kpp_index(kppIndexCapHandB, kppIndexCapHandB-1)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexToW)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexCapHandW)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index_safe(kppIndexCapturedW, kppIndexToW)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index(kppIndexCapturedW, kppIndexCapHandW)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index(kppIndexToW, kppIndexCapHandW-1)];
+      kppWhiteDiff += tbl.kpp[wkingR.index()][kpp_index(kppIndexCapHandW, kppIndexCapHandW-1)];
+      // 前の局面にしか存在しない特徴の組み合わせ(現局面には存在しないので引く)
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexFromB)];
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexCapturedB)];
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexCapHandB-1)];
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexCapturedB, kppIndexCapturedB)];
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexCapturedB, kppIndexCapHandB-1)];
+      kppBlackDiff -= tbl.kpp[bking.index()][kpp_index(kppIndexCapHandB-1, kppIndexCapHandB-1)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexFromW)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexCapturedW)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexCapHandW-1)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexCapturedW, kppIndexCapturedW)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexCapturedW, kppIndexCapHandW-1)];
+      kppWhiteDiff -= tbl.kpp[wkingR.index()][kpp_index(kppIndexCapHandW-1, kppIndexCapHandW-1)];
+    }
+    kppBlackDiff *= kppScale(tbl, bking.index());
+    kppWhiteDiff *= kppScale(tbl, wkingR.index());
+  }
 
-#undef ON_HAND
+  positional += kppBlackDiff - kppWhiteDiff;
 
-#define ON_BOARD(blackBB, whiteBB, pieceL, SQ_INDEX_B, SQ_INDEX_W) { \
-  nTemp = 0; \
-  auto bb = (blackBB); \
-  BB_EACH_OPE(sq, bb, { \
-    bList[num++] = KPP_BB ## pieceL + SQ_INDEX_B(sq); \
-    wTemp[nTemp++] = KPP_BW ## pieceL + SQ_INDEX_W(sq.reverse()); \
-  }); \
-  bb = (whiteBB); \
-  BB_EACH_OPE(sq, bb, { \
-    bList[num++] = KPP_BW ## pieceL + SQ_INDEX_W(sq); \
-    wTemp[nTemp++] = KPP_BB ## pieceL + SQ_INDEX_B(sq.reverse()); \
-  }); \
-  for (int i = 0; i < nTemp; i++) { wList[num-i-1] = wTemp[i]; } \
-}
-
-  ON_BOARD(board.getBPawn(), board.getWPawn(), PAWN, SQ_INDEX_BPAWN, SQ_INDEX_WPAWN);
-  ON_BOARD(board.getBLance(),board.getWLance(), LANCE, SQ_INDEX_BPAWN, SQ_INDEX_WPAWN);
-  ON_BOARD(board.getBKnight(), board.getWKnight(), KNIGHT, SQ_INDEX_BKNIGHT, SQ_INDEX_WKNIGHT);
-  ON_BOARD(board.getBSilver(), board.getWSilver(), SILVER, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBGold() | board.getBTokin() | board.getBProLance() | board.getBProKnight() | board.getBProSilver(),
-           board.getWGold() | board.getWTokin() | board.getWProLance() | board.getWProKnight() | board.getWProSilver(), GOLD,
-           SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBBishop(), board.getWBishop(), BISHOP, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBHorse(), board.getWHorse(), HORSE, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBRook(), board.getWRook(), ROOK, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-  ON_BOARD(board.getBDragon(), board.getWDragon(), DRAGON, SQ_INDEX_BNORMAL, SQ_INDEX_WNORMAL);
-
-#undef ON_BOARD
-
-#if ENABLE_KPP
-  if (isHand) {
-    // 持ち駒を打った場合
-    for (int i = 0; i < num; i++) {
-      int b = bList[i];
-      int w = wList[i];
-      // 持ち駒の現在の数
-      positional += t_->kpp[bking.index()][kpp_index_safe(b, kppIndexFromB)];
-      positional -= t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW)];
-      // 持ち駒の元の数
-      positional -= t_->kpp[bking.index()][kpp_index_safe(b, kppIndexFromB+1)];
-      positional += t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW+1)];
-      // 移動先の駒
-      positional += t_->kpp[bking.index()][kpp_index_safe(b, kppIndexToB)];
-      positional -= t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexToW)];
-      // 現在の局面では存在しないはずのインデクス
-      assert(b != kppIndexFromB+1);
-      assert(w != kppIndexFromW+1);
+  if (prevValuePair.isKppValid()) {
+    Value kppBlack = prevValuePair.kppBlack() + kppBlackDiff;
+    Value kppWhite = prevValuePair.kppWhite() + kppWhiteDiff;
+    if (P::HashTable) {
+      evaluateCache_->set(board.getNoTurnHash(), positional, kppBlack, kppWhite);
     }
-    // 2重に足している特徴の組み合わせ(ループ内で足しすぎているので引く)
-    positional -= t_->kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexToB)];
-    positional += t_->kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexToW)];
-    // 前の局面に存在しなかった特徴の組み合わせ(ループ内で引きすぎている分を足す)
-    positional += t_->kpp[bking.index()][kpp_index(kppIndexFromB+1, kppIndexFromB)];
-    positional += t_->kpp[bking.index()][kpp_index_safe(kppIndexFromB+1, kppIndexToB)];
-    positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexFromW+1, kppIndexFromW)];
-    positional -= t_->kpp[wkingR.index()][kpp_index_safe(kppIndexFromW+1, kppIndexToW)];
-    // 前の局面にしか存在しない特徴の組み合わせ(現局面には存在しないので引く)
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexFromB+1, kppIndexFromB+1)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexFromW+1, kppIndexFromW+1)];
-  } else if (captured.isEmpty()) {
-    // 駒を取らずに盤上の駒を移動した場合
-    for (int i = 0; i < num; i++) {
-      int b = bList[i];
-      int w = wList[i];
-      // 移動元の駒
-      positional -= t_->kpp[bking.index()][kpp_index_safe(b, kppIndexFromB)];
-      positional += t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW)];
-      // 移動先の駒
-      positional += t_->kpp[bking.index()][kpp_index_safe(b, kppIndexToB)];
-      positional -= t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexToW)];
-      // 現在の局面では存在しないはずのインデクス
-      assert(b != kppIndexFromB);
-      assert(w != kppIndexFromW);
-    }
-    // 前の局面に存在しなかった特徴の組み合わせ(ループ内で引きすぎている分を足す)
-    positional += t_->kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexToB)];
-    positional -= t_->kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexToW)];
-    // 前の局面にしか存在しない特徴の組み合わせ(現局面には存在しないので引く)
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexFromB)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexFromW)];
-  } else {
-    // 駒を取った場合
-    for (int i = 0; i < num; i++) {
-      int b = bList[i];
-      int w = wList[i];
-      // 移動元の駒
-      positional -= t_->kpp[bking.index()][kpp_index_safe(b, kppIndexFromB)];
-      positional += t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexFromW)];
-      // 移動先の駒
-      positional += t_->kpp[bking.index()][kpp_index_safe(b, kppIndexToB)];
-      positional -= t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexToW)];
-      // 取られた駒
-      positional -= t_->kpp[bking.index()][kpp_index_safe(b, kppIndexCapturedB)];
-      positional += t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexCapturedW)];
-      // 持ち駒の現在の数
-      positional += t_->kpp[bking.index()][kpp_index_safe(b, kppIndexCapHandB)];
-      positional -= t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexCapHandW)];
-      // 持ち駒の元の数
-      positional -= t_->kpp[bking.index()][kpp_index_safe(b, kppIndexCapHandB-1)];
-      positional += t_->kpp[wkingR.index()][kpp_index_safe(w, kppIndexCapHandW-1)];
-      // 現在の局面では存在しないはずのインデクス
-      assert(b != kppIndexFromB);
-      assert(w != kppIndexFromW);
-      assert(b != kppIndexCapturedB);
-      assert(w != kppIndexCapturedW);
-      assert(b != kppIndexCapHandB-1);
-      assert(w != kppIndexCapHandW-1);
-    }
-    // 2重に足している特徴の組み合わせ(ループ内で足しすぎているので引く)
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexToB, kppIndexCapHandB)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexToW, kppIndexCapHandW)];
-    // 前の局面に存在しなかった特徴の組み合わせ(ループ内で引きすぎている分を足す)
-    positional += t_->kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexToB)];
-    positional += t_->kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexCapHandB)];
-    positional += t_->kpp[bking.index()][kpp_index_safe(kppIndexCapturedB, kppIndexToB)];
-    positional += t_->kpp[bking.index()][kpp_index(kppIndexCapturedB, kppIndexCapHandB)];
-    positional += t_->kpp[bking.index()][kpp_index(kppIndexToB, kppIndexCapHandB-1)];
-    positional += t_->kpp[bking.index()][kpp_index(kppIndexCapHandB, kppIndexCapHandB-1)];
-    positional -= t_->kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexToW)];
-    positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexCapHandW)];
-    positional -= t_->kpp[wkingR.index()][kpp_index_safe(kppIndexCapturedW, kppIndexToW)];
-    positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexCapturedW, kppIndexCapHandW)];
-    positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexToW, kppIndexCapHandW-1)];
-    positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexCapHandW, kppIndexCapHandW-1)];
-    // 前の局面にしか存在しない特徴の組み合わせ(現局面には存在しないので引く)
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexFromB)];
-    positional -= t_->kpp[bking.index()][kpp_index_safe(kppIndexFromB, kppIndexCapturedB)];
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexFromB, kppIndexCapHandB-1)];
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexCapturedB, kppIndexCapturedB)];
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexCapturedB, kppIndexCapHandB-1)];
-    positional -= t_->kpp[bking.index()][kpp_index(kppIndexCapHandB-1, kppIndexCapHandB-1)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexFromW)];
-    positional += t_->kpp[wkingR.index()][kpp_index_safe(kppIndexFromW, kppIndexCapturedW)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexFromW, kppIndexCapHandW-1)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexCapturedW, kppIndexCapturedW)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexCapturedW, kppIndexCapHandW-1)];
-    positional += t_->kpp[wkingR.index()][kpp_index(kppIndexCapHandW-1, kppIndexCapHandW-1)];
-  }
-#endif // ENABLE_KPP
-
-#if ENABLE_HASHTABLE
-  evaluateCache_.set(board.getNoTurnHash(), positional);
-#endif
+    return ValuePair(material, positional, kppBlack, kppWhite);
+  }
 
+  if (P::HashTable) {
+    evaluateCache_->set(board.getNoTurnHash(), positional);
+  }
   return ValuePair(material, positional);
 
 }
-template ValuePair Evaluator::evaluateDiff_<true>(const Board&, const ValuePair&, const Move&);
-template ValuePair Evaluator::evaluateDiff_<false>(const Board&, const ValuePair&, const Move&);
+#define INSTANTIATE__(Tbl, P) \
+template ValuePair Evaluator::evaluateDiff_<true, Tbl, P>(const Board&, const ValuePair&, const Move&, bool*); \
+template ValuePair Evaluator::evaluateDiff_<false, Tbl, P>(const Board&, const ValuePair&, const Move&, bool*);
+EVALUATOR_INSTANTIATE_EACH__(INSTANTIATE__)
+#undef INSTANTIATE__
 
 /**
  * 評価値の変化を推定します。
  * @param board
  * @param move
  */
-template <bool black, bool isKing, bool positionalOnly>
+template <bool black, bool isKing, bool positionalOnly, class Tbl>
 Value Evaluator::estimate_(const Board& board, const Move& move) {
 
+  const auto& tbl = getTable_<Tbl>();
   Value value;
 
   Value material = 0;
   Value positional = 0;
+  Value kppBlack = 0;
+  Value kppWhite = 0;
   auto piece = move.piece();
   auto captured = board.getBoardPiece(move.to());
 
@@ -1126,44 +1982,44 @@ Value Evaluator::estimate_(const Board& board, const Move& move) {
     if (black) {
       int num = board.getBlackHand(piece);
       int kkpIndex = kkpHandIndex(piece) + num;
-      positional += t_->kkp[bking.index()][wking.index()][kkpIndex];
-      positional -= t_->kkp[bking.index()][wking.index()][kkpIndex+1];
+      positional += tbl.kkp[bking.index()][wking.index()][kkpIndex];
+      positional -= tbl.kkp[bking.index()][wking.index()][kkpIndex+1];
       int kppIndexB = kppHandIndex<true>(piece) + num;
-      positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
-      positional -= t_->kpp[bking.index()][kpp_index(kppIndexB+1)];
+      positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
+      positional -= tbl.kpp[bking.index()][kpp_index(kppIndexB+1)];
       int kppIndexW = kppHandIndex<false>(piece) + num;
-      positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
-      positional += t_->kpp[wkingR.index()][kpp_index(kppIndexW+1)];
+      positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional += tbl.kpp[wkingR.index()][kpp_index(kppIndexW+1)];
     } else {
       int num = board.getWhiteHand(piece);
       int kkpIndex = kkpHandIndex(piece) + num;
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpIndex];
-      positional += t_->kkp[wkingR.index()][bkingR.index()][kkpIndex+1];
+      positional -= tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex];
+      positional += tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex+1];
       int kppIndexB = kppHandIndex<false>(piece) + num;
-      positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
-      positional -= t_->kpp[bking.index()][kpp_index(kppIndexB+1)];
+      positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
+      positional -= tbl.kpp[bking.index()][kpp_index(kppIndexB+1)];
       int kppIndexW = kppHandIndex<true>(piece) + num;
-      positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
-      positional += t_->kpp[wkingR.index()][kpp_index(kppIndexW+1)];
+      positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional += tbl.kpp[wkingR.index()][kpp_index(kppIndexW+1)];
     }
   } else {
     // 盤上の駒を動かした場合
     auto from = move.from();
     if (black) {
       if (!isKing) {
-        positional -= t_->kkp[bking.index()][wking.index()][kkpBoardIndex(piece, from)];
+        positional -= tbl.kkp[bking.index()][wking.index()][kkpBoardIndex(piece, from)];
         int kppIndexB = kppBoardIndex<true>(piece, from);
-        positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
+        positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
         int kppIndexW = kppBoardIndex<false>(piece, from.reverse());
-        positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+        positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
       }
     } else {
       if (!isKing) {
-        positional += t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(piece, from.reverse())];
+        positional += tbl.kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(piece, from.reverse())];
         int kppIndexB = kppBoardIndex<false>(piece, from);
-        positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
+        positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
         int kppIndexW = kppBoardIndex<true>(piece, from.reverse());
-        positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+        positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
       }
     }
   }
@@ -1174,37 +2030,37 @@ Value Evaluator::estimate_(const Board& board, const Move& move) {
     if (black) {
       if (!positionalOnly) { material += material::piecePromote(piece); }
       auto promoted = piece.promote();
-      positional += t_->kkp[bking.index()][wking.index()][kkpBoardIndex(promoted, to)];
+      positional += tbl.kkp[bking.index()][wking.index()][kkpBoardIndex(promoted, to)];
       int kppIndexB = kppBoardIndex<true>(promoted, to);
-      positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
+      positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
       int kppIndexW = kppBoardIndex<false>(promoted, to.reverse());
-      positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
     } else {
       if (!positionalOnly) { material -= material::piecePromote(piece); }
       auto promoted = piece.promote();
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(promoted, to.reverse())];
+      positional -= tbl.kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(promoted, to.reverse())];
       int kppIndexB = kppBoardIndex<false>(promoted, to);
-      positional -= t_->kpp[bking.index()][kpp_index(kppIndexB)];
+      positional -= tbl.kpp[bking.index()][kpp_index(kppIndexB)];
       int kppIndexW = kppBoardIndex<true>(promoted, to.reverse());
-      positional += t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional += tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
     }
   } else {
     // 成らなかった場合
     if (black) {
       if (!isKing) {
-        positional += t_->kkp[bking.index()][wking.index()][kkpBoardIndex(piece, to)];
+        positional += tbl.kkp[bking.index()][wking.index()][kkpBoardIndex(piece, to)];
         int kppIndexB = kppBoardIndex<true>(piece, to);
-        positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
+        positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
         int kppIndexW = kppBoardIndex<false>(piece, to.reverse());
-        positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+        positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
       }
     } else {
       if (!isKing) {
-        positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(piece, to.reverse())];
+        positional -= tbl.kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(piece, to.reverse())];
         int kppIndexB = kppBoardIndex<false>(piece, to);
-        positional -= t_->kpp[bking.index()][kpp_index(kppIndexB)];
+        positional -= tbl.kpp[bking.index()][kpp_index(kppIndexB)];
         int kppIndexW = kppBoardIndex<true>(piece, to.reverse());
-        positional += t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+        positional += tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
       }
     }
   }
@@ -1213,58 +2069,68 @@ Value Evaluator::estimate_(const Board& board, const Move& move) {
   if (!captured.isEmpty()) {
     if (black) {
       if (!positionalOnly) { material += material::pieceExchange(captured); }
-      positional += t_->kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(captured, to.reverse())];
+      positional += tbl.kkp[wkingR.index()][bkingR.index()][kkpBoardIndex(captured, to.reverse())];
       int kppIndexB = kppBoardIndex<false>(captured, to);
-      positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
+      positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
       int kppIndexW = kppBoardIndex<true>(captured, to.reverse());
-      positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
     } else {
       if (!positionalOnly) { material -= material::pieceExchange(captured); }
-      positional -= t_->kkp[bking.index()][wking.index()][kkpBoardIndex(captured, to)];
+      positional -= tbl.kkp[bking.index()][wking.index()][kkpBoardIndex(captured, to)];
       int kppIndexB = kppBoardIndex<true>(captured, to);
-      positional -= t_->kpp[bking.index()][kpp_index(kppIndexB)];
+      positional -= tbl.kpp[bking.index()][kpp_index(kppIndexB)];
       int kppIndexW = kppBoardIndex<false>(captured, to.reverse());
-      positional += t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional += tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
     }
     auto hand = captured.hand();
     if (black) {
       int num = board.getBlackHand(hand);
       int kkpIndex = kkpHandIndex(hand) + num;
-      positional += t_->kkp[bking.index()][wking.index()][kkpIndex];
-      positional -= t_->kkp[bking.index()][wking.index()][kkpIndex-1];
+      positional += tbl.kkp[bking.index()][wking.index()][kkpIndex];
+      positional -= tbl.kkp[bking.index()][wking.index()][kkpIndex-1];
       int kppIndexB = kppHandIndex<true>(hand) + num;
-      positional += t_->kpp[bking.index()][kpp_index(kppIndexB)];
-      positional -= t_->kpp[bking.index()][kpp_index(kppIndexB-1)];
+      positional += tbl.kpp[bking.index()][kpp_index(kppIndexB)];
+      positional -= tbl.kpp[bking.index()][kpp_index(kppIndexB-1)];
       int kppIndexW = kppHandIndex<false>(hand) + num;
-      positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
-      positional += t_->kpp[wkingR.index()][kpp_index(kppIndexW-1)];
+      positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional += tbl.kpp[wkingR.index()][kpp_index(kppIndexW-1)];
     } else {
       int num = board.getWhiteHand(hand);
       int kkpIndex = kkpHandIndex(hand) + num;
-      positional -= t_->kkp[wkingR.index()][bkingR.index()][kkpIndex];
-      positional += t_->kkp[wkingR.index()][bkingR.index()][kkpIndex-1];
+      positional -= tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex];
+      positional += tbl.kkp[wkingR.index()][bkingR.index()][kkpIndex-1];
       int kppIndexB = kppHandIndex<false>(hand) + num;
-      positional -= t_->kpp[bking.index()][kpp_index(kppIndexB)];
-      positional += t_->kpp[bking.index()][kpp_index(kppIndexB-1)];
+      positional -= tbl.kpp[bking.index()][kpp_index(kppIndexB)];
+      positional += tbl.kpp[bking.index()][kpp_index(kppIndexB-1)];
       int kppIndexW = kppHandIndex<true>(hand) + num;
-      positional += t_->kpp[wkingR.index()][kpp_index(kppIndexW)];
-      positional -= t_->kpp[wkingR.index()][kpp_index(kppIndexW-1)];
+      positional += tbl.kpp[wkingR.index()][kpp_index(kppIndexW)];
+      positional -= tbl.kpp[wkingR.index()][kpp_index(kppIndexW-1)];
     }
   }
 
+  positional += kppBlack * kppScale(tbl, bking.index()) + kppWhite * kppScale(tbl, wkingR.index());
+
   auto valuePair = ValuePair(material, positional);
   value = black ? valuePair.value() : -valuePair.value();
 
   return value;
 }
-template Value Evaluator::estimate_<true, true, true>(const Board& board, const Move& move);
-template Value Evaluator::estimate_<true, false, true>(const Board& board, const Move& move);
-template Value Evaluator::estimate_<false, true, true>(const Board& board, const Move& move);
-template Value Evaluator::estimate_<false, false, true>(const Board& board, const Move& move);
-template Value Evaluator::estimate_<true, true, false>(const Board& board, const Move& move);
-template Value Evaluator::estimate_<true, false, false>(const Board& board, const Move& move);
-template Value Evaluator::estimate_<false, true, false>(const Board& board, const Move& move);
-template Value Evaluator::estimate_<false, false, false>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, true, true, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, false, true, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, true, true, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, false, true, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, true, false, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, false, false, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, true, false, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, false, false, Evaluator::Table>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, true, true, CompactTable>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, false, true, CompactTable>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, true, true, CompactTable>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, false, true, CompactTable>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, true, false, CompactTable>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<true, false, false, CompactTable>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, true, false, CompactTable>(const Board& board, const Move& move);
+template Value Evaluator::estimate_<false, false, false, CompactTable>(const Board& board, const Move& move);
 
 template class Feature<int16_t>;
 template class Feature<float>;
@@ -11,6 +11,7 @@
 #include "core/board/Board.h"
 #include "Material.h"
 #include <memory>
+#include <string>
 
 namespace sunfish {
 
@@ -23,11 +24,17 @@ private:
 
   Value material_;
   Value positional_;
+  Value kppBlack_;
+  Value kppWhite_;
+  bool kppValid_;
 
 public:
 
-  ValuePair() : material_(0), positional_(0) {}
-  ValuePair(const Value& material, const Value& positional) : material_(material), positional_(positional) {}
+  ValuePair() : material_(0), positional_(0), kppBlack_(0), kppWhite_(0), kppValid_(false) {}
+  ValuePair(const Value& material, const Value& positional) :
+    material_(material), positional_(positional), kppBlack_(0), kppWhite_(0), kppValid_(false) {}
+  ValuePair(const Value& material, const Value& positional, const Value& kppBlack, const Value& kppWhite) :
+    material_(material), positional_(positional), kppBlack_(kppBlack), kppWhite_(kppWhite), kppValid_(true) {}
 
   Value material() const {
     return material_;
@@ -37,11 +44,38 @@ public:
     return positional_;
   }
 
+  /**
+   * positional のうち先手玉に関する KPP の合計を返します。
+   */
+  Value kppBlack() const {
+    return kppBlack_;
+  }
+
+  /**
+   * positional のうち後手玉に関する KPP の合計を返します。
+   * positional = KKP + kppBlack - kppWhite の関係になります。
+   */
+  Value kppWhite() const {
+    return kppWhite_;
+  }
+
+  /**
+   * kppBlack(), kppWhite() が有効な場合に true を返します。
+   * ハッシュ表から引いた評価値には内訳が無いため false になります。
+   */
+  bool isKppValid() const {
+    return kppValid_;
+  }
+
   Value value() const {
     return material_ + positional_ / PositionalScale;
   }
 
   ValuePair operator+(const ValuePair& right) const {
+    if (kppValid_ && right.kppValid_) {
+      return ValuePair(material_ + right.material_, positional_ + right.positional_,
+                       kppBlack_ + right.kppBlack_, kppWhite_ + right.kppWhite_);
+    }
     return ValuePair(material_ + right.material_, positional_ + right.positional_);
   }
 
@@ -170,6 +204,24 @@ public:
     ValueType kkp[81][81][KKP_MAX];
   };
 
+  /**
+   * パラメータファイルのヘッダ
+   * ヘッダの無い古い形式のファイルも読み込むことができます。
+   */
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t valueSize;
+    uint32_t reserved;
+    uint64_t tableSize;
+    uint64_t checksum;
+    char padding[24];
+  };
+  static_assert(sizeof(FileHeader) == 64, "invalid header size");
+
+  static CONSTEXPR_CONST uint32_t FileVersion = 1;
+
   static CONSTEXPR size_t size() {
     return sizeof(Table) / sizeof(ValueType);
   }
@@ -178,28 +230,40 @@ public:
 
   bool allocated;
 
+private:
+
+  /** mapFile でマップした領域 */
+  void* mapped_;
+  size_t mappedSize_;
+
+  static bool checkHeader(const FileHeader& header);
+
+  void release();
+
 protected:
 
-  Feature() : t_(nullptr) {
-    t_ = new Table();
-    allocated = true;
-    assert(t_ != nullptr);
+  Feature(bool alloc = true) : t_(nullptr), allocated(false), mapped_(nullptr), mappedSize_(0) {
+    if (alloc) {
+      allocate();
+    }
   }
 
-  Feature(Feature& ref) : t_(nullptr) {
+  Feature(Feature& ref) : t_(nullptr), allocated(false), mapped_(nullptr), mappedSize_(0) {
     t_ = ref.t_;
-    allocated = false;
-    assert(t_ != nullptr);
   }
 
   Feature(const Feature&) = delete;
   Feature(Feature&&) = delete;
 
   ~Feature() {
-    if (allocated && t_ != nullptr) {
-      delete t_;
-      t_ = nullptr;
-    }
+    release();
+  }
+
+  void allocate() {
+    release();
+    t_ = new Table();
+    allocated = true;
+    assert(t_ != nullptr);
   }
 
 public:
@@ -239,11 +303,108 @@ public:
     return writeFile(filename.c_str());
   }
 
+  /**
+   * ファイルをメモリにマップしてパラメータとして使用します。
+   * 同じファイルをマップした他のプロセスとページを共有します。
+   * 参照コンストラクタでコピーを作る前に呼び出す必要があります。
+   * @param filename
+   * @param verify チェックサムを検証する場合に true を指定します。
+   *               全てのページを読むことになるため既定では検証しません。
+   */
+  bool mapFile(const char* filename, bool verify = false);
+
+  bool isMapped() const {
+    return mapped_ != nullptr;
+  }
+
+  /**
+   * パラメータのチェックサムを計算します。
+   */
+  static uint64_t checksum(const Table& table);
+
+  /**
+   * 特徴を抽出します。
+   * update が false の場合は評価値を返し、
+   * kppBlack, kppWhite を指定すると先後の玉それぞれの KPP の合計を格納します。
+   */
   template <class U, bool update>
-  U extract(const Board& board, U delta);
+  U extract(const Board& board, U delta, U* kppBlack = nullptr, U* kppWhite = nullptr);
+
+};
 
+/**
+ * KPP を 8bit に量子化したパラメータ
+ * KPP は玉の位置ごとのシフト量を使い kpp[king][index] << shift[king] で元の値を近似します。
+ * KKP は元の精度のまま保持します。
+ */
+struct CompactTable {
+  int8_t kpp[81][KPP_SIZE];
+  int16_t kkp[81][81][KKP_MAX];
+  uint8_t shift[81];
 };
 
+/**
+ * 評価関数の構成
+ * Evaluator の評価値計算はこのポリシーで特殊化されます。
+ * @tparam kpp KPP を使用するかどうか
+ * @tparam diff 差分計算を行うかどうか
+ * @tparam hashTable 評価値キャッシュを使用するかどうか
+ */
+template <bool kpp, bool diff, bool hashTable>
+struct EvaluatorPolicy {
+  static CONSTEXPR_CONST bool Kpp = kpp;
+  static CONSTEXPR_CONST bool Diff = diff;
+  static CONSTEXPR_CONST bool HashTable = hashTable;
+};
+
+namespace evaluator_policy {
+
+using Default     = EvaluatorPolicy<true, true, true>;
+using NoHashTable = EvaluatorPolicy<true, true, false>;
+using NoDiff      = EvaluatorPolicy<true, false, true>;
+using NoKpp       = EvaluatorPolicy<false, true, true>;
+
+} // namespace evaluator_policy
+
+/**
+ * 実行時に選択する評価関数の構成
+ */
+enum class EvaluatorVariant : int {
+  Default,
+  NoHashTable,
+  NoDiff,
+  NoKpp,
+  Num,
+};
+
+/**
+ * 全てのテーブルと構成の組み合わせについてマクロを展開します。
+ */
+#define EVALUATOR_INSTANTIATE_EACH__(M) \
+M(Evaluator::Table, evaluator_policy::Default) \
+M(Evaluator::Table, evaluator_policy::NoHashTable) \
+M(Evaluator::Table, evaluator_policy::NoDiff) \
+M(Evaluator::Table, evaluator_policy::NoKpp) \
+M(CompactTable, evaluator_policy::Default) \
+M(CompactTable, evaluator_policy::NoHashTable) \
+M(CompactTable, evaluator_policy::NoDiff) \
+M(CompactTable, evaluator_policy::NoKpp)
+
+/**
+ * 使用中のテーブルと構成に対応する特殊化を呼び出します。
+ */
+#define EVALUATOR_DISPATCH__(func, args) \
+  switch (variant_) { \
+  case EvaluatorVariant::NoHashTable: \
+    return compact_ ? func<CompactTable, evaluator_policy::NoHashTable> args : func<Table, evaluator_policy::NoHashTable> args; \
+  case EvaluatorVariant::NoDiff: \
+    return compact_ ? func<CompactTable, evaluator_policy::NoDiff> args : func<Table, evaluator_policy::NoDiff> args; \
+  case EvaluatorVariant::NoKpp: \
+    return compact_ ? func<CompactTable, evaluator_policy::NoKpp> args : func<Table, evaluator_policy::NoKpp> args; \
+  default: \
+    return compact_ ? func<CompactTable, evaluator_policy::Default> args : func<Table, evaluator_policy::Default> args; \
+  }
+
 class Evaluator : public Feature<int16_t> {
 public:
 
@@ -255,7 +416,17 @@ public:
 
 private:
 
-  EvaluateTable<18> evaluateCache_;
+  /** 評価値キャッシュ (コピー元と共有します。) */
+  std::shared_ptr<EvaluateTable> evaluateCache_;
+
+  /** 量子化したパラメータ (使用しない場合は nullptr, コピー元と共有します。) */
+  std::shared_ptr<const CompactTable> compact_;
+
+  /** 評価関数の構成 */
+  static EvaluatorVariant variant_;
+
+  template <class Tbl>
+  const Tbl& getTable_() const;
 
   std::shared_ptr<Table> readFvBin();
 
@@ -268,10 +439,42 @@ private:
   Value evaluateMaterial_(const Board& board) const;
 
   /**
-   * 局面の駒割りを除いた評価値を算出します。
+   * 局面の評価値を算出します。
    * @param board
+   * @param material
+   */
+  template <class Tbl, class P>
+  ValuePair evaluate_(const Board& board, const Value& material);
+
+  /**
+   * 複数の局面の評価値をまとめて算出します。
+   */
+  template <class Tbl, class P>
+  void evaluateBatch_(const Board* boards, size_t num, ValuePair* results);
+
+  /**
+   * 着手後の評価で参照する評価値キャッシュと KPP の行をプリフェッチします。
+   */
+  template <class Tbl, class P>
+  void prefetch_(const Board& board, const Move& move) const;
+
+  /**
+   * 局面の KKP の合計を算出します。
+   * @param board
+   */
+  template <class Tbl>
+  Value evaluateKkp_(const Board& board) const;
+
+  /**
+   * 玉の移動による評価値の変化値を算出します。
+   * 動いた玉の KPP のみを計算し直し、もう一方は差分計算します。
+   * @param board 着手後の局面を指定します。
+   * @param material 着手後の駒割りを指定します。
+   * @param prevValuePair
+   * @param move
    */
-  Value evaluate_(const Board& board);
+  template <bool black, class Tbl, class P>
+  ValuePair evaluateKingDiff_(const Board& board, const Value& material, const ValuePair& prevValuePair, const Move& move);
 
   /**
    * 指定した指し手による評価値の変化値を算出します。
@@ -279,12 +482,34 @@ private:
    * @param prevValuePair
    * @param move
    */
-  template <bool black>
-  ValuePair evaluateDiff_(const Board& board, const ValuePair& prevValuePair, const Move& move);
+  template <bool black, class Tbl, class P>
+  ValuePair evaluateDiff_(const Board& board, const ValuePair& prevValuePair, const Move& move, bool* cacheHit);
 
-  template <bool black, bool isKing, bool positionalOnly>
+  template <class Tbl, class P>
+  ValuePair evaluateDiff_(const Board& board, const ValuePair& prevValuePair, const Move& move, bool* cacheHit) {
+    if (!board.isBlack()) {
+      return evaluateDiff_<true, Tbl, P>(board, prevValuePair, move, cacheHit);
+    } else {
+      return evaluateDiff_<false, Tbl, P>(board, prevValuePair, move, cacheHit);
+    }
+  }
+
+  template <bool black, bool isKing, bool positionalOnly, class Tbl>
   Value estimate_(const Board& board, const Move& move);
 
+  template <bool positionalOnly, class Tbl>
+  Value estimate_(const Board& board, const Move& move) {
+    if (board.isBlack()) {
+      return (move.piece() == Piece::King ?
+              estimate_<true, true, positionalOnly, Tbl>(board, move):
+              estimate_<true, false, positionalOnly, Tbl>(board, move));
+    } else {
+      return (move.piece() == Piece::King ?
+              estimate_<false, true, positionalOnly, Tbl>(board, move):
+              estimate_<false, false, positionalOnly, Tbl>(board, move));
+    }
+  }
+
 public:
 
   Evaluator(InitType initType = InitType::File);
@@ -294,6 +519,44 @@ public:
   void init();
   void initRandom();
 
+  /**
+   * KPP の加算に SIMD 命令 (AVX2) を使うかどうかを設定します。
+   */
+  static void setSimdEnabled(bool enabled);
+
+  /**
+   * KPP の加算に SIMD 命令 (AVX2) を使っているかどうかを返します。
+   */
+  static bool isSimdEnabled();
+
+  /**
+   * 評価関数の構成を設定します。
+   * 評価値キャッシュには構成の区別が無いため, 切り替えた後は clearCache を呼び出してください。
+   */
+  static void setVariant(EvaluatorVariant variant) {
+    variant_ = variant;
+  }
+
+  static EvaluatorVariant getVariant() {
+    return variant_;
+  }
+
+  static const char* getVariantName(EvaluatorVariant variant);
+
+  /**
+   * 名前から評価関数の構成を取得します。
+   * @return {該当する構成が無い場合は false を返します。}
+   */
+  static bool parseVariant(const std::string& name, EvaluatorVariant& variant);
+
+  /**
+   * 以降に InitType::File で生成する Evaluator が
+   * 量子化したパラメータ (eval_q8.bin) を使用するかどうかを設定します。
+   */
+  static void setCompactEnabled(bool enabled);
+
+  static bool isCompactEnabled();
+
   Evaluator& operator=(const Evaluator& src) {
     Feature<ValueType>::operator=(src);
     return *this;
@@ -341,44 +604,113 @@ public:
     return Feature<int16_t>::writeFile(filename);
   }
 
+  /**
+   * ファイルをメモリにマップしてパラメータとして使用します。
+   */
+  bool mapFile();
+
+  /**
+   * ファイルをメモリにマップしてパラメータとして使用します。
+   * @param filename
+   * @param verify
+   */
+  bool mapFile(const char* filename, bool verify = false) {
+    return Feature<int16_t>::mapFile(filename, verify);
+  }
+
   /**
    * fv.bin があれば読み込んで並べ替えを行います。
    */
   bool convertFromFvBin();
 
+  /**
+   * パラメータを量子化してファイルに書き出します。
+   * @param filename
+   */
+  bool writeCompactFile(const char* filename) const;
+
+  /**
+   * パラメータを量子化して eval_q8.bin に書き出します。
+   */
+  bool writeCompactFile() const;
+
+  /**
+   * 量子化したパラメータをファイルから読み込んで使用します。
+   * ファイルはメモリにマップし、参照コンストラクタで作ったコピーと共有します。
+   * @param filename
+   */
+  bool readCompactFile(const char* filename);
+
+  /**
+   * 量子化したパラメータを eval_q8.bin から読み込んで使用します。
+   */
+  bool readCompactFile();
+
   /**
    * 局面の評価値を算出します。
    * @param board
    */
   ValuePair evaluate(const Board& board) {
-    return ValuePair(evaluateMaterial_(board), evaluate_(board));
+    EVALUATOR_DISPATCH__(evaluate_, (board, evaluateMaterial_(board)));
   }
 
+  /**
+   * 複数の局面の評価値をまとめて算出します。
+   * 結果は各局面に evaluate を呼び出した場合と一致します。
+   * @param boards
+   * @param num
+   * @param results num 個の評価値を受け取ります。
+   */
+  void evaluateBatch(const Board* boards, size_t num, ValuePair* results);
+  void evaluateBatch(const CompactBoard* boards, size_t num, ValuePair* results);
+
   /**
    * 指定した指し手に基づき評価値の差分計算を行います。
    * @param board 着手後の局面を指定します。
    * @param prevValuePair
    * @param move
+   * @param cacheHit 評価値キャッシュにヒットしたかどうかを受け取ります。
    */
-  ValuePair evaluateDiff(const Board& board, const ValuePair& prevValuePair, const Move& move) {
-    if (!board.isBlack()) {
-      return evaluateDiff_<true>(board, prevValuePair, move);
-    } else {
-      return evaluateDiff_<false>(board, prevValuePair, move);
+  ValuePair evaluateDiff(const Board& board, const ValuePair& prevValuePair, const Move& move, bool* cacheHit = nullptr) {
+    EVALUATOR_DISPATCH__(evaluateDiff_, (board, prevValuePair, move, cacheHit));
+  }
+
+  /**
+   * 指定した指し手による駒割りの変化のみを計算します。
+   * 遅延評価で KPP の差分計算を省略する場合に使用します。
+   * @param material 着手前の駒割りを指定します。
+   * @param move 着手済みの指し手 (取った駒が設定されていること)
+   * @param black 指し手の手番
+   */
+  static Value evaluateMaterialDiff(const Value& material, const Move& move, bool black) {
+    Value diff = Value::Zero;
+    auto captured = move.captured();
+    if (!captured.isEmpty()) {
+      diff += material::pieceExchange(captured);
+    }
+    if (move.promote()) {
+      diff += material::piecePromote(move.piece());
     }
+    return black ? material + diff : material - diff;
   }
 
   template <bool positionalOnly = false>
   Value estimate(const Board& board, const Move& move) {
-    if (board.isBlack()) {
-      return (move.piece() == Piece::King ?
-              estimate_<true, true, positionalOnly>(board, move):
-              estimate_<true, false, positionalOnly>(board, move));
-    } else {
-      return (move.piece() == Piece::King ?
-              estimate_<false, true, positionalOnly>(board, move):
-              estimate_<false, false, positionalOnly>(board, move));
+    if (compact_) {
+      return estimate_<positionalOnly, CompactTable>(board, move);
     }
+    return estimate_<positionalOnly, Table>(board, move);
+  }
+
+  /**
+   * 量子化したパラメータを使用しているかどうかを返します。
+   */
+  bool isCompact() const {
+    return compact_ != nullptr;
+  }
+
+  const CompactTable& compactTable() const {
+    return *compact_;
   }
 
   const Table& table() const {
@@ -386,11 +718,28 @@ public:
   }
 
   void clearCache() {
-    evaluateCache_.init();
+    evaluateCache_->init();
+  }
+
+  /**
+   * 評価値キャッシュのサイズを MBytes 単位で指定します。
+   */
+  bool setCacheSizeMB(uint32_t mbytes) {
+    return evaluateCache_->setSizeMB(mbytes);
   }
 
   void prefetch(uint64_t hash) const {
-    evaluateCache_.prefetch(hash);
+    evaluateCache_->prefetch(hash);
+  }
+
+  /**
+   * 指定した手を指した後の評価で参照する領域をプリフェッチします。
+   * 着手前に呼び出します。
+   * @param board 着手前の局面を指定します。
+   * @param move
+   */
+  void prefetch(const Board& board, const Move& move) const {
+    EVALUATOR_DISPATCH__(prefetch_, (board, move));
   }
 
 };
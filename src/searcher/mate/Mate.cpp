@@ -550,7 +550,7 @@ bool Mate::isIneffectiveEvasion(const Board& board, const Move move, const Move
 
 bool Mate::evade(Tree& tree, const Move check) {
   const Board& board = tree.getBoard();
-  Moves& moves = tree.getMoves();
+  MoveList& moves = tree.getMoves();
   Bitboard occ = board.getBOccupy() | board.getWOccupy();
 
   moves.clear();
@@ -610,7 +610,7 @@ bool Mate::evade(Tree& tree, const Move check) {
 
 bool Mate::mate3Ply(Tree& tree) {
   const Board& board = tree.getBoard();
-  Moves& moves = tree.getMoves();
+  MoveList& moves = tree.getMoves();
   bool black = board.isBlack();
   Bitboard occ = board.getBOccupy() | board.getWOccupy();
 
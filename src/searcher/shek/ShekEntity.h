@@ -10,7 +10,9 @@
 #include "HandSet.h"
 #include <cstdint>
 
-#define SHEK_INDEX_WIDTH 16
+// SHEK に登録されるのは対局の棋譜と探索中の経路上の局面のみなので
+// tree ごとに持つテーブルは小さくてよい。
+#define SHEK_INDEX_WIDTH 12
 
 #define SHEK_COUNT_WIDTH 5
 #define SHEK_TURN_WIDTH  1
@@ -39,6 +39,10 @@ public:
     return getEntity(hash).check(hash, HandSet(hand), board.isBlack());
   }
 
+  static size_t getMemorySize() {
+    return sizeof(ShekEntities) << SHEK_INDEX_WIDTH;
+  }
+
   bool isAllCleared() const {
     for (uint32_t i = 0; i < getSize(); i++) {
       if (!getEntity(i).isCleared()) {
@@ -8,7 +8,13 @@
 
 #include "core/def.h"
 #include "core/util/Memory.h"
+#include "logger/Logger.h"
+#include <new>
+#include <thread>
+#include <vector>
+#include <algorithm>
 #include <cstdint>
+#include <cassert>
 
 namespace sunfish {
 
@@ -19,8 +25,84 @@ template <class E> class HashTable {
 private:
 
   E* table_;
-  uint32_t size_;
-  uint32_t mask_;
+  uint64_t size_;
+  uint64_t mask_;
+
+  /**
+   * 全エントリに対して func を実行します。
+   * 大きなテーブルでは複数のスレッドで分担します。
+   */
+  template <class Func>
+  void forEach(Func func) {
+    uint64_t threads = 1;
+    if (sizeof(E) * size_ >= ParallelBytes) {
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if (threads == 1) {
+      for (uint64_t i = 0; i < size_; i++) {
+        func(i);
+      }
+      return;
+    }
+
+    std::vector<std::thread> workers;
+    uint64_t chunk = (size_ + threads - 1) / threads;
+    for (uint64_t begin = 0; begin < size_; begin += chunk) {
+      uint64_t end = std::min(begin + chunk, size_);
+      workers.emplace_back([func, begin, end]() {
+        for (uint64_t i = begin; i < end; i++) {
+          func(i);
+        }
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  /**
+   * 2^bits 個のエントリを確保します。
+   * 確保できない場合はサイズを半分にして 2^minBits まで再試行します。
+   * 全て失敗した場合は元のテーブルをそのまま残して false を返します。
+   */
+  bool allocate(uint32_t bits, uint32_t minBits) {
+    E* table = nullptr;
+    uint32_t b = bits;
+    while (true) {
+      table = static_cast<E*>(memory::allocateLarge(sizeof(E) << b));
+      if (table != nullptr || b <= minBits) {
+        break;
+      }
+      b--;
+    }
+    if (table == nullptr) {
+      Loggers::error << "failed to allocate a hash table: " << (sizeof(E) << bits) << " bytes";
+      return false;
+    }
+    if (b != bits) {
+      Loggers::warning << "hash table is shrunk to " << (sizeof(E) << b) << " bytes";
+    }
+
+    release();
+    table_ = table;
+    size_ = 1llu << b;
+    mask_ = size_ - 1;
+    // first-touch の場合も各スレッドのノードに分散させるため並列に初期化する。
+    forEach([table](uint64_t i) {
+      new (&table[i]) E();
+    });
+    return true;
+  }
+
+  void release() {
+    if (table_ != nullptr) {
+      for (uint64_t i = 0; i < size_; i++) {
+        table_[i].~E();
+      }
+      memory::freeLarge(table_, sizeof(E) * size_);
+      table_ = nullptr;
+    }
+  }
 
 protected:
 
@@ -44,6 +126,9 @@ public:
 
   static CONSTEXPR_CONST uint32_t DefaultBits = 18;
 
+  /** これ以上のサイズのテーブルは並列に初期化する */
+  static CONSTEXPR_CONST uint64_t ParallelBytes = 16llu * 1024llu * 1024llu;
+
   HashTable(uint32_t bits = DefaultBits) : table_(nullptr), size_(0) {
     init(bits);
   }
@@ -51,29 +136,41 @@ public:
   HashTable(HashTable&&) = delete;
 
   ~HashTable() {
-    delete [] table_;
+    release();
   }
 
-  void init(uint32_t bits = 0) {
-    uint32_t newSize = 1 << bits;
+  /**
+   * 2^bits 個のエントリで初期化します。
+   * bits が 0 の場合は現在のサイズのままエントリを初期化します。
+   * @return 確保に失敗した場合は false
+   */
+  bool init(uint32_t bits = 0, uint32_t minBits = 1) {
+    uint64_t newSize = 1llu << bits;
     if (bits != 0 && size_ != newSize) {
-      size_ = newSize;
-      mask_ = size_ - 1;
-      if (table_ != nullptr) {
-        delete[] table_;
-      }
-      table_ = new E[size_];
-    } else {
-      for (uint32_t i = 0; i < size_; i++) {
-        table_[i].init(i);
-      }
+      return allocate(bits, std::min(minBits, bits));
     }
+    E* table = table_;
+    forEach([table](uint64_t i) {
+      table[i].init(i);
+    });
+    return true;
   }
 
-  uint32_t getSize() const {
+  uint64_t getSize() const {
     return size_;
   }
 
+  /**
+   * 指定したバイト数に収まる最大のビット数を返します。
+   */
+  static uint32_t bitsForBytes(uint64_t bytes, uint32_t minBits = 1) {
+    uint32_t bits = minBits;
+    while (bits < 63 && (sizeof(E) << (bits + 1)) <= bytes) {
+      bits++;
+    }
+    return bits;
+  }
+
   void prefetch(uint64_t hash) const {
     const E* p = &table_[hash&mask_];
     const char* addr = reinterpret_cast<const char*>(p);
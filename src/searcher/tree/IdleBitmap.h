@@ -0,0 +1,147 @@
+/* IdleBitmap.h
+ *
+ * Kubo Ryosuke
+ */
+
+#ifndef SUNFISH_IDLEBITMAP__
+#define SUNFISH_IDLEBITMAP__
+
+#include "core/def.h"
+#include <atomic>
+#include <cstdint>
+
+namespace sunfish {
+
+/**
+ * 空いている worker や tree を管理する lock-free なビット集合
+ */
+class IdleBitmap {
+private:
+
+  static CONSTEXPR_CONST int WordBits = 64;
+
+  std::atomic<uint64_t>* words_;
+  int wordSize_;
+
+public:
+
+  IdleBitmap() : words_(nullptr), wordSize_(0) {
+  }
+  IdleBitmap(const IdleBitmap&) = delete;
+  IdleBitmap(IdleBitmap&&) = delete;
+
+  ~IdleBitmap() {
+    delete[] words_;
+  }
+
+  /**
+   * [begin, end) を空きとして初期化します。
+   */
+  void init(int begin, int end) {
+    int wordSize = (end + WordBits - 1) / WordBits;
+    if (wordSize != wordSize_) {
+      delete[] words_;
+      wordSize_ = wordSize;
+      words_ = new std::atomic<uint64_t>[wordSize_];
+    }
+    for (int w = 0; w < wordSize_; w++) {
+      words_[w].store(0llu);
+    }
+    for (int id = begin; id < end; id++) {
+      release(id);
+    }
+  }
+
+  /**
+   * id を空きにします。
+   */
+  void release(int id) {
+    words_[id / WordBits].fetch_or(1llu << (id % WordBits));
+  }
+
+  /**
+   * 指定した id を確保します。
+   * @return {既に使用中の場合は false を返します。}
+   */
+  bool acquire(int id) {
+    uint64_t bit = 1llu << (id % WordBits);
+    return words_[id / WordBits].fetch_and(~bit) & bit;
+  }
+
+  /**
+   * 空いている id を1つ確保します。
+   * @return {空きが無い場合は -1 を返します。}
+   */
+  int acquireAny() {
+    for (int w = 0; w < wordSize_; w++) {
+      uint64_t word = words_[w].load();
+      while (word != 0llu) {
+        int index = 0;
+        while (!(word & (1llu << index))) {
+          index++;
+        }
+        if (words_[w].compare_exchange_weak(word, word & ~(1llu << index))) {
+          return w * WordBits + index;
+        }
+      }
+    }
+    return -1;
+  }
+
+  /**
+   * id が空きかどうかを返します。
+   */
+  bool contains(int id) const {
+    return words_[id / WordBits].load() & (1llu << (id % WordBits));
+  }
+
+  /**
+   * 空いている id ごとに func を呼び出します。
+   */
+  template <class Func>
+  void forEach(Func&& func) const {
+    for (int w = 0; w < wordSize_; w++) {
+      for (uint64_t word = words_[w].load(); word != 0llu; word &= word - 1llu) {
+        int index = 0;
+        while (!(word & (1llu << index))) {
+          index++;
+        }
+        func(w * WordBits + index);
+      }
+    }
+  }
+
+  /**
+   * 空いている id のうち先頭から最大 n 個について func を呼び出します。
+   */
+  template <class Func>
+  void forEach(int n, Func&& func) const {
+    for (int w = 0; w < wordSize_ && n > 0; w++) {
+      for (uint64_t word = words_[w].load(); word != 0llu && n > 0; word &= word - 1llu, n--) {
+        int index = 0;
+        while (!(word & (1llu << index))) {
+          index++;
+        }
+        func(w * WordBits + index);
+      }
+    }
+  }
+
+  /**
+   * 空いている id の数を返します。
+   */
+  int count() const {
+    int n = 0;
+    for (int w = 0; w < wordSize_; w++) {
+      for (uint64_t word = words_[w].load(std::memory_order_relaxed); word != 0llu; word &= word - 1llu) {
+        n++;
+      }
+    }
+    return n;
+  }
+
+};
+
+} // namespace sunfish
+
+#endif // SUNFISH_IDLEBITMAP__
@@ -12,15 +12,18 @@ namespace sunfish {
 
 Tree::Tree() : ply_(0), checkHistCount_(0) {
   shekTable_.init();
+  resetArena();
 }
 
 void Tree::init(int id, const Board& board, Evaluator& eval, const std::vector<Move>& record) {
   ply_ = 0;
   board_ = board;
+  resetArena();
 #ifndef NDEBUG
   board_.validate();
 #endif
   stack_[0].valuePair = eval.evaluate(board);
+  stack_[0].lazyEval = false;
   stack_[0].checking = board_.isChecking();
   stack_[0].pv.init();
   stack_[0].killer1 = Move::empty();
@@ -42,6 +45,7 @@ void Tree::init(int id, const Board& board, Evaluator& eval, const std::vector<M
 
   tlp_.treeId = id;
   tlp_.used = false;
+  tlp_.splitDepth.store(0);
 }
 
 void Tree::release(const std::vector<Move>& record) {
@@ -65,7 +69,7 @@ void Tree::release(const std::vector<Move>& record) {
 #endif
 }
 
-void Tree::sort(const Moves::iterator begin) {
+void Tree::sort(const MoveList::iterator begin) {
   auto& moves = stack_[ply_].moves;
   auto& values = sortValues_;
   auto beginIndex = begin - moves.begin();
@@ -134,12 +138,15 @@ bool Tree::debug__matchPath(const char* path) const {
   return debug__getPath() == path;
 }
 
-void Tree::clearStack() {
-  while (ply_ >= 1) {
+/**
+ * 指定した ply まで局面を戻します。
+ */
+void Tree::rewind(int ply) {
+  while (ply_ > ply) {
     auto& curr = stack_[ply_];
     ply_--;
     if (!curr.move.isEmpty()) {
-      board_.unmakeMove(curr.move);
+      board_.unmakeMove(curr.undo);
       shekTable_.unset(board_);
     } else {
       board_.unmakeNullMove();
@@ -147,16 +154,49 @@ void Tree::clearStack() {
   }
 }
 
+/**
+ * parent とルート局面から同じ手順を辿っている ply を返します。
+ */
+int Tree::getCommonPly(const Tree& parent) const {
+  int base = checkHistCount_ - ply_;
+  int parentBase = parent.checkHistCount_ - parent.ply_;
+  if (base < 0 || base != parentBase) {
+    return 0;
+  }
+
+  int maxPly = std::min(ply_, parent.ply_);
+  int ply = 0;
+  while (ply < maxPly &&
+         checkHist_[base+ply].hash == parent.checkHist_[base+ply].hash &&
+         stack_[ply+1].move == parent.stack_[ply+1].move) {
+    ply++;
+  }
+  return ply;
+}
+
+void Tree::resetArena() {
+  for (int ply = 0; ply < StackSize; ply++) {
+    stack_[ply].moves.attach(moveArena_);
+    stack_[ply].histMoves.attach(histMoveArena_);
+  }
+}
+
 void Tree::fastCopy(Tree& parent) {
-  clearStack();
+  // 前回の split point と共通する手順は戻さずに再利用する。
+  int commonPly = getCommonPly(parent);
+  rewind(commonPly);
+  resetArena();
 
+  ply_ = 0;
   for (int ply = 1; ply <= parent.ply_; ply++) {
     Move move = parent.stack_[ply].move;
-    if (!move.isEmpty()) {
-      shekTable_.set(board_);
-      board_.makeMove(move);
-    } else {
-      board_.makeNullMove();
+    if (ply > commonPly) {
+      if (!move.isEmpty()) {
+        shekTable_.set(board_);
+        board_.makeMoveLegal(move, stack_[ply].undo);
+      } else {
+        board_.makeNullMove();
+      }
     }
     ply_++;
 
@@ -165,6 +205,7 @@ void Tree::fastCopy(Tree& parent) {
     curr.move = move;
     curr.checking = parentCurr.checking;
     curr.valuePair = parentCurr.valuePair;
+    curr.lazyEval = parentCurr.lazyEval;
 
     auto& child = stack_[ply_+1];
     auto& parentChild = parent.stack_[ply_+1];
@@ -12,6 +12,7 @@
 #include "../shek/ShekTable.h"
 #include "../tt/TT.h"
 #include "core/move/Moves.h"
+#include "core/util/Memory.h"
 #include "core/def.h"
 #include <atomic>
 #include <mutex>
@@ -19,8 +20,11 @@
 #include <cstdint>
 #include <cassert>
 
-#ifndef ENABLE_PREFETCH
-# define ENABLE_PREFETCH      1
+/**
+ * 探索中の指し手を合法手のみで生成し, 着手時の合法手チェックを省略します。
+ */
+#ifndef ENABLE_LEGAL_MOVE_GEN
+# define ENABLE_LEGAL_MOVE_GEN 1
 #endif
 
 namespace sunfish {
@@ -54,13 +58,21 @@ public:
   static CONSTEXPR_CONST int StackSize = 64;
   static CONSTEXPR_CONST int InvalidId = -1;
 
+  /** 1局面で生成される指し手の上限 */
+  static CONSTEXPR_CONST int MaxMovesPerNode = 1024;
+  /** 全ての ply で共有する指し手の領域 */
+  static CONSTEXPR_CONST int MoveArenaSize = MaxMovesPerNode * 16;
+  static CONSTEXPR_CONST int HistMoveArenaSize = MaxMovesPerNode * 8;
+  /** mate 等で isStackFull の判定を省略するため余裕を設ける。 */
+  static CONSTEXPR_CONST int ArenaMargin = MaxMovesPerNode * 4;
+
 private:
 
   struct Node {
-    Moves::iterator ite;
+    MoveList::iterator ite;
     Move move;
-    Moves moves;
-    Moves histMoves;
+    MoveList moves;
+    MoveList histMoves;
     GenPhase genPhase;
     ExpStat expStat;
     int count;
@@ -81,6 +93,12 @@ private:
     bool isThroughPhase;
     bool checking;
     bool isHistorical;
+    bool evalCacheHit;
+    bool lazyEval;
+    /** 手番側のピンされた駒 (指し手生成時に計算) */
+    Bitboard pinned;
+    /** この ply に進めた手を戻すための記録 */
+    UndoRecord undo;
   };
 
   struct CheckHist {
@@ -91,6 +109,13 @@ private:
   /** stack */
   Node stack_[StackSize];
 
+  /**
+   * 各 ply の指し手は親の ply の末尾から積み上げる。
+   * 親の指し手が追加されるのは子の探索が終わった後なので上書きされない。
+   */
+  Move moveArena_[MoveArenaSize];
+  Move histMoveArena_[HistMoveArenaSize];
+
   /** SHEK table */
   ShekTable shekTable_;
 
@@ -115,7 +140,10 @@ private:
     int workerId;
     bool used;
     std::atomic<int> childCount;
+    /** この split point で beta-cut が発生した */
     std::atomic<bool> shutdown;
+    /** 途中参加先を lock せずに選ぶための残り深さ */
+    std::atomic<int> splitDepth;
     bool black;
     int depth;
     Value alpha;
@@ -126,7 +154,22 @@ private:
     bool improving;
   } tlp_;
 
-  void clearStack();
+  void clearStack() {
+    rewind(0);
+  }
+
+  void rewind(int ply);
+
+  int getCommonPly(const Tree& parent) const;
+
+  void attachMoves() {
+    auto& front = stack_[ply_-1];
+    auto& curr = stack_[ply_];
+    curr.moves.attach(front.moves.end());
+    curr.histMoves.attach(front.histMoves.end());
+  }
+
+  void resetArena();
 
   void fastCopy(Tree& parent);
 
@@ -144,10 +187,13 @@ public:
   bool isStackFull() const {
     // killer や mate で判定を省略するため余裕を設ける。
     assert(ply_ <= StackSize - 8);
-    return ply_ >= StackSize - 8;
+    const auto& curr = stack_[ply_];
+    return ply_ >= StackSize - 8 ||
+      curr.moves.end() + ArenaMargin > moveArena_ + MoveArenaSize ||
+      curr.histMoves.end() + ArenaMargin > histMoveArena_ + HistMoveArenaSize;
   }
 
-  Moves& getMoves() {
+  MoveList& getMoves() {
     return stack_[ply_].moves;
   }
 
@@ -188,38 +234,38 @@ public:
       (fmove.isCapturing() || (fmove.promote() && fmove.piece() != Piece::Silver));
   }
 
-  Moves::iterator getNextMove() {
+  MoveList::iterator getNextMove() {
     return stack_[ply_].ite;
   }
 
-  Moves::iterator getCurrentMove() {
+  MoveList::iterator getCurrentMove() {
     assert(stack_[ply_].ite != stack_[ply_].moves.begin());
     return stack_[ply_].ite - 1;
   }
 
-  Moves::iterator getBegin() {
+  MoveList::iterator getBegin() {
     return stack_[ply_].moves.begin();
   }
 
-  Moves::iterator getEnd() {
+  MoveList::iterator getEnd() {
     return stack_[ply_].moves.end();
   }
 
-  Moves::iterator selectFirstMove() {
+  MoveList::iterator selectFirstMove() {
     return stack_[ply_].ite = stack_[ply_].moves.begin();
   }
 
-  Moves::iterator selectNextMove() {
+  MoveList::iterator selectNextMove() {
     assert(stack_[ply_].ite != stack_[ply_].moves.end());
     return stack_[ply_].ite++;
   }
 
-  Moves::iterator selectPreviousMove() {
+  MoveList::iterator selectPreviousMove() {
     assert(stack_[ply_].ite != stack_[ply_].moves.begin());
     return stack_[ply_].ite--;
   }
 
-  Moves::iterator addMove(const Move& move) {
+  MoveList::iterator addMove(const Move& move) {
     stack_[ply_].moves.add(move);
     return stack_[ply_].moves.end() - 1;
   }
@@ -230,11 +276,20 @@ public:
     stack_[ply_].moves.removeStable(stack_[ply_].ite);
   }
 
-  void removeAfter(const Moves::iterator ite) {
+  /**
+   * 指し手を削除し, 末尾の指し手とソート値を空いた位置に移します。
+   */
+  MoveList::iterator removeMove(MoveList::iterator ite) {
+    auto& moves = stack_[ply_].moves;
+    sortValues_[getIndexByIterator(ite)] = sortValues_[moves.size() - 1];
+    return moves.remove(ite);
+  }
+
+  void removeAfter(const MoveList::iterator ite) {
     return stack_[ply_].moves.removeAfter(ite);
   }
 
-  int getIndexByIterator(const Moves::iterator ite) const {
+  int getIndexByIterator(const MoveList::iterator ite) const {
     return (int)(ite - stack_[ply_].moves.begin());
   }
 
@@ -248,22 +303,26 @@ public:
     return -1;
   }
 
-  void setSortValue(const Moves::iterator ite, int32_t value) {
+  void setSortValue(const MoveList::iterator ite, int32_t value) {
     auto index = getIndexByIterator(ite);
     sortValues_[index] = value;
   }
 
-  int32_t getSortValue(const Moves::iterator ite) {
+  int32_t getSortValue(const MoveList::iterator ite) {
     auto index = getIndexByIterator(ite);
     return sortValues_[index];
   }
 
+  int32_t* getSortValues() {
+    return sortValues_;
+  }
+
   void setSortValues(const int32_t* sortValues) {
     unsigned size = stack_[ply_].moves.size();
     memcpy(sortValues_, sortValues, sizeof(int32_t) * size);
   }
 
-  void sort(const Moves::iterator begin);
+  void sort(const MoveList::iterator begin);
 
   void sortAll() {
     sort(stack_[ply_].moves.begin());
@@ -333,6 +392,14 @@ public:
     return node.valuePair;
   }
 
+  /**
+   * 直前の makeMove で評価値キャッシュにヒットしたかどうかを返します。
+   */
+  bool isEvalCacheHit() const {
+    auto& node = stack_[ply_];
+    return node.evalCacheHit;
+  }
+
   bool hasPrefrontierNode() const {
     return ply_ >= 2;
   }
@@ -342,7 +409,10 @@ public:
     return eval.estimate<positionalOnly>(board_, move);
   }
 
-  bool makeMove(Evaluator& eval) {
+private:
+
+  template <bool lazy>
+  bool makeMove_(Evaluator& eval) {
     assert(stack_[ply_].ite != stack_[ply_].moves.begin());
     // frontier node
     auto& front = stack_[ply_];
@@ -355,20 +425,28 @@ public:
     checkHist_[checkHistCount_].check = front.checking;
     checkHist_[checkHistCount_].hash = board_.getHash();
     checkHistCount_++;
+#if ENABLE_PREFETCH
+    // prefetch (着手後の評価値キャッシュと KPP)
+    eval.prefetch(board_, move);
+#endif // ENABLE_PREFETCH
     bool checking = board_.isCheck(move);
     // make move
-    if (!board_.makeMove(move)) {
+#if ENABLE_LEGAL_MOVE_GEN
+    board_.makeMoveLegal(move, stack_[ply_+1].undo);
+#else
+    if (!board_.makeMove(move, stack_[ply_+1].undo)) {
       shekTable_.unset(board_);
       checkHistCount_--;
       return false;
     }
+#endif
 #if ENABLE_PREFETCH
     // prefetch
-    eval.prefetch(board_.getNoTurnHash());
     shekTable_.prefetch(board_.getBoardHash());
 #endif // ENABLE_PREFETCH
     // ply
     ply_++;
+    attachMoves();
     // current node
     auto& curr = stack_[ply_];
     curr.move = move;
@@ -384,15 +462,56 @@ public:
     child.excluded = Move::empty();
     child.isHistorical = false;
     // evaluation
-    curr.valuePair = eval.evaluateDiff(board_, front.valuePair, move);
+    curr.lazyEval = lazy;
+    if (lazy) {
+      curr.evalCacheHit = false;
+      curr.valuePair = ValuePair(Evaluator::evaluateMaterialDiff(front.valuePair.material(), move, !board_.isBlack()),
+                                 front.valuePair.positional());
+    } else {
+      curr.valuePair = eval.evaluateDiff(board_, front.valuePair, move, &curr.evalCacheHit);
+    }
     return true;
   }
 
+public:
+
+  bool makeMove(Evaluator& eval) {
+    return makeMove_<false>(eval);
+  }
+
+  /**
+   * 駒割りのみを更新して指し手を進めます。
+   * 評価値の位置評価は直前の局面の値で代用し, 必要になった時点で evaluateLazy を呼び出します。
+   */
+  bool makeMoveLazy(Evaluator& eval) {
+    return makeMove_<true>(eval);
+  }
+
+  /**
+   * makeMoveLazy で省略した評価値の差分計算を行います。
+   */
+  void evaluateLazy(Evaluator& eval) {
+    auto& curr = stack_[ply_];
+    auto& front = stack_[ply_-1];
+    assert(curr.lazyEval);
+    assert(!front.lazyEval);
+    curr.valuePair = eval.evaluateDiff(board_, front.valuePair, curr.move, &curr.evalCacheHit);
+    curr.lazyEval = false;
+  }
+
+  /**
+   * 評価値の差分計算を省略しているかどうかを返します。
+   */
+  bool isLazyEval() const {
+    auto& node = stack_[ply_];
+    return node.lazyEval;
+  }
+
   void unmakeMove() {
     auto& curr = stack_[ply_];
     ply_--;
     assert(stack_[ply_].ite != stack_[ply_].moves.begin());
-    board_.unmakeMove(curr.move);
+    board_.unmakeMove(curr.undo);
     shekTable_.unset(board_);
     checkHistCount_--;
   }
@@ -410,6 +529,7 @@ public:
 #endif // ENABLE_PREFETCH
     // ply
     ply_++;
+    attachMoves();
     // current node
     auto& curr = stack_[ply_];
     curr.move.setEmpty();
@@ -419,6 +539,7 @@ public:
     // frontier node
     auto& front = stack_[ply_-1];
     curr.valuePair = front.valuePair;
+    curr.lazyEval = false;
     // child node
     auto& child = stack_[ply_+1];
     child.killer1 = Move::empty();
@@ -438,8 +559,9 @@ public:
   bool makeMoveFast(const Move& move) {
     Move mtemp = move;
     mtemp.unsetCaptured();
-    if (board_.makeMove(mtemp)) {
+    if (board_.makeMove(mtemp, stack_[ply_+1].undo)) {
       ply_++;
+      attachMoves();
       auto& curr = stack_[ply_];
       curr.move = mtemp;
       return true;
@@ -450,7 +572,7 @@ public:
   void unmakeMoveFast() {
     auto& curr = stack_[ply_];
     ply_--;
-    board_.unmakeMove(curr.move);
+    board_.unmakeMove(curr.undo);
   }
 
   void updatePV(int depth) {
@@ -478,6 +600,13 @@ public:
     return node.pv;
   }
 
+  /**
+   * tree 1つあたりのメモリ使用量を返します。
+   */
+  static size_t getMemorySize() {
+    return sizeof(Tree) + ShekTable::getMemorySize();
+  }
+
   ShekTable& getShekTable() {
     return shekTable_;
   }
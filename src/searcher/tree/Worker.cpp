@@ -45,6 +45,7 @@ void Worker::startOnCurrentThread(int tid) {
 void Worker::stop() {
   if (this->thread.joinable()) {
     this->shutdown = true;
+    wakeUp();
     this->thread.join();
   }
 }
@@ -52,10 +53,16 @@ void Worker::stop() {
 void Worker::setJob(int tid) {
   this->treeId = tid;
   this->job = true;
+  wakeUp();
 }
 
 void Worker::unsetJob() {
-  this->job = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->job = false;
+  }
+  // waitForIdle で待っているスレッドを起こす
+  this->cond.notify_all();
 }
 
 void Worker::swapTree(int tid) {
@@ -66,19 +73,53 @@ void Worker::sleep() {
   this->sleeping = true;
 }
 
+void Worker::wakeUp() {
+  // park 中の判定と notify がすれ違わないようにロックを取る
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+  }
+  // waitForIdle で待っているスレッドと cond を共有するため全て起こす
+  this->cond.notify_all();
+}
+
+/**
+ * 割り当てられた探索が終わるまで待ちます。
+ */
+void Worker::waitForIdle() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->cond.wait(lock, [this]() {
+    return !this->job.load();
+  });
+}
+
 void Worker::waitForJob(Tree* suspendedTree) {
   if (suspendedTree != nullptr) {
-    std::lock_guard<std::mutex> lock(psearcher->getSplitMutex());
     unsetJob();
-    this->psearcher->addIdleWorker();
+    this->psearcher->addIdleWorker(this->workerId);
   }
 
+  // park 中に新しい split point が開かれたら途中参加を試みる
+  uint32_t splitGen = 0;
+  auto isReady = [this, suspendedTree, &splitGen]() {
+    return this->job.load() || this->shutdown.load() ||
+      (suspendedTree != nullptr && suspendedTree->getTlp().childCount.load() == 0) ||
+      (suspendedTree == nullptr && !this->sleeping.load() &&
+       this->psearcher->getSplitGeneration() != splitGen);
+  };
+
+  int spin = 0;
+  auto idleStart = std::chrono::steady_clock::now();
+  auto addIdleTime = [this, &idleStart]() {
+    auto elapsed = std::chrono::steady_clock::now() - idleStart;
+    this->info.idleTime += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  };
+
   while (true) {
     if (suspendedTree != nullptr && suspendedTree->getTlp().childCount.load() == 0) {
-      std::lock_guard<std::mutex> lock(this->psearcher->getSplitMutex());
-      if (!this->job) {
+      // 他の split point に確保されていなければ元の tree に戻る
+      if (this->psearcher->removeIdleWorker(this->workerId)) {
+        addIdleTime();
         setJob(suspendedTree->getTlp().treeId);
-        this->psearcher->reduceIdleWorker();
         return;
       }
     }
@@ -88,25 +129,39 @@ void Worker::waitForJob(Tree* suspendedTree) {
     }
 
     if (this->job) {
+      addIdleTime();
       this->psearcher->searchTlp(this->treeId);
-      {
-        std::lock_guard<std::mutex> lock(this->psearcher->getSplitMutex());
+      this->psearcher->releaseTree(this->treeId);
 
-        psearcher->releaseTree(this->treeId);
+      if (suspendedTree != nullptr && suspendedTree->getTlp().childCount.load() == 0) {
+        setJob(suspendedTree->getTlp().treeId);
+        return;
+      }
 
-        if (suspendedTree != nullptr && suspendedTree->getTlp().childCount.load() == 0) {
-          setJob(suspendedTree->getTlp().treeId);
-          return;
-        }
+      unsetJob();
+      this->psearcher->addIdleWorker(this->workerId);
+      idleStart = std::chrono::steady_clock::now();
+      spin = 0;
+    }
 
-        unsetJob();
-        this->psearcher->addIdleWorker();
-      }
+    // 進行中の split point に途中参加する
+    splitGen = this->psearcher->getSplitGeneration();
+    if (suspendedTree == nullptr && !this->sleeping &&
+        this->psearcher->joinSplit(this->workerId)) {
+      continue;
     }
 
-    if (this->sleeping) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (this->sleeping || spin >= SpinCount) {
+      // park
+      bool wasSleeping = this->sleeping;
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->cond.wait(lock, isReady);
+      if (wasSleeping) {
+        // 探索の間の待機時間は数えない
+        idleStart = std::chrono::steady_clock::now();
+      }
     } else {
+      spin++;
       std::this_thread::yield();
     }
   }
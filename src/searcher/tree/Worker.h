@@ -9,6 +9,8 @@
 #include "../SearchInfo.h"
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace sunfish {
 
@@ -17,6 +19,9 @@ class Searcher;
 
 struct Worker {
 
+  /** park する前に yield する回数 */
+  static CONSTEXPR_CONST int SpinCount = 1024;
+
   SearchInfoBase info;
   std::thread thread;
   Searcher* psearcher;
@@ -25,6 +30,8 @@ struct Worker {
   std::atomic<bool> job;
   std::atomic<bool> shutdown;
   std::atomic<bool> sleeping;
+  std::mutex mutex;
+  std::condition_variable cond;
 
   Worker();
   Worker(const Worker&) = delete;
@@ -47,6 +54,10 @@ struct Worker {
 
   void swapTree(int tid);
 
+  void wakeUp();
+
+  void waitForIdle();
+
   void waitForJob(Tree* suspendedTree);
 
 };
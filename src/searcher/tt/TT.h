@@ -8,6 +8,7 @@
 
 #include "TTE.h"
 #include "../table/HashTable.h"
+#include <algorithm>
 
 namespace sunfish {
 
@@ -18,10 +19,34 @@ private:
 
 public:
 
+  static CONSTEXPR_CONST uint32_t HashfullSamples = 1000;
+
   TT() : HashTable<TTEs>(TT_INDEX_WIDTH), age_(1) {}
   TT(const TT&) = delete;
   TT(TT&&) = delete;
 
+  /**
+   * サイズを MBytes 単位で指定します。
+   * 収まる最大の2の冪に切り詰めます。
+   * @return 確保に失敗した場合は false
+   */
+  bool setSizeMB(uint32_t mbytes) {
+    uint64_t bytes = (uint64_t)mbytes * 1024llu * 1024llu;
+    return init(bitsForBytes(bytes, TT_MIN_INDEX_WIDTH), TT_MIN_INDEX_WIDTH);
+  }
+
+  /**
+   * 現在の世代で埋まっている割合を千分率で返します。
+   */
+  uint32_t hashfull() const {
+    uint64_t samples = std::min((uint64_t)HashfullSamples, getSize());
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < samples; i++) {
+      n += getEntity((uint32_t)i).count(age_);
+    }
+    return (uint32_t)(n * 1000 / (samples * TTEs::size()));
+  }
+
   void evolve() {
     age_ = age_ % (TTE::AgeMax-1) + 1;
     assert(age_ != TTE::InvalidAge);
@@ -110,43 +110,38 @@ void TTE::updatePV(uint64_t newHash, int newDepth, uint16_t move, uint32_t newAg
 
 TTStatus TTEs::set(const TTE& entity) {
   // ハッシュ値が一致するスロットを探す
-  uint32_t l = lastAccess_ % Size;
   for (uint32_t i = 0; i < Size; i++) {
-    const uint32_t index = (l + i) % Size;
-    if (slots_[index].getHash() == entity.getHash()) {
-      slots_[index] = entity;
-      lastAccess_ = index;
+    if (slots_[i].getHash() == entity.getHash()) {
+      slots_[i] = entity;
       return TTStatus::Update;
     }
   }
 
   // 空きスロットを探す
-  l++;
   for (uint32_t i = 0; i < Size; i++) {
-    const uint32_t index = (l + i) % Size;
-    if (slots_[index].getAge() != entity.getAge()) {
-      slots_[index] = entity;
-      lastAccess_ = index;
+    if (slots_[i].getAge() != entity.getAge()) {
+      slots_[i] = entity;
       return TTStatus::New;
     }
   }
 
-  // 上書きする
-  const uint32_t index = l % Size;
+  // 最も浅いスロットを上書きする
+  uint32_t index = 0;
+  for (uint32_t i = 1; i < Size; i++) {
+    if (slots_[i].getDepth() < slots_[index].getDepth()) {
+      index = i;
+    }
+  }
   slots_[index] = entity;
-  lastAccess_ = index;
   return TTStatus::Collide;
 
 }
 
 bool TTEs::get(uint64_t hash, TTE& entity) {
 
-  uint32_t l = lastAccess_ % Size;
   for (uint32_t i = 0; i < Size; i++) {
-    const uint32_t index = (l + i) % Size;
-    if (slots_[index].checkHash(hash)) {
-      entity = slots_[index];
-      lastAccess_ = index;
+    if (slots_[i].checkHash(hash)) {
+      entity = slots_[i];
       return true;
     }
   }
@@ -13,6 +13,7 @@
 #include <iostream>
 
 #define TT_INDEX_WIDTH 19
+#define TT_MIN_INDEX_WIDTH (64 - TT_HASH_WIDTH + 1)
 
 // 1st word
 #define TT_AGE_WIDTH   3  // 2^3 = 8 [0, 7]
@@ -50,7 +51,7 @@
 
 static_assert(TT_AGE_WIDTH + TT_MATE_WIDTH + TT_HASH_WIDTH <= 64, "invalid data size");
 static_assert(TT_MOVE_WIDTH + TT_VALUE_WIDTH + TT_VTYPE_WIDTH + TT_DEPTH_WIDTH + TT_CSUM_WIDTH <= 64, "invalid data size");
-static_assert((TT_INDEX_WIDTH > 64 - TT_HASH_WIDTH), "invalid hash length");
+static_assert((TT_INDEX_WIDTH >= TT_MIN_INDEX_WIDTH), "invalid hash length");
 
 namespace sunfish {
 
@@ -177,18 +178,18 @@ public:
 
 };
 
-class TTEs {
+/**
+ * 1 cache line (64 bytes) に収まる TTE のバケット
+ * 置換は各エントリの世代と深さで判断します。
+ */
+class ALIGNAS(64) TTEs {
 private:
 
   static CONSTEXPR_CONST uint32_t Size = 4;
   TTE slots_[Size];
-  volatile uint32_t lastAccess_;
 
 public:
 
-  TTEs() : lastAccess_(0) {
-  }
-
   void init(uint32_t) {
     for (uint32_t i = 0; i < Size; i++) {
       slots_[i].init();
@@ -198,10 +199,26 @@ public:
   TTStatus set(const TTE& entity);
   bool get(uint64_t hash, TTE& entity);
 
+  /**
+   * 指定した世代のエントリ数を数えます。
+   */
+  uint32_t count(uint32_t age) const {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < Size; i++) {
+      n += slots_[i].getAge() == age ? 1 : 0;
+    }
+    return n;
+  }
+
+  static CONSTEXPR uint32_t size() {
+    return Size;
+  }
+
 };
 
 static_assert(sizeof(TTE) == 16, "invalid struct size");
-static_assert(sizeof(TTEs) == 72, "invalid struct size");
+static_assert(sizeof(TTEs) == 64, "invalid struct size");
+static_assert(alignof(TTEs) == 64, "invalid struct alignment");
 
 } // namespace sunfish
 
@@ -7,6 +7,7 @@
 
 #include "test/Test.h"
 #include "core/record/CsaReader.h"
+#include "core/move/MoveGenerator.h"
 
 using namespace sunfish;
 
@@ -946,4 +947,156 @@ P-00KI00GI00KE00KE00FU00FU00FU\n\
   }
 }
 
+TEST(BoardTest, pieceListTest) {
+  {
+    Board board;
+    board.init(Board::Handicap::Even);
+    ASSERT_EQ(38, board.getPieceListSize());
+    ASSERT_EQ(true, board.validate());
+
+    Move moves[] = {
+      Move(Piece::Pawn, S77, S76, false), // 76歩
+      Move(Piece::Pawn, S33, S34, false), // 34歩
+      Move(Piece::Bishop, S88, S22, true), // 22角成
+      Move(Piece::Silver, S31, S22, false), // 同銀
+      Move(Piece::Bishop, S55), // 55角打
+    };
+    const int sizes[] = { 38, 38, 37, 36, 37 };
+
+    int num = sizeof(moves) / sizeof(moves[0]);
+    for (int i = 0; i < num; i++) {
+      ASSERT_EQ(true, board.makeMove(moves[i]));
+      ASSERT_EQ(sizes[i], board.getPieceListSize());
+      ASSERT_EQ(true, board.validate());
+    }
+    for (int i = num - 1; i >= 0; i--) {
+      board.unmakeMove(moves[i]);
+      ASSERT_EQ(true, board.validate());
+    }
+    ASSERT_EQ(38, board.getPieceListSize());
+  }
+
+  {
+    // 二枚落ち
+    Board board;
+    board.init(Board::Handicap::TwoPieces);
+    ASSERT_EQ(36, board.getPieceListSize());
+    ASSERT_EQ(true, board.validate());
+  }
+}
+
+TEST(BoardTest, undoRecordTest) {
+  {
+    // 成り, 駒取り, 玉の移動, 駒打ちを含む局面
+    std::string src = "\
+P1 *  * +TO *  *  *  *  * -KY\n\
+P2+UM *  *  *  *  * -KI-OU * \n\
+P3+TO *  *  *  * -GI-KE * -GI\n\
+P4-FU *  *  *  * -FU-HI * -FU\n\
+P5 *  *  *  *  *  * -FU+FU * \n\
+P6 *  * -FU-UM * +FU * +HI+FU\n\
+P7+FU *  *  *  *  * +FU * +KE\n\
+P8+KI *  * +FU-TO+GI+KI *  * \n\
+P9+KY *  *  *  *  * +OU * +KY\n\
+P+00KY00FU\n\
+P-00KI00GI00KE00KE00FU00FU00FU\n\
+-\n\
+";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+    std::string csa = board.toStringCsa();
+    uint64_t hash = board.getHash();
+
+    Moves moves;
+    MoveGenerator::generateLegal(board, moves);
+    ASSERT(moves.size() != 0);
+    for (auto& move : moves) {
+      UndoRecord undo;
+      Move tmp = move;
+      board.makeMoveLegal(tmp, undo);
+
+      // 2手目は記録を使わずに戻す手と比較する。
+      Moves moves2;
+      MoveGenerator::generateLegal(board, moves2);
+      for (auto& move2 : moves2) {
+        Board board2 = board;
+        Move tmp2 = move2;
+        board2.makeMove(tmp2);
+        board2.unmakeMove(tmp2);
+
+        UndoRecord undo2;
+        Move tmp3 = move2;
+        board.makeMoveLegal(tmp3, undo2);
+        board.unmakeMove(undo2);
+        ASSERT_EQ(board2.toStringCsa(), board.toStringCsa());
+        ASSERT_EQ(board2.getHash(), board.getHash());
+      }
+
+      board.unmakeMove(undo);
+      ASSERT_EQ(true, board.validate());
+      ASSERT_EQ(csa, board.toStringCsa());
+      ASSERT_EQ(hash, board.getHash());
+      ASSERT_EQ(S39, board.getBKingSquare().index());
+      ASSERT_EQ(S22, board.getWKingSquare().index());
+    }
+  }
+}
+
+TEST(BoardTest, hashAfterTest) {
+  {
+    Board board;
+    board.init(Board::Handicap::Even);
+
+    Move moves[] = {
+      Move(Piece::Pawn, S77, S76, false), // 76歩
+      Move(Piece::Pawn, S33, S34, false), // 34歩
+      Move(Piece::Bishop, S88, S22, true), // 22角成
+      Move(Piece::Silver, S31, S22, false), // 同銀
+      Move(Piece::Bishop, S55), // 55角打
+    };
+
+    for (auto& move : moves) {
+      uint64_t hash = board.getHashAfter(move);
+      uint64_t noTurnHash = board.getNoTurnHashAfter(move);
+      ASSERT_EQ(true, board.makeMove(move));
+      ASSERT_EQ(board.getHash(), hash);
+      ASSERT_EQ(board.getNoTurnHash(), noTurnHash);
+    }
+  }
+
+  {
+    // 後手番の全ての手
+    std::string src = "\
+P1 *  * +TO *  *  *  *  * -KY\n\
+P2+UM *  *  *  *  * -KI-OU * \n\
+P3+TO *  *  *  * -GI-KE * -GI\n\
+P4-FU *  *  *  * -FU-HI * -FU\n\
+P5 *  *  *  *  *  * -FU+FU * \n\
+P6 *  * -FU-UM * +FU * +HI+FU\n\
+P7+FU *  *  *  *  * +FU * +KE\n\
+P8+KI *  * +FU-TO+GI+KI *  * \n\
+P9+KY *  *  *  *  * +OU * +KY\n\
+P+00KY00FU\n\
+P-00KI00GI00KE00KE00FU00FU00FU\n\
+-\n\
+";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    Moves moves;
+    MoveGenerator::generate(board, moves);
+    ASSERT(moves.size() != 0);
+    for (auto& move : moves) {
+      uint64_t hash = board.getHashAfter(move);
+      Move tmp = move;
+      if (board.makeMove(tmp)) {
+        ASSERT_EQ(board.getHash(), hash);
+        board.unmakeMove(tmp);
+      }
+    }
+  }
+}
+
 #endif // !defined(NDEBUG)
@@ -7,6 +7,7 @@
 
 #include "test/Test.h"
 #include "core/move/MoveGenerator.h"
+#include "core/move/MoveTable.h"
 #include "core/record/CsaReader.h"
 
 using namespace sunfish;
@@ -1016,4 +1017,185 @@ TEST(MoveGeneratorTest, testCheckLight) {
   }
 }
 
+TEST(MoveGeneratorTest, testLegal) {
+  {
+    // 57金がピンされている, 12歩打ちは打ち歩詰め
+    std::string src =
+"P1 *  *  *  * -HI *  * -KY-OU\n"
+"P2 *  *  *  *  *  *  * -GI * \n"
+"P3 *  *  *  *  *  *  * +KI * \n"
+"P4 *  *  *  *  *  *  *  *  * \n"
+"P5 *  *  *  *  *  *  *  *  * \n"
+"P6 *  *  *  *  *  *  *  *  * \n"
+"P7 *  *  *  * +KI *  *  *  * \n"
+"P8 *  *  *  *  *  *  *  *  * \n"
+"P9 *  *  *  * +OU *  *  *  * \n"
+"P+00FU\n"
+"P-\n"
+"+\n";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    Bitboard pinned = board.getPinnedPieces();
+    ASSERT(pinned.check(S57));
+    ASSERT(!pinned.check(S23));
+
+    Moves pseudo;
+    MoveGenerator::generate(board, pseudo);
+    Moves legal;
+    MoveGenerator::generateLegal(board, legal);
+
+    // 57金の横と斜めへの移動 (4手) と 12歩打ち
+    ASSERT_EQ(pseudo.size() - 5, legal.size());
+    ASSERT(pseudo.find(Move(Piece::Pawn, S12, false)) != pseudo.end());
+    ASSERT(legal.find(Move(Piece::Pawn, S12, false)) == legal.end());
+    ASSERT(legal.find(Move(Piece::Gold, S57, S56, false, false)) != legal.end());
+    ASSERT(legal.find(Move(Piece::Gold, S57, S67, false, false)) == legal.end());
+
+    for (auto ite = pseudo.begin(); ite != pseudo.end(); ite++) {
+      Board tmp = board;
+      Move move = *ite;
+      bool valid = tmp.makeMove(move);
+      ASSERT_EQ(valid, legal.find(*ite) != legal.end());
+    }
+  }
+}
+
+TEST(MoveGeneratorTest, testPext) {
+  if (!isBmi2Supported()) {
+    return;
+  }
+
+  bool pext0 = MoveTables::isPextEnabled();
+  uint64_t x = 0x2545f4914f6cdd1dllu;
+  for (int i = 0; i < 64; i++) {
+    Bitboard occ;
+    occ.init();
+    SQUARE_EACH(sq) {
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      if ((x & 0x03) == 0) {
+        occ.set(sq);
+      }
+    }
+    SQUARE_EACH(sq) {
+      MoveTables::setPextEnabled(false);
+      Bitboard horse = MoveTables::horse(sq, occ);
+      Bitboard dragon = MoveTables::dragon(sq, occ);
+      Bitboard left = MoveTables::left(sq, occ);
+      Bitboard rightUp = MoveTables::rightUp(sq, occ);
+      Bitboard rightDown = MoveTables::rightDown(sq, occ);
+      MoveTables::setPextEnabled(true);
+      ASSERT_EQ(horse, MoveTables::horse(sq, occ));
+      ASSERT_EQ(dragon, MoveTables::dragon(sq, occ));
+      ASSERT_EQ(left, MoveTables::left(sq, occ));
+      ASSERT_EQ(rightUp, MoveTables::rightUp(sq, occ));
+      ASSERT_EQ(rightDown, MoveTables::rightDown(sq, occ));
+    }
+  }
+  MoveTables::setPextEnabled(pext0);
+}
+
+TEST(MoveGeneratorTest, testScored) {
+  {
+    // 57金がピンされている, 23金で22銀を取れる
+    std::string src =
+"P1 *  *  *  * -HI *  * -KY-OU\n"
+"P2 *  *  *  *  *  *  * -GI * \n"
+"P3 *  *  *  *  *  *  * +KI * \n"
+"P4 *  *  *  *  *  *  *  *  * \n"
+"P5 *  *  *  *  *  *  *  *  * \n"
+"P6 *  *  *  *  *  *  *  *  * \n"
+"P7 *  *  *  * +KI *  *  *  * \n"
+"P8 *  *  *  *  *  *  *  *  * \n"
+"P9 *  *  *  * +OU *  *  *  * \n"
+"P+00FU00HI\n"
+"P-\n"
+"+\n";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+    Bitboard pinned = board.getPinnedPieces();
+
+    History history;
+    history.init();
+    history.add(History::getKey(Move(Piece::Gold, S57, S56, false, false)), 8, 8);
+    history.add(History::getKey(Move(Piece::Rook, S55, false)), 8, 1);
+
+    Moves plain;
+    MoveGenerator::generateCap(board, plain);
+    MoveGenerator::generateNoCap(board, plain);
+    MoveGenerator::generateDrop(board, plain);
+
+    Moves moves;
+    int32_t scores[1024];
+    HistoryScorer hscorer(history);
+    MoveGenerator::generateCap(board, moves, scores, hscorer);
+    MoveGenerator::generateNoCap(board, moves, scores, hscorer);
+    MoveGenerator::generateDrop(board, moves, scores, hscorer);
+    ASSERT_EQ(plain.size(), moves.size());
+    for (int i = 0; i < moves.size(); i++) {
+      ASSERT_EQ(plain[i], moves[i]);
+      ASSERT_EQ(hscorer(board, moves[i]), scores[i]);
+    }
+    int i56 = (int)(moves.find(Move(Piece::Gold, S57, S56, false, false)) - moves.begin());
+    int i55 = (int)(moves.find(Move(Piece::Rook, S55, false)) - moves.begin());
+    int i58 = (int)(moves.find(Move(Piece::Gold, S57, S58, false, false)) - moves.begin());
+    ASSERT(scores[i56] > scores[i58]);
+    ASSERT(scores[i55] < scores[i58]);
+
+    // 非合法手を除いてもスコアの対応は保たれる
+    Moves legal;
+    MoveGenerator::generateCapLegal(board, legal, scores, hscorer, pinned);
+    MoveGenerator::generateNoCapLegal(board, legal, scores, hscorer, pinned);
+    MoveGenerator::generateDropLegal(board, legal, scores, hscorer);
+    ASSERT_EQ(plain.size() - 5, legal.size());
+    for (int i = 0; i < legal.size(); i++) {
+      ASSERT_EQ(hscorer(board, legal[i]), scores[i]);
+    }
+
+  }
+
+  {
+    // 王手回避
+    std::string src =
+"P1 *  *  *  *  *  *  *  * -OU\n"
+"P2 *  *  *  *  *  *  *  *  * \n"
+"P3 *  *  *  *  *  *  *  *  * \n"
+"P4 *  *  *  *  *  *  *  *  * \n"
+"P5 *  *  *  * -HI *  *  *  * \n"
+"P6 *  *  *  *  *  *  *  *  * \n"
+"P7 *  *  * +GI * +KI *  *  * \n"
+"P8 *  *  *  *  *  *  *  *  * \n"
+"P9 *  *  *  * +OU *  *  *  * \n"
+"P+00KI\n"
+"P-\n"
+"+\n";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+    ASSERT(board.isChecking());
+
+    Moves plain;
+    MoveGenerator::generateEvasion(board, plain);
+
+    History history;
+    history.init();
+    history.add(History::getKey(Move(Piece::Gold, S58, false)), 8, 8);
+
+    Moves moves;
+    int32_t scores[1024];
+    HistoryScorer hscorer(history);
+    MoveGenerator::generateEvasion(board, moves, scores, hscorer);
+    ASSERT_EQ(plain.size(), moves.size());
+    for (int i = 0; i < moves.size(); i++) {
+      ASSERT_EQ(plain[i], moves[i]);
+      ASSERT_EQ(hscorer(board, moves[i]), scores[i]);
+    }
+    int i58 = (int)(moves.find(Move(Piece::Gold, S58, false)) - moves.begin());
+    ASSERT(i58 < moves.size());
+    ASSERT(scores[i58] > 0);
+  }
+}
+
 #endif // !defined(NDEBUG)
@@ -0,0 +1,75 @@
+/* PerftTest.cpp
+ *
+ * Kubo Ryosuke
+ */
+
+#if !defined(NDEBUG)
+
+#include "test/Test.h"
+#include "core/move/Perft.h"
+#include "core/record/CsaReader.h"
+
+using namespace sunfish;
+
+TEST(PerftTest, test) {
+  {
+    Board board(Board::Handicap::Even);
+    Perft perft;
+
+    ASSERT_EQ(1, perft.run(board, 0).leaves);
+    ASSERT_EQ(30, perft.run(board, 1).leaves);
+    ASSERT_EQ(900, perft.run(board, 2).leaves);
+    // 角の不成を生成しないため, 厳密な値 (25470) とは一致しない
+    ASSERT_EQ(25440, perft.run(board, 3).leaves);
+  }
+}
+
+TEST(PerftTest, testThreads) {
+  {
+    Board board(Board::Handicap::Even);
+    Perft single(1);
+    Perft multi(4);
+
+    auto result1 = single.run(board, 3);
+    auto result4 = multi.run(board, 3);
+    ASSERT_EQ(result1.leaves, result4.leaves);
+    ASSERT_EQ(result1.nodes, result4.nodes);
+    ASSERT_EQ(result1.divide.size(), result4.divide.size());
+    for (size_t i = 0; i < result1.divide.size(); i++) {
+      ASSERT_EQ(result1.divide[i].first, result4.divide[i].first);
+      ASSERT_EQ(result1.divide[i].second, result4.divide[i].second);
+    }
+  }
+}
+
+TEST(PerftTest, testLegal) {
+  {
+    std::string src =
+"P1-KY *  *  *  *  * -OU-KE-KY\n"
+"P2 *  *  *  * -GI * -KI *  * \n"
+"P3-FU *  *  * -HI *  * -GI-FU\n"
+"P4 *  * -FU+KA * -KI * -FU * \n"
+"P5 * -FU *  *  * -FU-FU *  * \n"
+"P6 *  * +FU-FU+FU *  *  * +FU\n"
+"P7+FU *  * +OU * +UM+KI *  * \n"
+"P8 *  *  *  *  *  *  * +HI * \n"
+"P9+KY+KE *  *  *  *  *  * +KY\n"
+"P+00GI00KE00KE00FU00FU00FU00FU00FU\n"
+"P-00KI00GI00FU\n"
+"+\n";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    Perft pseudo;
+    Perft legal;
+    legal.setLegal(true);
+
+    auto result1 = pseudo.run(board, 3);
+    auto result2 = legal.run(board, 3);
+    ASSERT_EQ(result1.leaves, result2.leaves);
+    ASSERT_EQ(result1.nodes, result2.nodes);
+  }
+}
+
+#endif // !defined(NDEBUG)
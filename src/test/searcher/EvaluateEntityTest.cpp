@@ -11,7 +11,7 @@
 using namespace sunfish;
 
 TEST(SeeTest, testEvaluateEntity) {
-  EvaluateEntity<21> entity;
+  EvaluateEntity entity;
 
   uint64_t hash1 = 0x8f70ac3b2973d012LL;
   uint64_t hash2 = 0x9b2185ef180294ceLL;
@@ -29,4 +29,29 @@ TEST(SeeTest, testEvaluateEntity) {
   ASSERT_EQ(false, ok2);
 }
 
+TEST(SeeTest, testEvaluateEntityKpp) {
+  EvaluateEntity entity;
+
+  uint64_t hash1 = 0x8f70ac3b2973d012LL;
+  uint64_t hash2 = 0x9b2185ef180294ceLL;
+  Value positional;
+  Value kppBlack;
+  Value kppWhite;
+  bool kppValid;
+
+  entity.set(hash1, 1234, -56789, 98765);
+  ASSERT_EQ(true, entity.get(hash1, positional, kppBlack, kppWhite, kppValid));
+  ASSERT_EQ(true, kppValid);
+  ASSERT_EQ(1234, positional.int32());
+  ASSERT_EQ(-56789, kppBlack.int32());
+  ASSERT_EQ(98765, kppWhite.int32());
+  ASSERT_EQ(false, entity.get(hash2, positional, kppBlack, kppWhite, kppValid));
+
+  entity.set(hash2, -4321);
+  ASSERT_EQ(true, entity.get(hash2, positional, kppBlack, kppWhite, kppValid));
+  ASSERT_EQ(false, kppValid);
+  ASSERT_EQ(-4321, positional.int32());
+  ASSERT_EQ(false, entity.get(hash1, positional));
+}
+
 #endif // !defined(NDEBUG)
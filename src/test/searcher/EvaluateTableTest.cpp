@@ -11,7 +11,7 @@
 using namespace sunfish;
 
 TEST(SeeTest, testEvaluateTable) {
-  EvaluateTable<21> table;
+  EvaluateTable table(21);
 
   uint64_t hash1 = 0x8f70ac3b2973d012LL;
   uint64_t hash2 = 0x9b2185ef180294ceLL;
@@ -29,5 +29,21 @@ TEST(SeeTest, testEvaluateTable) {
   ASSERT_EQ(false, ok2);
 }
 
+TEST(SeeTest, testEvaluateTableSize) {
+  EvaluateTable table;
+
+  uint64_t hash1 = 0x8f70ac3b2973d012LL;
+  Value value1 = -1234;
+  Value result1;
+
+  table.setSizeMB(1);
+  ASSERT_EQ(1llu << 16, table.getSize());
+
+  table.set(hash1, value1);
+  bool ok1 = table.get(hash1, result1);
+  ASSERT_EQ(true, ok1);
+  ASSERT_EQ(value1.int32(), result1.int32());
+}
+
 #endif // !defined(NDEBUG)
 
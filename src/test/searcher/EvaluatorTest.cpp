@@ -8,6 +8,11 @@
 #include "test/Test.h"
 #include "searcher/eval/Evaluator.h"
 #include "core/record/CsaReader.h"
+#include "core/move/MoveGenerator.h"
+#include "core/avx2.h"
+#include <fstream>
+#include <cstdio>
+#include <cstring>
 
 using namespace sunfish;
 
@@ -249,6 +254,53 @@ TEST(EvaluatorTest, testEvaluateDiff) {
 
 }
 
+TEST(EvaluatorTest, testEvaluateKingDiff) {
+
+  Evaluator eval(Evaluator::InitType::Random);
+
+  {
+    std::string src =
+"P1-KY-KE-GI-KI-OU-KI-GI-KE-KY\n"
+"P2 * -HI *  *  * +GI * -KA * \n"
+"P3-FU-FU-FU-FU * -FU-FU-FU-FU\n"
+"P4 *  *  *  *  *  *  *  *  * \n"
+"P5 *  *  *  *  *  *  *  *  * \n"
+"P6 *  *  *  *  *  *  *  *  * \n"
+"P7+FU+FU+FU+FU+FU+FU+FU+FU+FU\n"
+"P8 * +KA *  * -FU *  * +HI * \n"
+"P9+KY+KE+GI+KI+OU+KI * +KE+KY\n"
+"P+\n"
+"P-\n"
+"+\n";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    Move moves[] = {
+      Move(Piece::King, S59, S58, false), // 先手玉が駒を取る
+      Move(Piece::King, S51, S42, false), // 後手玉が駒を取る
+      Move(Piece::Pawn, S77, S76, false),
+      Move(Piece::King, S42, S52, false), // 後手玉が駒を取らずに移動
+      Move(Piece::Bishop, S88, S33, true),
+      Move(Piece::King, S52, S53, false),
+    };
+
+    auto valuePair = eval.evaluate(board);
+    for (auto& move : moves) {
+      ASSERT_EQ(true, board.makeMove(move));
+      valuePair = eval.evaluateDiff(board, valuePair, move);
+      auto correctValuePair = eval.evaluate(board);
+
+      ASSERT_EQ(true, valuePair.isKppValid());
+      ASSERT_EQ(correctValuePair.material().int32(), valuePair.material().int32());
+      ASSERT_EQ(correctValuePair.positional().int32(), valuePair.positional().int32());
+      ASSERT_EQ(correctValuePair.kppBlack().int32(), valuePair.kppBlack().int32());
+      ASSERT_EQ(correctValuePair.kppWhite().int32(), valuePair.kppWhite().int32());
+    }
+  }
+
+}
+
 TEST(EvaluatorTest, testEstimate) {
 
   Evaluator eval(Evaluator::InitType::Zero);
@@ -297,6 +349,325 @@ TEST(EvaluatorTest, testEstimate) {
 
 }
 
+TEST(EvaluatorTest, testSimd) {
+
+  if (!isAvx2Supported()) {
+    return;
+  }
+
+  Evaluator eval(Evaluator::InitType::Random);
+  bool simdEnabled = Evaluator::isSimdEnabled();
+
+  {
+    std::string src =
+"P1-KY *  *  *  *  * -OU-KE-KY\n"
+"P2 *  *  *  * -GI * -KI *  * \n"
+"P3-FU *  *  * -HI *  * -GI-FU\n"
+"P4 *  * -FU+KA * -KI * -FU * \n"
+"P5 * -FU *  *  * -FU-FU *  * \n"
+"P6 *  * +FU-FU+FU *  *  * +FU\n"
+"P7+FU *  * +OU * +UM+KI *  * \n"
+"P8 *  *  *  *  *  *  * +HI * \n"
+"P9+KY+KE *  *  *  *  *  * +KY\n"
+"P+00GI00KE00KE00FU00FU00FU00FU00FU\n"
+"P-00KI00GI00FU\n"
+"+\n";
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    Evaluator::setSimdEnabled(false);
+    auto scalarValuePair = eval.evaluate(board);
+    Evaluator::setSimdEnabled(true);
+    auto simdValuePair = eval.evaluate(board);
+
+    ASSERT_EQ(scalarValuePair.positional().int32(), simdValuePair.positional().int32());
+  }
+
+  Evaluator::setSimdEnabled(simdEnabled);
+
+}
+
+TEST(EvaluatorTest, testEvaluateBatch) {
+
+  Evaluator eval(Evaluator::InitType::Random);
+  bool simdEnabled = Evaluator::isSimdEnabled();
+
+  std::string src =
+"P1-KY-KE-GI-KI-OU-KI-GI-KE-KY\n"
+"P2 * -HI *  *  *  *  * -KA * \n"
+"P3-FU-FU-FU-FU * -FU-FU-FU-FU\n"
+"P4 *  *  *  *  *  *  *  *  * \n"
+"P5 *  *  *  *  *  *  *  *  * \n"
+"P6 *  *  *  *  *  *  *  *  * \n"
+"P7+FU+FU+FU+FU+FU+FU+FU+FU+FU\n"
+"P8 * +KA *  *  *  *  * +HI * \n"
+"P9+KY+KE+GI+KI+OU+KI * +KE+KY\n"
+"P+00FU\n"
+"P-00GI\n"
+"+\n";
+  std::istringstream iss(src);
+  Board board;
+  CsaReader::readBoard(iss, board);
+
+  // 玉の位置を共有する局面と異なる局面を混在させる
+  std::vector<Board> boards;
+  std::vector<CompactBoard> compactBoards;
+  Moves moves;
+  MoveGenerator::generate(board, moves);
+  for (auto& move : moves) {
+    Board tmp = board;
+    if (tmp.makeMove(move)) {
+      boards.push_back(tmp);
+      compactBoards.push_back(tmp.getCompactBoard());
+    }
+  }
+  ASSERT(boards.size() > 8);
+
+  for (bool simd : { false, true }) {
+    Evaluator::setSimdEnabled(simd);
+
+    std::vector<ValuePair> results(boards.size());
+    eval.evaluateBatch(boards.data(), boards.size(), results.data());
+    for (size_t i = 0; i < boards.size(); i++) {
+      auto correctValuePair = eval.evaluate(boards[i]);
+      ASSERT_EQ(correctValuePair.material().int32(), results[i].material().int32());
+      ASSERT_EQ(correctValuePair.positional().int32(), results[i].positional().int32());
+      ASSERT_EQ(correctValuePair.kppBlack().int32(), results[i].kppBlack().int32());
+      ASSERT_EQ(correctValuePair.kppWhite().int32(), results[i].kppWhite().int32());
+    }
+
+    std::vector<ValuePair> compactResults(compactBoards.size());
+    eval.evaluateBatch(compactBoards.data(), compactBoards.size(), compactResults.data());
+    for (size_t i = 0; i < compactBoards.size(); i++) {
+      ASSERT_EQ(results[i].value().int32(), compactResults[i].value().int32());
+    }
+  }
+
+  Evaluator::setSimdEnabled(simdEnabled);
+
+}
+
+TEST(EvaluatorTest, testVariant) {
+
+  Evaluator eval(Evaluator::InitType::Random);
+  auto variant = Evaluator::getVariant();
+
+  std::string src =
+"P1-KY-KE-GI-KI-OU-KI-GI-KE-KY\n"
+"P2 * -HI *  *  *  *  * -KA * \n"
+"P3-FU-FU-FU-FU-FU-FU-FU-FU-FU\n"
+"P4 *  *  *  *  *  *  *  *  * \n"
+"P5 *  *  *  *  *  *  *  *  * \n"
+"P6 *  *  *  *  *  *  *  *  * \n"
+"P7+FU+FU+FU+FU+FU+FU+FU+FU+FU\n"
+"P8 * +KA *  *  *  *  * +HI * \n"
+"P9+KY+KE+GI+KI+OU+KI+GI+KE+KY\n"
+"P+\n"
+"P-\n"
+"+\n";
+
+  Move moves[] = {
+    Move(Piece::Pawn, S77, S76, false),
+    Move(Piece::Pawn, S33, S34, false),
+    Move(Piece::Bishop, S88, S22, true),
+    Move(Piece::Silver, S31, S22, false),
+    Move(Piece::King, S59, S58, false),
+    Move(Piece::Bishop, S55),
+  };
+
+  auto run = [&](EvaluatorVariant v, std::vector<ValuePair>& values) {
+    Evaluator::setVariant(v);
+    eval.clearCache();
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+    auto valuePair = eval.evaluate(board);
+    values.push_back(valuePair);
+    for (auto move : moves) {
+      ASSERT(board.makeMove(move));
+      valuePair = eval.evaluateDiff(board, valuePair, move);
+      values.push_back(valuePair);
+    }
+  };
+
+  std::vector<ValuePair> correct;
+  run(EvaluatorVariant::Default, correct);
+
+  // KPP を使用する構成は全て同じ評価値になる
+  for (auto v : { EvaluatorVariant::NoHashTable, EvaluatorVariant::NoDiff }) {
+    std::vector<ValuePair> values;
+    run(v, values);
+    ASSERT_EQ(correct.size(), values.size());
+    for (size_t i = 0; i < correct.size(); i++) {
+      ASSERT_EQ(correct[i].value().int32(), values[i].value().int32());
+    }
+  }
+
+  // KPP を使用しない構成は KPP の分だけ評価値が異なる
+  {
+    std::vector<ValuePair> values;
+    run(EvaluatorVariant::NoKpp, values);
+    for (size_t i = 0; i < correct.size(); i++) {
+      ASSERT_EQ(correct[i].material().int32(), values[i].material().int32());
+    }
+    Evaluator::setVariant(EvaluatorVariant::NoKpp);
+    eval.clearCache();
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+    auto valuePair = eval.evaluate(board);
+    ASSERT_EQ(0, valuePair.kppBlack().int32());
+    ASSERT_EQ(0, valuePair.kppWhite().int32());
+    ASSERT_EQ(correct[0].positional().int32() - correct[0].kppBlack().int32() + correct[0].kppWhite().int32(),
+              valuePair.positional().int32());
+  }
+
+  EvaluatorVariant parsed;
+  ASSERT(Evaluator::parseVariant("nodiff", parsed));
+  ASSERT(parsed == EvaluatorVariant::NoDiff);
+  ASSERT(!Evaluator::parseVariant("unknown", parsed));
+
+  Evaluator::setVariant(variant);
+  eval.clearCache();
+
+}
+
+TEST(EvaluatorTest, testMapFile) {
+  const char* filename = "test_eval.bin";
+
+  Evaluator eval(Evaluator::InitType::Random);
+  ASSERT(eval.writeFile(filename));
+
+  {
+    // コピーして読み込み
+    Evaluator eval2(Evaluator::InitType::Zero);
+    ASSERT(eval2.readFile(filename));
+    ASSERT(!eval2.isMapped());
+    ASSERT(memcmp(eval.t_, eval2.t_, sizeof(Evaluator::Table)) == 0);
+  }
+
+  {
+    // マップして読み込み
+    Evaluator eval2(Evaluator::InitType::Zero);
+    ASSERT(eval2.mapFile(filename, true));
+    ASSERT(eval2.isMapped());
+    ASSERT(memcmp(eval.t_, eval2.t_, sizeof(Evaluator::Table)) == 0);
+
+    // 参照コピーはマップした領域を共有する
+    Evaluator eval3(eval2);
+    ASSERT_EQ(eval2.t_, eval3.t_);
+  }
+
+  {
+    // チェックサムの不一致
+    std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(sizeof(Evaluator::FileHeader) + 12345);
+    char c = 0x55;
+    file.write(&c, 1);
+    file.close();
+
+    Evaluator eval2(Evaluator::InitType::Zero);
+    ASSERT(!eval2.readFile(filename));
+    ASSERT(!eval2.mapFile(filename, true));
+    ASSERT(!eval2.isMapped());
+  }
+
+  {
+    // ヘッダの無い古い形式
+    std::ofstream file(filename, std::ios::binary | std::ios::out);
+    file.write((const char*)eval.t_, sizeof(Evaluator::Table));
+    file.close();
+
+    Evaluator eval2(Evaluator::InitType::Zero);
+    ASSERT(eval2.mapFile(filename));
+    ASSERT(memcmp(eval.t_, eval2.t_, sizeof(Evaluator::Table)) == 0);
+  }
+
+  std::remove(filename);
+}
+
+TEST(EvaluatorTest, testCompact) {
+  const char* filename = "test_eval_q8.bin";
+
+  Evaluator eval(Evaluator::InitType::Random);
+
+  std::string src =
+"P1-KY-KE-GI-KI-OU-KI-GI-KE-KY\n"
+"P2 * -HI *  *  * +GI * -KA * \n"
+"P3-FU-FU-FU-FU * -FU-FU-FU-FU\n"
+"P4 *  *  *  *  *  *  *  *  * \n"
+"P5 *  *  *  *  *  *  *  *  * \n"
+"P6 *  *  *  *  *  *  *  *  * \n"
+"P7+FU+FU+FU+FU+FU+FU+FU+FU+FU\n"
+"P8 * +KA *  * -FU *  * +HI * \n"
+"P9+KY+KE+GI+KI+OU+KI * +KE+KY\n"
+"P+\n"
+"P-\n"
+"+\n";
+
+  Move moves[] = {
+    Move(Piece::King, S59, S58, false),
+    Move(Piece::King, S51, S42, false),
+    Move(Piece::Pawn, S77, S76, false),
+    Move(Piece::King, S42, S52, false),
+    Move(Piece::Bishop, S88, S33, true),
+    Move(Piece::King, S52, S53, false),
+  };
+
+  {
+    // 値が int8_t に収まる場合は元の評価値と一致する
+    ASSERT(eval.writeCompactFile(filename));
+    Evaluator compact(Evaluator::InitType::Zero);
+    ASSERT(compact.readCompactFile(filename));
+    ASSERT(compact.isCompact());
+
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    auto valuePair = compact.evaluate(board);
+    ASSERT_EQ(eval.evaluate(board).positional().int32(), valuePair.positional().int32());
+    for (auto& move : moves) {
+      ASSERT_EQ(eval.estimate(board, move).int32(), compact.estimate(board, move).int32());
+      ASSERT_EQ(true, board.makeMove(move));
+      valuePair = compact.evaluateDiff(board, valuePair, move);
+      ASSERT_EQ(eval.evaluate(board).positional().int32(), valuePair.positional().int32());
+    }
+  }
+
+  {
+    // シフトが必要な場合も差分計算と全計算が一致する
+    for (int i = 0; i < KPP_SIZE; i += 7) {
+      eval.t_->kpp[Square(S58).index()][i] *= 50;
+      eval.t_->kpp[Square(S42).reverse().index()][i] *= 50;
+    }
+    ASSERT(eval.writeCompactFile(filename));
+    Evaluator compact(Evaluator::InitType::Zero);
+    ASSERT(compact.readCompactFile(filename));
+
+    // 参照コピーは量子化したパラメータを共有する
+    Evaluator copy(compact);
+    ASSERT(copy.isCompact());
+
+    std::istringstream iss(src);
+    Board board;
+    CsaReader::readBoard(iss, board);
+
+    auto valuePair = copy.evaluate(board);
+    for (auto& move : moves) {
+      ASSERT_EQ(true, board.makeMove(move));
+      valuePair = copy.evaluateDiff(board, valuePair, move);
+      auto correctValuePair = copy.evaluate(board);
+      ASSERT_EQ(correctValuePair.positional().int32(), valuePair.positional().int32());
+      ASSERT_EQ(correctValuePair.kppBlack().int32(), valuePair.kppBlack().int32());
+      ASSERT_EQ(correctValuePair.kppWhite().int32(), valuePair.kppWhite().int32());
+    }
+  }
+
+  std::remove(filename);
+}
+
 TEST(EvaluatorTest, testSymmetrize) {
   ASSERT_EQ(KPP_HBPAWN + 17, symmetrizeKppIndex(KPP_HBPAWN + 17));
   ASSERT_EQ(KPP_HWROOK + 2, symmetrizeKppIndex(KPP_HWROOK + 2));
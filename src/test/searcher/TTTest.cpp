@@ -0,0 +1,46 @@
+/* TTTest.cpp
+ *
+ * Kubo Ryosuke
+ */
+
+#if !defined(NDEBUG)
+
+#include "test/Test.h"
+#include "searcher/tt/TT.h"
+
+using namespace sunfish;
+
+TEST(TTTest, testSetSizeMB) {
+  TT tt;
+
+  tt.setSizeMB(1);
+  ASSERT(tt.getSize() * sizeof(TTEs) <= 1llu * 1024 * 1024);
+  ASSERT(tt.getSize() * sizeof(TTEs) * 2 > 1llu * 1024 * 1024);
+
+  tt.setSizeMB(80);
+  ASSERT(tt.getSize() * sizeof(TTEs) <= 80llu * 1024 * 1024);
+  ASSERT(tt.getSize() * sizeof(TTEs) * 2 > 80llu * 1024 * 1024);
+
+  // 最小サイズ
+  tt.setSizeMB(0);
+  ASSERT_EQ(1llu << TT_MIN_INDEX_WIDTH, tt.getSize());
+}
+
+TEST(TTTest, testHashfull) {
+  TT tt;
+  tt.setSizeMB(1);
+  tt.init();
+  tt.evolve();
+
+  ASSERT_EQ(0u, tt.hashfull());
+
+  for (uint64_t i = 0; i < tt.getSize(); i++) {
+    uint64_t hash = (i * 0x9e3779b97f4a7c15llu) & ~(tt.getSize() - 1);
+    tt.entryPV(hash | i, 1, 0);
+  }
+
+  ASSERT(tt.hashfull() > 0u);
+  ASSERT(tt.hashfull() <= 1000u);
+}
+
+#endif // !defined(NDEBUG)
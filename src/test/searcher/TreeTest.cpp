@@ -143,4 +143,61 @@ P-00FU00FU00FU\n\
 
 }
 
+namespace {
+
+void makeMoveForTest(Tree& tree, Evaluator& eval, const Move& move) {
+  tree.initGenPhase();
+  tree.addMove(move);
+  tree.selectNextMove();
+  tree.makeMove(eval);
+}
+
+} // namespace
+
+TEST(TreeTest, testUse) {
+
+  Tree parent;
+  Tree child;
+  Evaluator eval(Evaluator::InitType::Zero);
+  Board board(Board::Handicap::Even);
+  std::vector<Move> record;
+
+  parent.init(0, board, eval, record);
+  child.init(1, board, eval, record);
+
+  makeMoveForTest(parent, eval, Move(Piece::Pawn, S77, S76, false));
+  makeMoveForTest(parent, eval, Move(Piece::Pawn, S33, S34, false));
+  child.use(parent, 1);
+  ASSERT_EQ(parent.getBoard().toStringCsa(), child.getBoard().toStringCsa());
+  ASSERT_EQ(parent.getBoard().getHash(), child.getBoard().getHash());
+
+  // 子は split point より深く進んでいる
+  makeMoveForTest(child, eval, Move(Piece::Pawn, S27, S26, false));
+  child.unuse();
+
+  // 76歩までは共通の手順
+  parent.unmakeMove();
+  makeMoveForTest(parent, eval, Move(Piece::Pawn, S83, S84, false));
+  child.use(parent, 1);
+  ASSERT_EQ(parent.getBoard().toStringCsa(), child.getBoard().toStringCsa());
+  ASSERT_EQ(parent.getBoard().getHash(), child.getBoard().getHash());
+  ASSERT_EQ(true, child.getBoard().validate());
+
+  // 共通の手順がない
+  parent.unmakeMove();
+  parent.unmakeMove();
+  makeMoveForTest(parent, eval, Move(Piece::Pawn, S27, S26, false));
+  child.use(parent, 1);
+  ASSERT_EQ(parent.getBoard().toStringCsa(), child.getBoard().toStringCsa());
+  ASSERT_EQ(parent.getBoard().getHash(), child.getBoard().getHash());
+  ASSERT_EQ(true, child.getBoard().validate());
+
+  child.unuse();
+  child.release(record);
+  parent.release(record);
+  ASSERT_EQ(board.getHash(), child.getBoard().getHash());
+  ASSERT_EQ(board.getHash(), parent.getBoard().getHash());
+
+}
+
 #endif // !defined(NDEBUG)